@@ -0,0 +1,1164 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "buffer.h"
+#include "file.h"
+#include "filescan.h"
+#include "btree.h"
+#include "node_search.h"
+#include "page.h"
+#include "exceptions/end_of_file_exception.h"
+
+/**
+ * Benchmarks for the storage layer. Run as
+ *
+ *   ./badgerdb_bench [name]
+ *
+ * where name selects a single benchmark; without it every benchmark runs.
+ */
+
+using namespace badgerdb;
+
+// -----------------------------------------------------------------------------
+// Globals
+// -----------------------------------------------------------------------------
+const std::string benchFileName = "bench.pages";
+
+// Thread counts the scaling benchmarks step through
+const int threadCounts[] = {1, 2, 4, 8, 16, 32};
+
+// Every replacement policy, for benchmarks that compare them
+const ReplacementPolicyType policyTypes[] = {CLOCK, LRU_K, TWO_Q, ARC};
+
+// -----------------------------------------------------------------------------
+// Forward declarations
+// -----------------------------------------------------------------------------
+
+std::vector<PageId> createPages(const std::string& name, const int numPages);
+double elapsedSeconds(const std::chrono::steady_clock::time_point& start);
+void dropFileCache(const std::string& name);
+void benchBufMgrScaling();
+void benchPolicies();
+void benchBackgroundWriter();
+void benchPrefetch();
+void benchFileIO();
+void benchDurability();
+void benchZeroCopy();
+void benchPax();
+void benchParallelScan();
+void benchBatchScan();
+void benchRing();
+void benchNodeSearch();
+
+// -----------------------------------------------------------------------------
+// Helpers
+// -----------------------------------------------------------------------------
+
+/**
+ * Creates a file of numPages pages, each holding one record with its own page number.
+ */
+std::vector<PageId> createPages(const std::string& name, const int numPages)
+{
+	if(File::exists(name))
+		File::remove(name);
+
+	std::vector<PageId> pageIds;
+	PageFile file = PageFile::create(name);
+	for(int i = 0; i < numPages; i++)
+	{
+		PageId pageNo;
+		Page page = file.allocatePage(pageNo);
+		page.insertRecord(std::to_string(pageNo));
+		file.writePage(pageNo, page);
+		pageIds.push_back(pageNo);
+	}
+	return pageIds;
+}
+
+/**
+ * Asks the kernel to forget the cached pages of a file, so that the next reads go to the device.
+ */
+void dropFileCache(const std::string& name)
+{
+	int fd = open(name.c_str(), O_RDONLY);
+	if(fd < 0)
+		return;
+	fdatasync(fd);
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+}
+
+double elapsedSeconds(const std::chrono::steady_clock::time_point& start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// -----------------------------------------------------------------------------
+// BufMgr scaling: readPage/unPinPage from many threads
+// -----------------------------------------------------------------------------
+
+/**
+ * Pins random pages, checks that each holds its own page number and unpins it again.
+ * With globalLatch set every call goes through one mutex, the way callers had to share a pool before.
+ */
+void pinWorker(BufMgr* bufMgr, File* file, const std::vector<PageId>* pageIds, const int ops,
+								const unsigned seed, std::mutex* globalLatch, std::atomic<int>* errors)
+{
+	std::mt19937 rng(seed);
+	RecordId rid;
+	rid.slot_number = 1;
+
+	for(int i = 0; i < ops; i++)
+	{
+		rid.page_number = (*pageIds)[rng() % pageIds->size()];
+		Page* page;
+
+		if(globalLatch != NULL)
+			globalLatch->lock();
+		bufMgr->readPage(file, rid.page_number, page);
+		if(globalLatch != NULL)
+			globalLatch->unlock();
+
+		if(page->getRecord(rid) != std::to_string(rid.page_number))
+			(*errors)++;
+
+		if(globalLatch != NULL)
+			globalLatch->lock();
+		bufMgr->unPinPage(file, rid.page_number, false);
+		if(globalLatch != NULL)
+			globalLatch->unlock();
+	}
+}
+
+/**
+ * Runs pinWorker on numThreads threads and returns the throughput in operations per second.
+ */
+double runPinWorkers(BufMgr* bufMgr, File* file, const std::vector<PageId>& pageIds, const int numThreads,
+											const int opsPerThread, std::mutex* globalLatch, std::atomic<int>& errors)
+{
+	std::vector<std::thread> workers;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for(int t = 0; t < numThreads; t++)
+		workers.push_back(std::thread(pinWorker, bufMgr, file, &pageIds, opsPerThread, t + 1, globalLatch, &errors));
+	for(int t = 0; t < numThreads; t++)
+		workers[t].join();
+	return numThreads * (double)opsPerThread / elapsedSeconds(start);
+}
+
+void benchBufMgrScaling()
+{
+	const int numPages = 1024;
+	const int opsPerThread = 200000;
+	const std::uint32_t numShards = 64;
+
+	std::cout << "BufMgr readPage/unPinPage scaling (" << numPages << " pages, "
+						<< std::thread::hardware_concurrency() << " hardware threads)\n";
+	std::vector<PageId> pageIds = createPages(benchFileName, numPages);
+	std::atomic<int> errors(0);
+
+	{
+		PageFile file = PageFile::open(benchFileName);
+
+		// Every page fits: measures the hit path
+		BufMgr sharded(2 * numPages, numShards);
+		BufMgr locked(2 * numPages);
+		std::mutex globalLatch;
+		runPinWorkers(&sharded, &file, pageIds, 1, numPages * 4, NULL, errors);
+		runPinWorkers(&locked, &file, pageIds, 1, numPages * 4, &globalLatch, errors);
+
+		double shardedBase = 0, lockedBase = 0;
+		std::cout << std::setw(8) << "threads" << std::setw(16) << "global mutex" << std::setw(10) << "speedup"
+							<< std::setw(16) << "sharded" << std::setw(10) << "speedup" << "\n";
+		for(int threads : threadCounts)
+		{
+			double lockedOps = runPinWorkers(&locked, &file, pageIds, threads, opsPerThread, &globalLatch, errors);
+			double shardedOps = runPinWorkers(&sharded, &file, pageIds, threads, opsPerThread, NULL, errors);
+			if(threads == 1)
+			{
+				lockedBase = lockedOps;
+				shardedBase = shardedOps;
+			}
+			std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+								<< std::setw(14) << lockedOps / 1e6 << "M/s" << std::setw(9) << lockedOps / lockedBase << "x"
+								<< std::setw(14) << shardedOps / 1e6 << "M/s" << std::setw(9) << shardedOps / shardedBase << "x\n";
+		}
+
+		// A pool a quarter of the file: every thread keeps evicting and reading pages in
+		for(ReplacementPolicyType policyType : policyTypes)
+		{
+			BufMgr small(numPages / 4, numShards, policyType);
+			double missOps = runPinWorkers(&small, &file, pageIds, 32, opsPerThread / 20, NULL, errors);
+			std::cout << "eviction stress, 32 threads, " << small.getBufStats().policy << ": " << std::setprecision(2)
+								<< missOps / 1e6 << "M ops/s, " << small.getBufStats().diskreads << " disk reads\n";
+		}
+	}
+	File::remove(benchFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "BufMgr scaling FAILED: " << errors << " pages held the wrong contents\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Replacement policies: index lookups mixed with table scans
+// -----------------------------------------------------------------------------
+
+/**
+ * Reads and unpins one page.
+ */
+void touch(BufMgr* bufMgr, File* file, const PageId pageNo)
+{
+	Page* page;
+	bufMgr->readPage(file, pageNo, page);
+	bufMgr->unPinPage(file, pageNo, false);
+}
+
+void benchPolicies()
+{
+	// The file holds a small B+ tree (root, inner nodes, leaves) followed by a table scanned from end to end
+	const int numInner = 16;
+	const int numLeaves = 512;
+	const int numTablePages = 2048;
+	const int numBufs = 256;
+	const int rounds = 20;
+	const int lookupsPerRound = 2000;
+
+	std::cout << "Replacement policies: " << lookupsPerRound << " index lookups then a " << numTablePages
+						<< " page scan, " << rounds << " rounds, " << numBufs << " frames\n";
+	std::vector<PageId> pageIds = createPages(benchFileName, 1 + numInner + numLeaves + numTablePages);
+
+	{
+		PageFile file = PageFile::open(benchFileName);
+		std::cout << std::setw(8) << "policy" << std::setw(12) << "hit ratio" << std::setw(14) << "disk reads"
+							<< std::setw(12) << "seconds" << "\n";
+		for(ReplacementPolicyType policyType : policyTypes)
+		{
+			BufMgr bufMgr(numBufs, 1, policyType);
+			std::mt19937 rng(1);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			for(int round = 0; round < rounds; round++)
+			{
+				// Lookups: root, one inner node, then a leaf; leaves are skewed towards the low key range
+				for(int i = 0; i < lookupsPerRound; i++)
+				{
+					int leaf = (rng() % numLeaves) * (rng() % numLeaves) / numLeaves;
+					touch(&bufMgr, &file, pageIds[0]);
+					touch(&bufMgr, &file, pageIds[1 + leaf * numInner / numLeaves]);
+					touch(&bufMgr, &file, pageIds[1 + numInner + leaf]);
+				}
+
+				for(int i = 0; i < numTablePages; i++)
+					touch(&bufMgr, &file, pageIds[1 + numInner + numLeaves + i]);
+			}
+
+			BufStats& stats = bufMgr.getBufStats();
+			std::cout << std::setw(8) << stats.policy << std::fixed << std::setprecision(3) << std::setw(12)
+								<< stats.hitRatio() << std::setw(14) << stats.diskreads << std::setprecision(2)
+								<< std::setw(12) << elapsedSeconds(start) << "\n";
+		}
+	}
+	File::remove(benchFileName);
+}
+
+// -----------------------------------------------------------------------------
+// Background writer: foreground versus background writes under an update workload
+// -----------------------------------------------------------------------------
+
+/**
+ * Pins random pages, dirtying every other one, until ops pages have been touched.
+ */
+void updateWorker(BufMgr* bufMgr, File* file, const std::vector<PageId>* pageIds, const int ops,
+									const unsigned seed, std::atomic<int>* errors)
+{
+	std::mt19937 rng(seed);
+	RecordId rid;
+	rid.slot_number = 1;
+
+	for(int i = 0; i < ops; i++)
+	{
+		rid.page_number = (*pageIds)[rng() % pageIds->size()];
+		Page* page;
+		bufMgr->readPage(file, rid.page_number, page);
+		if(page->getRecord(rid) != std::to_string(rid.page_number))
+			(*errors)++;
+		bufMgr->unPinPage(file, rid.page_number, i % 2 == 0);
+	}
+}
+
+void benchBackgroundWriter()
+{
+	const int numPages = 2048;
+	const int numBufs = 256;
+	const int numThreads = 4;
+	const int opsPerThread = 20000;
+
+	std::cout << "Background writer: " << numThreads << " threads, random pages, half of them dirtied, "
+						<< numBufs << " frames over " << numPages << " pages\n";
+	std::vector<PageId> pageIds = createPages(benchFileName, numPages);
+	std::atomic<int> errors(0);
+
+	{
+		PageFile file = PageFile::open(benchFileName);
+		std::cout << std::setw(12) << "writer" << std::setw(14) << "ops/s" << std::setw(14) << "foreground"
+							<< std::setw(14) << "background" << "\n";
+		for(int withWriter = 0; withWriter < 2; withWriter++)
+		{
+			BufMgr bufMgr(numBufs, 16);
+			if(withWriter)
+				bufMgr.startBackgroundWriter(0.1, 64, 1);
+
+			std::vector<std::thread> workers;
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for(int t = 0; t < numThreads; t++)
+				workers.push_back(std::thread(updateWorker, &bufMgr, &file, &pageIds, opsPerThread, t + 1, &errors));
+			for(int t = 0; t < numThreads; t++)
+				workers[t].join();
+			double ops = numThreads * (double)opsPerThread / elapsedSeconds(start);
+			bufMgr.stopBackgroundWriter();
+
+			BufStats& stats = bufMgr.getBufStats();
+			std::cout << std::setw(12) << (withWriter ? "on" : "off") << std::fixed << std::setprecision(0)
+								<< std::setw(14) << ops << std::setw(14) << stats.foregroundWrites
+								<< std::setw(14) << stats.backgroundWrites << "\n";
+		}
+	}
+	File::remove(benchFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "Background writer FAILED: " << errors << " pages held the wrong contents\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Prefetch: sequential FileScan with and without read-ahead on a cold file
+// -----------------------------------------------------------------------------
+
+void benchPrefetch()
+{
+	const int numPages = 4096;
+	const int numBufs = 256;
+	const std::uint32_t readAheads[] = {0, 4, 16, 64};
+	const int workPerPage = 2000;
+
+	std::cout << "Prefetch: FileScan over " << numPages << " pages not in the OS cache, " << numBufs << " frames\n";
+	createPages(benchFileName, numPages);
+	std::cout << std::setw(12) << "read-ahead" << std::setw(14) << "pages/s" << std::setw(14) << "prefetched" << "\n";
+	for(std::uint32_t readAhead : readAheads)
+	{
+		BufMgr bufMgr(numBufs);
+		int numRecords = 0;
+		volatile std::uint64_t sink = 0;
+
+		std::chrono::steady_clock::time_point start;
+		{
+			// opening the scan walks the page headers; only the scan itself is timed
+			FileScan scan(benchFileName, &bufMgr, readAhead);
+			dropFileCache(benchFileName);
+			start = std::chrono::steady_clock::now();
+			RecordId rid;
+			try
+			{
+				while(true)
+				{
+					scan.scanNext(rid);
+					std::string record = scan.getRecord();
+					// stands in for whatever the consumer does with the page
+					for(int i = 0; i < workPerPage; i++)
+						sink = sink + record[i % record.size()];
+					numRecords++;
+				}
+			}
+			catch(EndOfFileException&)
+			{
+			}
+		}
+		double pages = numRecords / elapsedSeconds(start);
+
+		std::cout << std::setw(12) << readAhead << std::fixed << std::setprecision(0) << std::setw(14) << pages
+							<< std::setw(14) << bufMgr.getBufStats().prefetchReads << "\n";
+		if(numRecords != numPages)
+		{
+			std::cout << "Prefetch FAILED: scanned " << numRecords << " of " << numPages << " records\n";
+			exit(1);
+		}
+	}
+	File::remove(benchFileName);
+}
+
+// -----------------------------------------------------------------------------
+// File I/O: random 8 KB page reads through a shared fstream versus pread
+// -----------------------------------------------------------------------------
+
+/**
+ * Reads pages the way File did before it used pread: every thread shares one stream, so each
+ * read seeks and reads the file header and then the page while holding a mutex.
+ */
+void streamReadWorker(std::fstream* stream, std::mutex* streamMutex, const std::vector<off_t>* positions,
+											const int ops, const unsigned seed, std::atomic<int>* errors)
+{
+	std::mt19937 rng(seed);
+	FileHeader header;
+	char buffer[Page::SIZE];
+
+	for(int i = 0; i < ops; i++)
+	{
+		off_t pos = (*positions)[rng() % positions->size()];
+		std::lock_guard<std::mutex> guard(*streamMutex);
+		stream->seekg(0, std::ios::beg);
+		stream->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+		stream->seekg(pos, std::ios::beg);
+		stream->read(buffer, Page::SIZE);
+		if(!*stream)
+			(*errors)++;
+	}
+}
+
+void preadWorker(PageFile* file, const std::vector<PageId>* pageIds, const int ops, const unsigned seed,
+								 std::atomic<int>* errors)
+{
+	std::mt19937 rng(seed);
+	RecordId rid;
+	rid.slot_number = 1;
+
+	for(int i = 0; i < ops; i++)
+	{
+		rid.page_number = (*pageIds)[rng() % pageIds->size()];
+		Page page = file->readPage(rid.page_number);
+		if(page.getRecord(rid) != std::to_string(rid.page_number))
+			(*errors)++;
+	}
+}
+
+void benchFileIO()
+{
+	const int numPages = 4096;
+	const int opsPerThread = 20000;
+	const int fileThreadCounts[] = {1, 4, 16};
+
+	std::cout << "File I/O: random 8 KB page reads from a " << numPages << "-page file in the OS cache\n";
+	std::vector<PageId> pageIds = createPages(benchFileName, numPages);
+	std::vector<off_t> positions;
+	{
+		PageFile file = PageFile::open(benchFileName);
+		for(PageId pageNo : pageIds)
+			positions.push_back(file.pagePosition(pageNo));
+	}
+	std::atomic<int> errors(0);
+
+	std::cout << std::setw(10) << "threads" << std::setw(16) << "fstream ops/s" << std::setw(16) << "pread ops/s" << "\n";
+	for(int numThreads : fileThreadCounts)
+	{
+		std::fstream stream(benchFileName, std::fstream::in | std::fstream::binary);
+		std::mutex streamMutex;
+		std::vector<std::thread> workers;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for(int t = 0; t < numThreads; t++)
+			workers.push_back(std::thread(streamReadWorker, &stream, &streamMutex, &positions, opsPerThread, t + 1, &errors));
+		for(int t = 0; t < numThreads; t++)
+			workers[t].join();
+		double streamOps = numThreads * (double)opsPerThread / elapsedSeconds(start);
+
+		PageFile file = PageFile::open(benchFileName);
+		workers.clear();
+		start = std::chrono::steady_clock::now();
+		for(int t = 0; t < numThreads; t++)
+			workers.push_back(std::thread(preadWorker, &file, &pageIds, opsPerThread, t + 1, &errors));
+		for(int t = 0; t < numThreads; t++)
+			workers[t].join();
+		double preadOps = numThreads * (double)opsPerThread / elapsedSeconds(start);
+
+		std::cout << std::setw(10) << numThreads << std::fixed << std::setprecision(0) << std::setw(16) << streamOps
+							<< std::setw(16) << preadOps << "\n";
+	}
+	File::remove(benchFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "File I/O FAILED: " << errors << " reads returned the wrong page\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Durability: writing a file through the buffer pool under each durability mode
+// -----------------------------------------------------------------------------
+
+void benchDurability()
+{
+	const int numPages = 1024;
+	const Durability durabilities[] = {NONE, FLUSH, FSYNC_ON_FLUSHFILE, DSYNC};
+	const char* names[] = {"none", "flush", "fsync", "dsync"};
+
+	std::cout << "Durability: " << numPages << " new pages written through the buffer pool and flushFile()\n";
+	std::cout << std::setw(10) << "mode" << std::setw(14) << "pages/s" << "\n";
+	for(int d = 0; d < 4; d++)
+	{
+		if(File::exists(benchFileName))
+			File::remove(benchFileName);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		{
+			BlobFile file = BlobFile::create(benchFileName);
+			file.setDurability(durabilities[d]);
+			BufMgr bufMgr(numPages / 4);
+			for(int i = 0; i < numPages; i++)
+			{
+				PageId pageNo;
+				Page* page;
+				bufMgr.allocPage(&file, pageNo, page);
+				bufMgr.unPinPage(&file, pageNo, true);
+			}
+			bufMgr.flushFile(&file);
+		}
+		double pages = numPages / elapsedSeconds(start);
+		std::cout << std::setw(10) << names[d] << std::fixed << std::setprecision(0) << std::setw(14) << pages << "\n";
+	}
+	File::remove(benchFileName);
+}
+
+// -----------------------------------------------------------------------------
+// Zero-copy reads: CPU spent per page read into a buffer frame
+// -----------------------------------------------------------------------------
+
+/**
+ * Returns the CPU time the process has used, in seconds.
+ */
+double cpuSeconds()
+{
+	return std::clock() / (double)CLOCKS_PER_SEC;
+}
+
+void benchZeroCopy()
+{
+	const int numPages = 4096;
+	const int ops = 400000;
+
+	std::cout << "Zero-copy: random page reads into a frame from a " << numPages << "-page file in the OS cache\n";
+	std::vector<PageId> pageIds = createPages(benchFileName, numPages);
+	int errors = 0;
+	{
+		PageFile file = PageFile::open(benchFileName);
+		Page* frame = new Page();
+		std::mt19937 rng(1);
+
+		// The way BufMgr read a page before: a Page built (and cleared) by readPage, then copied into the frame
+		double start = cpuSeconds();
+		for(int i = 0; i < ops; i++)
+		{
+			PageId pageNo = pageIds[rng() % pageIds.size()];
+			*frame = file.readPage(pageNo);
+			if(frame->page_number() != pageNo)
+				errors++;
+		}
+		double copyNs = (cpuSeconds() - start) * 1e9 / ops;
+
+		start = cpuSeconds();
+		for(int i = 0; i < ops; i++)
+		{
+			PageId pageNo = pageIds[rng() % pageIds.size()];
+			file.readPageInto(pageNo, *frame);
+			if(frame->page_number() != pageNo)
+				errors++;
+		}
+		double intoNs = (cpuSeconds() - start) * 1e9 / ops;
+		delete frame;
+
+		std::cout << std::setw(20) << "path" << std::setw(16) << "CPU ns/page" << "\n";
+		std::cout << std::fixed << std::setprecision(0);
+		std::cout << std::setw(20) << "readPage + copy" << std::setw(16) << copyNs << "\n";
+		std::cout << std::setw(20) << "readPageInto" << std::setw(16) << intoNs << "\n";
+		std::cout << std::setw(20) << "saved per miss" << std::setw(16) << copyNs - intoNs << "\n";
+
+		// Every readPage of a 16-frame pool over the whole file is a miss, now served by readPageInto
+		BufMgr bufMgr(16);
+		start = cpuSeconds();
+		for(int i = 0; i < ops; i++)
+		{
+			PageId pageNo = pageIds[rng() % pageIds.size()];
+			Page* page;
+			bufMgr.readPage(&file, pageNo, page);
+			if(page->page_number() != pageNo)
+				errors++;
+			bufMgr.unPinPage(&file, pageNo, false);
+		}
+		std::cout << std::setw(20) << "BufMgr miss" << std::setw(16) << (cpuSeconds() - start) * 1e9 / ops << "\n";
+	}
+	File::remove(benchFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "Zero-copy FAILED: " << errors << " reads returned the wrong page\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// PAX
+// -----------------------------------------------------------------------------
+
+// Row of the test relations: int, double and a 64-byte string
+struct Tuple {
+	int i;
+	double d;
+	char s[64];
+};
+
+/**
+ * Fills file with numRecords tuples, one page after the other.  Returns the number of pages used.
+ */
+int fillTuples(PageFile& file, const int numRecords)
+{
+	Tuple tuple;
+	std::memset(&tuple, ' ', sizeof(tuple));
+	PageId pageNo;
+	Page page = file.allocatePage(pageNo);
+	int numPages = 1;
+	for(int i = 0; i < numRecords; i++)
+	{
+		tuple.i = i;
+		tuple.d = (double)(i % 1000);
+		std::string data(reinterpret_cast<char*>(&tuple), sizeof(tuple));
+		if(!page.hasSpaceForRecord(data))
+		{
+			file.writePage(pageNo, page);
+			page = file.allocatePage(pageNo);
+			numPages++;
+		}
+		page.insertRecord(data);
+	}
+	file.writePage(pageNo, page);
+	return numPages;
+}
+
+/**
+ * Returns the largest d of the relation in name through a FileScan, reading whole rows or, in column mode, only
+ * the minipage of d.
+ */
+double maxOfD(const std::string& name, BufMgr* bufMgr, const bool columnMode)
+{
+	double max = -1;
+	FileScan scan(name, bufMgr, 0 /* readAhead */);
+	if(columnMode)
+		scan.projectColumn(1);
+	try
+	{
+		RecordId rid;
+		while(true)
+		{
+			scan.scanNext(rid);
+			double d;
+			if(columnMode)
+				std::memcpy(&d, scan.getRecordView().data(), sizeof(d));
+			else
+				std::memcpy(&d, scan.getRecordView().data() + offsetof(Tuple, d), sizeof(d));
+			if(d > max)
+				max = d;
+		}
+	}
+	catch(EndOfFileException&)
+	{
+	}
+	return max;
+}
+
+void benchPax()
+{
+	const int numRecords = 500000;
+	const int passes = 5;
+	const std::string paxFileName = "bench.pax";
+
+	std::cout << "PAX: max(d) over " << numRecords << " tuples of (int, double, char[64]), pages in the buffer pool\n";
+	if(File::exists(benchFileName))
+		File::remove(benchFileName);
+	if(File::exists(paxFileName))
+		File::remove(paxFileName);
+
+	int rowPages;
+	int paxPages;
+	{
+		PageFile rowFile = PageFile::create(benchFileName);
+		rowPages = fillTuples(rowFile, numRecords);
+		const std::vector<std::uint16_t> widths = {offsetof(Tuple, d), sizeof(double), sizeof(Tuple::s)};
+		PageFile paxFile = PageFile::create(paxFileName, widths);
+		paxPages = fillTuples(paxFile, numRecords);
+	}
+
+	int errors = 0;
+	BufMgr bufMgr(rowPages + paxPages + 64);
+	std::cout << std::setw(20) << "layout" << std::setw(10) << "pages" << std::setw(16) << "ns/tuple" << "\n";
+	const char* labels[] = {"row slotted", "PAX row", "PAX column"};
+	const std::string* names[] = {&benchFileName, &paxFileName, &paxFileName};
+	const int pages[] = {rowPages, paxPages, paxPages};
+	const bool columnModes[] = {false, false, true};
+	for(int layout = 0; layout < 3; layout++)
+	{
+		// One pass to bring the pages in, then the timed passes
+		if(maxOfD(*names[layout], &bufMgr, columnModes[layout]) != 999)
+			errors++;
+		double start = cpuSeconds();
+		for(int pass = 0; pass < passes; pass++)
+		{
+			if(maxOfD(*names[layout], &bufMgr, columnModes[layout]) != 999)
+				errors++;
+		}
+		double ns = (cpuSeconds() - start) * 1e9 / ((double)passes * numRecords);
+		std::cout << std::setw(20) << labels[layout] << std::setw(10) << pages[layout] << std::fixed << std::setprecision(1)
+			<< std::setw(16) << ns << "\n";
+	}
+	File::remove(benchFileName);
+	File::remove(paxFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "PAX FAILED: " << errors << " scans returned the wrong maximum\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Parallel scan
+// -----------------------------------------------------------------------------
+
+void benchParallelScan()
+{
+	const int numRecords = 1000000;
+	const unsigned cores = std::thread::hardware_concurrency();
+
+	std::cout << "Parallel scan: count of d < 500 over " << numRecords << " tuples in the buffer pool, "
+		<< cores << " hardware threads\n";
+	if(File::exists(benchFileName))
+		File::remove(benchFileName);
+	int numPages;
+	{
+		PageFile file = PageFile::create(benchFileName);
+		numPages = fillTuples(file, numRecords);
+	}
+	ScanPredicate predicate;
+	predicate.addDouble(offsetof(Tuple, d), LT, 500);
+
+	int errors = 0;
+	BufMgr bufMgr(numPages + 64);
+	{
+		// Bring the pages in, and time the one-thread FileScan for comparison
+		FileScan warm(benchFileName, &bufMgr, 0 /* readAhead */);
+		RecordId rid;
+		try
+		{
+			while(true)
+				warm.scanNext(rid);
+		}
+		catch(EndOfFileException&)
+		{
+		}
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int count = 0;
+	{
+		FileScan scan(benchFileName, &bufMgr, 0 /* readAhead */);
+		scan.setPredicate(predicate);
+		RecordId rid;
+		try
+		{
+			while(true)
+			{
+				scan.scanNext(rid);
+				count++;
+			}
+		}
+		catch(EndOfFileException&)
+		{
+		}
+	}
+	double serial = elapsedSeconds(start);
+	if(count != numRecords / 2)
+		errors++;
+
+	std::cout << std::setw(10) << "threads" << std::setw(16) << "Mtuples/s" << std::setw(12) << "speedup" << "\n";
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << std::setw(10) << "FileScan" << std::setw(16) << numRecords / serial / 1e6 << std::setw(12) << 1.0 << "\n";
+	for(int numThreads : threadCounts)
+	{
+		std::vector<long> counts(numThreads * 8);
+		std::vector<ParallelFileScan::RecordSink> sinks;
+		for(int t = 0; t < numThreads; t++)
+		{
+			// Counters a cache line apart
+			long* counter = &counts[t * 8];
+			sinks.push_back([counter](const RecordId&, std::string_view) { (*counter)++; });
+		}
+		ParallelFileScan scan(benchFileName, &bufMgr);
+		scan.setPredicate(predicate);
+		start = std::chrono::steady_clock::now();
+		scan.run(sinks);
+		double seconds = elapsedSeconds(start);
+		long total = 0;
+		for(long c : counts)
+			total += c;
+		if(total != numRecords / 2)
+			errors++;
+		std::cout << std::setw(10) << numThreads << std::setw(16) << numRecords / seconds / 1e6 << std::setw(12)
+			<< serial / seconds << "\n";
+	}
+	File::remove(benchFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "Parallel scan FAILED: " << errors << " scans returned the wrong count\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Batch scan
+// -----------------------------------------------------------------------------
+
+/**
+ * Returns the largest d of the relation in name through FileScan::scanNextBatch().
+ */
+double maxOfDBatched(const std::string& name, BufMgr* bufMgr, const std::size_t batchSize)
+{
+	double max = -1;
+	FileScan scan(name, bufMgr, 0 /* readAhead */);
+	std::vector<RecordId> rids;
+	std::vector<std::string_view> records;
+	while(scan.scanNextBatch(rids, records, batchSize))
+	{
+		for(std::size_t i = 0; i < records.size(); i++)
+		{
+			double d;
+			std::memcpy(&d, records[i].data() + offsetof(Tuple, d), sizeof(d));
+			if(d > max)
+				max = d;
+		}
+	}
+	return max;
+}
+
+void benchBatchScan()
+{
+	const int numRecords = 500000;
+	const int passes = 5;
+
+	std::cout << "Batch scan: max(d) over " << numRecords << " tuples in the buffer pool\n";
+	if(File::exists(benchFileName))
+		File::remove(benchFileName);
+	int numPages;
+	{
+		PageFile file = PageFile::create(benchFileName);
+		numPages = fillTuples(file, numRecords);
+	}
+
+	int errors = 0;
+	BufMgr bufMgr(numPages + 64);
+	if(maxOfD(benchFileName, &bufMgr, false) != 999)
+		errors++;
+	std::cout << std::setw(20) << "scan" << std::setw(16) << "ns/tuple" << "\n";
+	std::cout << std::fixed << std::setprecision(1);
+	double start = cpuSeconds();
+	for(int pass = 0; pass < passes; pass++)
+	{
+		if(maxOfD(benchFileName, &bufMgr, false) != 999)
+			errors++;
+	}
+	std::cout << std::setw(20) << "scanNext" << std::setw(16)
+		<< (cpuSeconds() - start) * 1e9 / ((double)passes * numRecords) << "\n";
+	const std::size_t batchSizes[] = {16, 128, 1024};
+	for(std::size_t batchSize : batchSizes)
+	{
+		start = cpuSeconds();
+		for(int pass = 0; pass < passes; pass++)
+		{
+			if(maxOfDBatched(benchFileName, &bufMgr, batchSize) != 999)
+				errors++;
+		}
+		std::cout << std::setw(14) << "batch of " << std::setw(6) << batchSize << std::setw(16)
+			<< (cpuSeconds() - start) * 1e9 / ((double)passes * numRecords) << "\n";
+	}
+	File::remove(benchFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "Batch scan FAILED: " << errors << " scans returned the wrong maximum\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Buffer ring: index lookups running alongside a scan of a relation bigger than the pool
+// -----------------------------------------------------------------------------
+
+/**
+ * Looks up a skewed leaf of the index file: root, one inner node, then the leaf.  Returns the disk reads it caused.
+ */
+std::uint64_t lookup(BufMgr* bufMgr, File* file, const std::vector<PageId>& pageIds, const int numInner,
+										 const int numLeaves, std::mt19937& rng)
+{
+	std::uint64_t diskreads = bufMgr->getBufStats().diskreads;
+	int leaf = (rng() % numLeaves) * (rng() % numLeaves) / numLeaves;
+	touch(bufMgr, file, pageIds[0]);
+	touch(bufMgr, file, pageIds[1 + leaf * numInner / numLeaves]);
+	touch(bufMgr, file, pageIds[1 + numInner + leaf]);
+	return bufMgr->getBufStats().diskreads - diskreads;
+}
+
+void benchRing()
+{
+	const std::string indexFileName = "bench.index";
+	const int numInner = 16;
+	const int numLeaves = 128;
+	const int numTablePages = 4096;
+	const int numBufs = 256;
+	const int lookupsPerPage = 4;
+
+	std::cout << "Buffer ring: " << lookupsPerPage << " index lookups per page of a " << numTablePages
+						<< " page scan, " << (1 + numInner + numLeaves) << " index pages, " << numBufs << " frames\n";
+	std::vector<PageId> indexPageIds = createPages(indexFileName, 1 + numInner + numLeaves);
+	std::vector<PageId> tablePageIds = createPages(benchFileName, numTablePages);
+
+	int errors = 0;
+	{
+		PageFile indexFile = PageFile::open(indexFileName);
+		std::cout << std::setw(8) << "policy" << std::setw(10) << "scan" << std::setw(18) << "index hit ratio"
+							<< std::setw(14) << "index reads" << "\n";
+		for(ReplacementPolicyType policyType : policyTypes)
+		{
+			for(int useRing = 0; useRing < 2; useRing++)
+			{
+				BufMgr bufMgr(numBufs, 1, policyType);
+				std::mt19937 rng(1);
+
+				// warm the index up before the scan starts
+				for(std::size_t i = 0; i < indexPageIds.size(); i++)
+					touch(&bufMgr, &indexFile, indexPageIds[i]);
+
+				std::uint64_t indexReads = 0;
+				int scanned = 0;
+				if(useRing)
+				{
+					// FileScan reads a relation this size through a ring on its own; without read-ahead, so that every
+					// disk read during a lookup is one of the lookup's
+					FileScan fscan(benchFileName, &bufMgr, 0);
+					RecordId rid;
+					try
+					{
+						while(1)
+						{
+							fscan.scanNext(rid);
+							scanned++;
+							for(int i = 0; i < lookupsPerPage; i++)
+								indexReads += lookup(&bufMgr, &indexFile, indexPageIds, numInner, numLeaves, rng);
+						}
+					}
+					catch(EndOfFileException&)
+					{
+					}
+				}
+				else
+				{
+					PageFile tableFile = PageFile::open(benchFileName);
+					for(int page = 0; page < numTablePages; page++)
+					{
+						touch(&bufMgr, &tableFile, tablePageIds[page]);
+						scanned++;
+						for(int i = 0; i < lookupsPerPage; i++)
+							indexReads += lookup(&bufMgr, &indexFile, indexPageIds, numInner, numLeaves, rng);
+					}
+					bufMgr.flushFile(&tableFile);
+				}
+				if(scanned != numTablePages)
+					errors++;
+
+				double indexAccesses = 3.0 * lookupsPerPage * numTablePages;
+				std::cout << std::setw(8) << bufMgr.getBufStats().policy << std::setw(10) << (useRing ? "ring" : "pool")
+									<< std::fixed << std::setprecision(4) << std::setw(18) << 1.0 - indexReads / indexAccesses
+									<< std::setw(14) << indexReads << "\n";
+				bufMgr.flushFile(&indexFile);
+			}
+		}
+	}
+	File::remove(indexFileName);
+	File::remove(benchFileName);
+
+	if(errors > 0)
+	{
+		std::cout << "Buffer ring FAILED: " << errors << " scans missed pages\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// Node search: the kernels of NodeSearch over sorted key arrays of every node size
+// -----------------------------------------------------------------------------
+
+/**
+ * Times upper-bound searches of a full leaf of Traits keys, key(i) being the i-th; returns 1 if any result was wrong.
+ */
+template <class Traits, class MakeKey>
+int benchLeafSearch(const char* name, MakeKey key)
+{
+	typedef typename Traits::Key Key;
+	const int size = LeafNode<Traits>::CAPACITY;
+	const int numProbes = 1 << 12;
+	const int passes = 200;
+
+	// Probes fall both on the keys and between them
+	std::vector<Key> keys(size);
+	for(int i = 0; i < size; i++)
+		keys[i] = key(2 * i);
+	std::mt19937 rng(size);
+	std::vector<Key> probes(numProbes);
+	std::vector<int> expected(numProbes);
+	for(int i = 0; i < numProbes; i++)
+	{
+		const int k = rng() % (2 * size + 1);
+		probes[i] = key(k);
+		expected[i] = (k + 2) / 2;
+	}
+
+	long long sum = 0;
+	double start = cpuSeconds();
+	for(int pass = 0; pass < passes; pass++)
+	{
+		for(int i = 0; i < numProbes; i++)
+			sum += Traits::upperBound(keys.data(), size, probes[i]);
+	}
+	double seconds = cpuSeconds() - start;
+
+	long long total = 0;
+	for(int i = 0; i < numProbes; i++)
+		total += std::min(expected[i], size);
+	std::cout << std::setw(8) << name << std::setw(8) << size << " keys" << std::setw(10)
+						<< seconds * 1e9 / ((double)numProbes * passes) << "\n";
+	return sum == total * passes ? 0 : 1;
+}
+
+void benchNodeSearch()
+{
+	const int sizes[] = {16, 64, 256, INTARRAYLEAFSIZE, INTARRAYNONLEAFSIZE};
+	const NodeSearch::Kernel kernels[] = {NodeSearch::LINEAR, NodeSearch::BINARY, NodeSearch::SSE, NodeSearch::AVX2};
+	const char* kernelNames[] = {"linear", "binary", "sse", "avx2"};
+	const int numProbes = 1 << 12;
+	const int passes = 200;
+
+	std::cout << "Node search: ns per search of a full node, " << numProbes * passes << " searches per kernel, best "
+						<< kernelNames[NodeSearch::best()] << "\n";
+	std::cout << std::setw(8) << "keys";
+	for(const char* name : kernelNames)
+		std::cout << std::setw(10) << name;
+	std::cout << "\n" << std::fixed << std::setprecision(1);
+
+	int errors = 0;
+	for(int size : sizes)
+	{
+		// Keys spaced out so that probes fall both on and between them
+		std::vector<int> keys(size);
+		for(int i = 0; i < size; i++)
+			keys[i] = 3 * i;
+		std::mt19937 rng(size);
+		std::vector<int> probes(numProbes);
+		for(int i = 0; i < numProbes; i++)
+			probes[i] = rng() % (3 * size + 2) - 1;
+
+		std::cout << std::setw(8) << size;
+		for(NodeSearch::Kernel kernel : kernels)
+		{
+			if(!NodeSearch::supported(kernel))
+			{
+				std::cout << std::setw(10) << "-";
+				continue;
+			}
+			long long sum = 0;
+			double start = cpuSeconds();
+			for(int pass = 0; pass < passes; pass++)
+			{
+				for(int i = 0; i < numProbes; i++)
+					sum += NodeSearch::upperBound(kernel, keys.data(), size, probes[i]);
+			}
+			double seconds = cpuSeconds() - start;
+
+			long long expected = 0;
+			for(int i = 0; i < numProbes; i++)
+				expected += std::upper_bound(keys.begin(), keys.end(), probes[i]) - keys.begin();
+			if(sum != expected * passes)
+				errors++;
+			std::cout << std::setw(10) << seconds * 1e9 / ((double)numProbes * passes);
+		}
+		std::cout << "\n";
+	}
+
+	// A full leaf of each key type, searched through its key traits as the tree does
+	std::cout << "Leaf search by key type: ns per search of a full leaf\n";
+	errors += benchLeafSearch<IntKeyTraits>("int", [](int i) { return 3 * i; });
+	errors += benchLeafSearch<DoubleKeyTraits>("double", [](int i) { return 1.5 * i; });
+	errors += benchLeafSearch<StringKeyTraits>("string", [](int i) {
+		char chars[STRINGSIZE + 1];
+		snprintf(chars, sizeof(chars), "%09d", 3 * i);
+		return StringKeyTraits::read(chars);
+	});
+
+	if(errors > 0)
+	{
+		std::cout << "Node search FAILED: " << errors << " kernels returned wrong positions\n";
+		exit(1);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// main
+// -----------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+	std::string only = argc > 1 ? argv[1] : "";
+
+	if(only.empty() || only == "bufmgr")
+		benchBufMgrScaling();
+	if(only.empty() || only == "policies")
+		benchPolicies();
+	if(only.empty() || only == "bgwriter")
+		benchBackgroundWriter();
+	if(only.empty() || only == "prefetch")
+		benchPrefetch();
+	if(only.empty() || only == "fileio")
+		benchFileIO();
+	if(only.empty() || only == "durability")
+		benchDurability();
+	if(only.empty() || only == "zerocopy")
+		benchZeroCopy();
+	if(only.empty() || only == "pax")
+		benchPax();
+	if(only.empty() || only == "parallelscan")
+		benchParallelScan();
+	if(only.empty() || only == "batchscan")
+		benchBatchScan();
+	if(only.empty() || only == "ring")
+		benchRing();
+	if(only.empty() || only == "nodesearch")
+		benchNodeSearch();
+
+	return 0;
+}
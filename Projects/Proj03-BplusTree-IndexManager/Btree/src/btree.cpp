@@ -7,10 +7,15 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <queue>
+#include <cstdio>
 
 
 #include "btree.h"
 #include "filescan.h"
+#include "node_search.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -29,6 +34,203 @@
 namespace badgerdb
 {
 
+// -----------------------------------------------------------------------------
+// EntrySorter -- sorts the (key, rid) pairs of a bulk load
+// -----------------------------------------------------------------------------
+
+/**
+ * Total order on index entries: by key, then by record id so that the order of duplicates is deterministic.
+ */
+template <class Traits>
+static bool entryLess(const RIDKeyPair<typename Traits::Key>& a, const RIDKeyPair<typename Traits::Key>& b)
+{
+	if(Traits::less(a.key, b.key))
+		return true;
+	if(Traits::less(b.key, a.key))
+		return false;
+	if(a.rid.page_number != b.rid.page_number)
+		return a.rid.page_number < b.rid.page_number;
+	return a.rid.slot_number < b.rid.slot_number;
+}
+
+/**
+ * Sorts index entries in frames borrowed from the buffer pool, at most maxFrames of them, so that a bulk load needs
+ * no memory beside the pool. Every frame is sorted once it is full. When all the frames are full they are merged
+ * into a run in a temporary file and filled again, and next() merges the frames still in memory with the runs.
+ */
+template <class Traits>
+class EntrySorter
+{
+ public:
+	typedef RIDKeyPair<typename Traits::Key> Entry;
+
+	EntrySorter(BufMgr* bufMgr, std::uint32_t maxFrames)
+		: bufMgr(bufMgr), maxFrames(std::max(maxFrames, 1u)), numEntries(0), usedFrames(0), lastFill(PER_FRAME)
+	{
+	}
+
+	~EntrySorter()
+	{
+		for(std::size_t i = 0; i < runs.size(); i++)
+			std::fclose(runs[i]);
+		for(std::size_t i = 0; i < frames.size(); i++)
+			bufMgr->returnFrame(frames[i].frameNo);
+	}
+
+	void add(const Entry& entry)
+	{
+		if(lastFill == PER_FRAME) {
+			if(usedFrames > 0)
+				sortFrame(usedFrames - 1);
+			nextFrame();
+		}
+		frames[usedFrames - 1].entries[lastFill++] = entry;
+		numEntries++;
+	}
+
+	// Call once, after the last add()
+	void sort()
+	{
+		if(usedFrames > 0)
+			sortFrame(usedFrames - 1);
+		startMerge(true);
+	}
+
+	bool next(Entry& entry)
+	{
+		if(heap.empty())
+			return false;
+		std::size_t i = heap.top().second;
+		entry = heap.top().first;
+		heap.pop();
+		if(++sources[i].pos < sources[i].end || refill(sources[i]))
+			heap.push(std::make_pair(*sources[i].pos, i));
+		return true;
+	}
+
+	std::size_t size() const
+	{
+		return numEntries;
+	}
+
+ private:
+	static const std::size_t PER_FRAME = sizeof(Page) / sizeof(Entry);
+
+	struct Frame
+	{
+		FrameId frameNo;
+		Entry* entries;
+	};
+
+	// Sorted entries still to merge, from a frame or, a page worth at a time, from a run
+	struct Source
+	{
+		const Entry* pos;
+		const Entry* end;
+		std::FILE* run;
+		std::vector<Entry> buffer;
+	};
+
+	struct HeapGreater
+	{
+		bool operator()(const std::pair<Entry, std::size_t>& a,
+										const std::pair<Entry, std::size_t>& b) const
+		{
+			return entryLess<Traits>(b.first, a.first);
+		}
+	};
+
+	std::size_t fill(std::size_t frame) const
+	{
+		return (frame + 1 == usedFrames) ? lastFill : PER_FRAME;
+	}
+
+	void sortFrame(std::size_t frame)
+	{
+		std::sort(frames[frame].entries, frames[frame].entries + fill(frame), entryLess<Traits>);
+	}
+
+	// Start filling the next frame, borrowing another one while allowed, else spilling the full ones
+	void nextFrame()
+	{
+		if(usedFrames == frames.size() && frames.size() < maxFrames) {
+			try {
+				Frame frame;
+				frame.entries = reinterpret_cast<Entry*>(bufMgr->borrowFrame(frame.frameNo));
+				frames.push_back(frame);
+			} catch(BufferExceededException& e) {
+				// the rest of the pool is pinned; make do with the frames we have
+				if(frames.empty())
+					throw;
+				maxFrames = frames.size();
+			}
+		}
+		if(usedFrames == frames.size())
+			spill();
+		usedFrames++;
+		lastFill = 0;
+	}
+
+	void spill()
+	{
+		std::FILE* run = std::tmpfile();
+		if(run == NULL)
+			throw BadgerDbException("bulk load could not create a sorted run");
+		runs.push_back(run);
+
+		startMerge(false);
+		Entry entry;
+		while(next(entry)) {
+			if(std::fwrite(&entry, sizeof(Entry), 1, run) != 1)
+				throw BadgerDbException("bulk load could not write a sorted run");
+		}
+		usedFrames = 0;
+	}
+
+	// Merge the frames in use, and the runs as well if withRuns
+	void startMerge(bool withRuns)
+	{
+		sources.clear();
+		for(std::size_t i = 0; i < usedFrames; i++) {
+			Source source = {frames[i].entries, frames[i].entries + fill(i), NULL, std::vector<Entry>()};
+			sources.push_back(source);
+		}
+		for(std::size_t i = 0; withRuns && i < runs.size(); i++) {
+			std::rewind(runs[i]);
+			Source source = {NULL, NULL, runs[i], std::vector<Entry>()};
+			sources.push_back(source);
+			refill(sources.back());
+		}
+		for(std::size_t i = 0; i < sources.size(); i++) {
+			if(sources[i].pos < sources[i].end)
+				heap.push(std::make_pair(*sources[i].pos, i));
+		}
+	}
+
+	// Read the next page worth of entries of a run; false once the run, or a frame, is exhausted
+	bool refill(Source& source)
+	{
+		if(source.run == NULL)
+			return false;
+		source.buffer.resize(PER_FRAME);
+		std::size_t n = std::fread(source.buffer.data(), sizeof(Entry), source.buffer.size(), source.run);
+		source.pos = source.buffer.data();
+		source.end = source.pos + n;
+		return n > 0;
+	}
+
+	BufMgr* bufMgr;
+	std::size_t maxFrames;
+	std::size_t numEntries;
+	std::vector<Frame> frames;
+	std::size_t usedFrames;
+	std::size_t lastFill;
+	std::vector<std::FILE*> runs;
+	std::vector<Source> sources;
+	std::priority_queue<std::pair<Entry, std::size_t>,
+											std::vector<std::pair<Entry, std::size_t>>, HeapGreater> heap;
+};
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -39,18 +241,31 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 		const int attrByteOffset,
 		const Datatype attrType,
 		int orderNonLeaf /*=INTARRAYLEAFSIZE*/,
-		int orderLeaf /*=INTARRAYLEAFSIZE*/)
+		int orderLeaf /*=INTARRAYLEAFSIZE*/,
+		bool useLog /*=false*/,
+		bool bulkLoad /*=false*/,
+		float fillFactor /*=1.0*/)
+	: scanCursor(this)
 {
 	bufMgr = bufMgrIn;
 	this->attrByteOffset = attrByteOffset;
 	attributeType = attrType;
 
-	nodeOccupancy = orderNonLeaf;
-	leafOccupancy = orderLeaf;
+	// The key traits are picked once here and in every public call; below that the tree code is typed
+	switch(attrType) {
+		case INTEGER: setOccupancy<IntKeyTraits>(orderNonLeaf, orderLeaf); break;
+		case DOUBLE: setOccupancy<DoubleKeyTraits>(orderNonLeaf, orderLeaf); break;
+		case STRING: setOccupancy<StringKeyTraits>(orderNonLeaf, orderLeaf); break;
+		default: throw BadIndexInfoException("unknown attrType");
+	}
 
 	numLeafNode = 0;
 	numNonLeafNode = 0;
-	scanExecuting = false;
+	height = 0;
+	numKeys = 0;
+	numNonLeafKeys = 0;
+	readAheadDepth = BufMgr::DEFAULT_READ_AHEAD;
+	indexLog = NULL;
 
 	// Construct index file name
 	std::ostringstream idxStr;
@@ -60,76 +275,127 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 	if(File::exists(outIndexName)) {
 		// The index file exists, open it
 		file = new BlobFile(outIndexName, false);
+		// the meta page is the first page the index allocated
+		headerPageNum = static_cast<BlobFile*>(file)->first_page_number();
 
-		Page* metaPage;
-		bufMgr->readPage(file, 1, metaPage); //TODO: not sure if meta data page id is always 1?
-		IndexMetaInfo* metaData = reinterpret_cast<IndexMetaInfo*>(metaPage);
+		// Redo whatever inserts were logged but had not reached the index file yet
+		if(useLog) {
+			indexLog = new IndexLog(outIndexName + ".log", bufMgr, file);
+			indexLog->recover();
+		}
+
+		try {
+			PageGuard metaPage = bufMgr->readPage(file, headerPageNum);
+			IndexMetaInfo* metaData = metaPage.as<IndexMetaInfo>();
 		
-		// Check if values in metapage(relationName, attribute byte offset and attribute type) 
-		// match with values received through constructor parameters.
-		if(metaData->relationName != relationName)
-			throw BadIndexInfoException("relationName does not match");
-		if(metaData->attrByteOffset != attrByteOffset)
-			throw BadIndexInfoException("attrByteOffset does not match");
-		if(metaData->attrType != attrType)
-			throw BadIndexInfoException("attrType does not match");
+			// Check if values in metapage(relationName, attribute byte offset and attribute type) 
+			// match with values received through constructor parameters.
+			if(metaData->relationName != relationName)
+				throw BadIndexInfoException("relationName does not match");
+			if(metaData->attrByteOffset != attrByteOffset)
+				throw BadIndexInfoException("attrByteOffset does not match");
+			if(metaData->attrType != attrType)
+				throw BadIndexInfoException("attrType does not match");
+			if(metaData->layoutVersion != INDEX_LAYOUT_VERSION)
+				throw BadIndexInfoException("node layout version does not match; the index must be rebuilt");
+			if(metaData->headerPageNo != headerPageNum || metaData->height <= 0)
+				throw BadIndexInfoException("meta page does not describe the tree; the index must be rebuilt");
 		
-		rootPageNum = metaData->rootPageNo;
-
-		bufMgr->unPinPage(file, 1, false);
+			// The shape of the tree is read back as is, so that the index is ready for lookups without a walk
+			rootPageNum = metaData->rootPageNo;
+			height = metaData->height;
+			numLeafNode = metaData->numLeafNodes;
+			numNonLeafNode = metaData->numNonLeafNodes;
+			numKeys = metaData->numKeys;
+			numNonLeafKeys = metaData->numNonLeafKeys;
+			// Nodes were filled up to the orders the index was built with, whatever this open asked for
+			switch(attrType) {
+				case INTEGER: restoreOccupancy<IntKeyTraits>(metaData->nodeOccupancy, metaData->leafOccupancy); break;
+				case DOUBLE: restoreOccupancy<DoubleKeyTraits>(metaData->nodeOccupancy, metaData->leafOccupancy); break;
+				case STRING: restoreOccupancy<StringKeyTraits>(metaData->nodeOccupancy, metaData->leafOccupancy); break;
+			}
+		} catch(BadIndexInfoException& e) {
+			// No destructor runs for an object whose constructor throws, so the file is closed here
+			delete indexLog;
+			bufMgr->flushFile(file);
+			delete file;
+			throw;
+		}
 	} else {
 		// The index file does not exist, create a new one
 		file = new BlobFile(outIndexName, true);
 
 		// Create a meta data page on file
 		PageId metaPageId;
-		Page* metaPage;
-		bufMgr->allocPage(file, metaPageId, metaPage);
+		PageGuard metaPage = bufMgr->allocPage(file, metaPageId);
 		headerPageNum = metaPageId;
+		rootPageNum = Page::INVALID_NUMBER;
+
+		if(!bulkLoad) {
+			// Create a root page on file
+			PageId rootPageId;
+			PageGuard rootPage = bufMgr->allocPage(file, rootPageId);
+			rootPageNum = rootPageId;
+			// Initialize root node as an empty leaf node
+			switch(attributeType) {
+				case INTEGER: initLeafNode(rootPage.as<LeafNodeInt>()); break;
+				case DOUBLE: initLeafNode(rootPage.as<LeafNodeDouble>()); break;
+				case STRING: initLeafNode(rootPage.as<LeafNodeString>()); break;
+			}
+			rootPage.markDirty();
+			height = 1;
+			numLeafNode = 1;
+		}
 
-		// Create a root page on file
-		PageId rootPageId;
-		Page* rootPage;
-		bufMgr->allocPage(file, rootPageId, rootPage);
-		rootPageNum = rootPageId;
-		// Initialize root node as an empty leaf node
-		LeafNodeInt* rootNode = reinterpret_cast<LeafNodeInt*>(rootPage);
-		initLeafNode(rootNode);
-		bufMgr->unPinPage(file, rootPageId, true);
-
-		// Insert meta data to file
-		IndexMetaInfo metaData;
+		// Insert meta data to file. The meta page is cast to IndexMetaInfo, the same way it is read back on open
+		// and updated when the root moves.
+		IndexMetaInfo* metaData = metaPage.as<IndexMetaInfo>();
 		unsigned int i = 0;
-		for(; i < relationName.length(); i++) {
-			metaData.relationName[i] = relationName[i];
+		for(; i < relationName.length() && i < 19; i++) {
+			metaData->relationName[i] = relationName[i];
 		}
-		i = (i > 19) ? 19 : i;
-		metaData.relationName[i] = '\0';
-		metaData.attrByteOffset = attrByteOffset;
-		metaData.attrType = attrType;
-		metaData.rootPageNo = rootPageNum;
-    	std::string metaDataStr(reinterpret_cast<char*>(&metaData), sizeof(metaData));
-		metaPage->insertRecord(metaDataStr);
-		bufMgr->unPinPage(file, metaPageId, true);
+		metaData->relationName[i] = '\0';
+		metaData->attrByteOffset = attrByteOffset;
+		metaData->attrType = attrType;
+		metaData->layoutVersion = INDEX_LAYOUT_VERSION;
+		metaPage.markDirty();
+		metaPage.release();
+
+		if(bulkLoad) {
+			switch(attributeType) {
+				case INTEGER: rootPageNum = bulkLoadRelation<IntKeyTraits>(relationName, fillFactor); break;
+				case DOUBLE: rootPageNum = bulkLoadRelation<DoubleKeyTraits>(relationName, fillFactor); break;
+				case STRING: rootPageNum = bulkLoadRelation<StringKeyTraits>(relationName, fillFactor); break;
+			}
+		}
+		saveTreeShape();
 
 		// Store header(meta page) and root page to file
 		bufMgr->flushFile(file);
 
-		// Insert entries for every tuple in the base relation using FileScan class
-		FileScan fileScan(relationName, bufMgr);
-		std::string recordStr;
-		RecordId recordId;
-		int key;
-		while(true) {
-			try{
-				fileScan.scanNext(recordId);
-				recordStr = fileScan.getRecord();
-				const char *record = recordStr.c_str();
-				key = *((int *)(record + attrByteOffset));
-				insertEntry((void*)&key, recordId);
-			} catch(EndOfFileException e) {
-				break;
+		if(useLog) {
+			// A log left behind by an earlier index of the same name must not be replayed into this one
+			IndexLog::remove(outIndexName + ".log");
+			indexLog = new IndexLog(outIndexName + ".log", bufMgr, file);
+		}
+
+		if(!bulkLoad) {
+			// Insert entries for every tuple in the base relation using FileScan class
+			FileScan fileScan(relationName, bufMgr);
+			RecordId recordId;
+			while(true) {
+				try{
+					fileScan.scanNext(recordId);
+					// the key is read in place on the pinned page; it need not be aligned
+					std::string_view record = fileScan.getRecordView();
+					insertEntry(record.data() + attrByteOffset, recordId);
+				} catch(EndOfFileException e) {
+					break;
+				}
 			}
+
+			if(indexLog != NULL)
+				indexLog->checkpoint();
 		}
 	}
 
@@ -143,18 +409,37 @@ BTreeIndex::BTreeIndex(const std::string & relationName,
 BTreeIndex::~BTreeIndex()
 {
 	//in case the program ends without calling endScan
-	if (scanExecuting) 
-	  endScan();
-	bufMgr->flushFile(file);
+	if (scanCursor.isScanning()) 
+	  scanCursor.endScan();
+	bool checkpointed = true;
+	if (indexLog != NULL) {
+		try {
+			indexLog->checkpoint();
+		} catch(...) {
+			// the log stays behind, to be replayed the next time the index is opened
+			checkpointed = false;
+		}
+	}
+	try {
+		// with the log still hooked in, a page is only written once the log records it depends on are durable
+		bufMgr->flushFile(file);
+	} catch(...) {
+	}
+	if (indexLog != NULL) {
+		delete indexLog;
+		if (checkpointed)
+			IndexLog::remove(file->filename() + ".log");
+	}
 	delete file;
 }
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::initLeafNode
 // -----------------------------------------------------------------------------
-void BTreeIndex::initLeafNode(LeafNodeInt* node) {
+template <class Traits>
+void BTreeIndex::initLeafNode(LeafNode<Traits>* node) {
 	for(int i = 0; i < leafOccupancy; i++) {
-		node->keyArray[i] = 0;
+		node->keyArray[i] = typename Traits::Key();
 	}
 	node->length = 0;
 	node->rightSibPageNo = 0;
@@ -163,112 +448,277 @@ void BTreeIndex::initLeafNode(LeafNodeInt* node) {
 // -----------------------------------------------------------------------------
 // BTreeIndex::initNonLeafNode
 // -----------------------------------------------------------------------------
-void BTreeIndex::initNonLeafNode(NonLeafNodeInt* node) {
+template <class Traits>
+void BTreeIndex::initNonLeafNode(NonLeafNode<Traits>* node) {
 	for(int i = 0; i < nodeOccupancy; i++) {
-		node->keyArray[i] = 0;
+		node->keyArray[i] = typename Traits::Key();
 	}
 	node->length = 0;
 	node->level = 0;
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::searchEntry
+// BTreeIndex::setOccupancy
 // -----------------------------------------------------------------------------
-PageId BTreeIndex::searchEntry(int* key, LeafNodeInt*& outNode, std::vector<PageId> &path)
-{
-	Page* page;
-	bufMgr->readPage(file, rootPageNum, page);
+template <class Traits>
+void BTreeIndex::setOccupancy(int orderNonLeaf, int orderLeaf) {
+	const int nonLeafCapacity = NonLeafNode<Traits>::CAPACITY;
+	const int leafCapacity = LeafNode<Traits>::CAPACITY;
+	nodeOccupancy = (orderNonLeaf > 0 && orderNonLeaf < nonLeafCapacity) ? orderNonLeaf : nonLeafCapacity;
+	leafOccupancy = (orderLeaf > 0 && orderLeaf < leafCapacity) ? orderLeaf : leafCapacity;
+}
 
-	if(numNonLeafNode == 0) {
-		// Root node is a leaf node
-		outNode = reinterpret_cast<LeafNodeInt*>(page);
-		return rootPageNum;
-	} else {
-		path.push_back(rootPageNum);
+// -----------------------------------------------------------------------------
+// BTreeIndex::restoreOccupancy
+// -----------------------------------------------------------------------------
+template <class Traits>
+void BTreeIndex::restoreOccupancy(int orderNonLeaf, int orderLeaf) {
+	if(orderNonLeaf <= 0 || orderNonLeaf > NonLeafNode<Traits>::CAPACITY)
+		throw BadIndexInfoException("nodeOccupancy in the meta page does not fit a non-leaf node");
+	if(orderLeaf <= 0 || orderLeaf > LeafNode<Traits>::CAPACITY)
+		throw BadIndexInfoException("leafOccupancy in the meta page does not fit a leaf node");
+	nodeOccupancy = orderNonLeaf;
+	leafOccupancy = orderLeaf;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::logPageUpdate
+// -----------------------------------------------------------------------------
+void BTreeIndex::logPageUpdate(PageId pageId, Page* page) {
+	if(indexLog != NULL)
+		indexLog->beforeUpdate(pageId, page);
+}
 
-		// Root node is a non-leaf node
-		NonLeafNodeInt* node = reinterpret_cast<NonLeafNodeInt*>(page);
-		bool found;
-		PageId nextPageId = rootPageNum;
+// -----------------------------------------------------------------------------
+// BTreeIndex::saveTreeShape
+// -----------------------------------------------------------------------------
+void BTreeIndex::saveTreeShape() {
+	PageGuard headerPage = bufMgr->readPage(file, headerPageNum);
+	logPageUpdate(headerPageNum, headerPage.get());
+	headerPage.markDirty();
+	IndexMetaInfo* metaData = headerPage.as<IndexMetaInfo>();
+	metaData->rootPageNo = rootPageNum;
+	metaData->headerPageNo = headerPageNum;
+	metaData->height = height;
+	metaData->numLeafNodes = numLeafNode;
+	metaData->numNonLeafNodes = numNonLeafNode;
+	metaData->leafOccupancy = leafOccupancy;
+	metaData->nodeOccupancy = nodeOccupancy;
+	metaData->numKeys = numKeys;
+	metaData->numNonLeafKeys = numNonLeafKeys;
+}
 
+// -----------------------------------------------------------------------------
+// BTreeIndex::getLeafFill
+// -----------------------------------------------------------------------------
+double BTreeIndex::getLeafFill() const {
+	if(numLeafNode == 0)
+		return 0;
+	return (double)numKeys / ((double)numLeafNode * leafOccupancy);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::getNonLeafFill
+// -----------------------------------------------------------------------------
+double BTreeIndex::getNonLeafFill() const {
+	if(numNonLeafNode == 0)
+		return 0;
+	return (double)numNonLeafKeys / ((double)numNonLeafNode * nodeOccupancy);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::bulkLoadRelation
+// -----------------------------------------------------------------------------
+template <class Traits>
+PageId BTreeIndex::bulkLoadRelation(const std::string & relationName, float fillFactor)
+{
+	typedef typename Traits::Key Key;
+	typedef typename EntrySorter<Traits>::Entry Entry;
+
+	if(fillFactor <= 0 || fillFactor > 1)
+		fillFactor = 1;
+	// Entries per leaf and children per non-leaf node
+	const int leafFill = std::max(1, (int)(leafOccupancy * fillFactor));
+	const int nodeFill = std::max(2, (int)(nodeOccupancy * fillFactor) + 1);
+
+	// Extract the (key, rid) pairs, sorting them in frames borrowed from the buffer pool. Half of the pool is left
+	// to the scan of the relation and to other users of the buffer manager.
+	EntrySorter<Traits> entries(bufMgr, bufMgr->getNumBufs() / 2);
+	{
+		FileScan fileScan(relationName, bufMgr);
+		Entry entry;
 		while(true) {
-			// Find next pageId
-			found = false;
-			// 
-			for(int i = 0; i < node->length; i++) {
-				if(*key < node->keyArray[i]) { //TODO: may need to use custom operator
-					// Unpin the current page
-					bufMgr->unPinPage(file, nextPageId, false);
-					// Assign the next page id
-					nextPageId = node->pageNoArray[i];
-					found = true;
-					break;
-				}
-			}
-			//
-			if(!found) {
-				// Unpin the current page
-				bufMgr->unPinPage(file, nextPageId, false);
-				// Assign the next page id
-				nextPageId = node->pageNoArray[node->length];
+			try{
+				fileScan.scanNext(entry.rid);
+				std::string_view record = fileScan.getRecordView();
+				entry.key = Traits::read(record.data() + attrByteOffset);
+				entries.add(entry);
+			} catch(EndOfFileException e) {
+				break;
 			}
-			
-			// Get next node by nextPageId
-			bufMgr->readPage(file, nextPageId, page);
-			if(node->level == 0) {
-				// Next child node is a non-leaf node
-				node = reinterpret_cast<NonLeafNodeInt*>(page);
-				// Push this pageId to path
-				path.push_back(nextPageId);
-			} else {
-				// Now node's level == 1, which means the next child node is the target leaf node
-				outNode = reinterpret_cast<LeafNodeInt*>(page);
-				return nextPageId;
+		}
+	}
+	entries.sort();
+	const std::size_t numEntries = entries.size();
+
+	// Size every level up front so that all nodes can be allocated as one run of pages:
+	// the leaves first, then each non-leaf level, ending with the root.
+	std::vector<PageId> levelSizes;
+	PageId numNodes = (numEntries == 0) ? 1 : (numEntries + leafFill - 1) / leafFill;
+	PageId totalNodes = numNodes;
+	levelSizes.push_back(numNodes);
+	while(numNodes > 1) {
+		// At most half as many parents as children, so that every non-leaf node gets two children or more; only
+		// nodes of order one, which hold two children at most, may have to take a single one.
+		const PageId fullNodes = (numNodes + nodeOccupancy) / (nodeOccupancy + 1);
+		numNodes = std::max(std::min((numNodes + nodeFill - 1) / nodeFill, numNodes / 2), fullNodes);
+		totalNodes += numNodes;
+		levelSizes.push_back(numNodes);
+	}
+	const PageId firstPageId = static_cast<BlobFile*>(file)->allocatePages(totalNodes);
+	PageId pageId = firstPageId;
+
+	// Lowest key below each node of the level written last
+	std::vector<Key> lowKeys;
+	lowKeys.reserve(levelSizes[0]);
+
+	// Pack the leaves left to right. Entries are spread evenly so the last leaf is not left nearly empty.
+	const PageId numLeaves = levelSizes[0];
+	for(PageId i = 0; i < numLeaves; i++) {
+		Page page;
+		LeafNode<Traits>* node = reinterpret_cast<LeafNode<Traits>*>(&page);
+		initLeafNode(node);
+
+		const int count = numEntries / numLeaves + (i < numEntries % numLeaves ? 1 : 0);
+		Entry entry;
+		for(int j = 0; j < count; j++) {
+			entries.next(entry);
+			node->keyArray[j] = entry.key;
+			node->ridArray[j] = entry.rid;
+		}
+		node->length = count;
+		node->rightSibPageNo = (i + 1 < numLeaves) ? pageId + 1 : 0;
+
+		lowKeys.push_back(node->keyArray[0]);
+		file->writePage(pageId++, page);
+	}
+	numLeafNode = numLeaves;
+	numNonLeafNode = 0;
+	numKeys = numEntries;
+	numNonLeafKeys = 0;
+	height = levelSizes.size();
+
+	// Stack the non-leaf levels, each one directly after the level below it
+	PageId firstChildPageId = firstPageId;
+	for(std::size_t level = 1; level < levelSizes.size(); level++) {
+		const PageId numChildren = levelSizes[level - 1];
+		const PageId numParents = levelSizes[level];
+		std::vector<Key> parentLowKeys;
+		parentLowKeys.reserve(numParents);
+
+		PageId child = 0;
+		for(PageId i = 0; i < numParents; i++) {
+			Page page;
+			NonLeafNode<Traits>* node = reinterpret_cast<NonLeafNode<Traits>*>(&page);
+			initNonLeafNode(node);
+			node->level = (level == 1) ? 1 : 0;
+
+			const PageId count = numChildren / numParents + (i < numChildren % numParents ? 1 : 0);
+			node->pageNoArray[0] = firstChildPageId + child;
+			for(PageId k = 1; k < count; k++) {
+				node->keyArray[k - 1] = lowKeys[child + k];
+				node->pageNoArray[k] = firstChildPageId + child + k;
 			}
+			node->length = count - 1;
+			numNonLeafKeys += node->length;
+
+			parentLowKeys.push_back(lowKeys[child]);
+			child += count;
+			file->writePage(pageId++, page);
+		}
+
+		firstChildPageId += numChildren;
+		lowKeys.swap(parentLowKeys);
+		numNonLeafNode += numParents;
+	}
+
+	// The root is the last page written
+	return pageId - 1;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::searchEntry
+// -----------------------------------------------------------------------------
+template <class Traits>
+PageGuard BTreeIndex::searchEntry(const typename Traits::Key& key, std::vector<PageId> &path)
+{
+	PageGuard page = bufMgr->readPage(file, rootPageNum);
+
+	if(numNonLeafNode == 0) {
+		// Root node is a leaf node
+		return page;
+	}
+
+	while(true) {
+		// Push this pageId to path
+		path.push_back(page.getPageNo());
+		NonLeafNode<Traits>* node = page.as<NonLeafNode<Traits>>();
+
+		// Find next pageId: the child right of the last key not greater than the key
+		const PageId nextPageId = node->pageNoArray[Traits::upperBound(node->keyArray, node->length, key)];
+		const bool isChildLeaf = (node->level == 1);
+
+		// Unpin the current page and get next node by nextPageId
+		page.release();
+		page = bufMgr->readPage(file, nextPageId);
+		if(isChildLeaf) {
+			// The node was at level 1, which means the child is the target leaf node
+			return page;
 		}
 	}
-	
 }
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::splitNonLeafNode
 // -----------------------------------------------------------------------------
+template <class Traits>
 void BTreeIndex::splitNonLeafNode(PageId pageId, 
-								const int key,
+								const typename Traits::Key key,
 								PageId leftNodePageId,
 								PageId rightNodePageId,
-								int& newKey,
+								typename Traits::Key& newKey,
 								PageId& outLeftNodePageId,
 								PageId& outRightNodePageId)
 {
 	// Split a non-root non-leaf node
 	// Use the current page as left node
 	PageId leftPageId = pageId;
-	Page* leftPage;
-	bufMgr->readPage(file, leftPageId, leftPage);
-	NonLeafNodeInt* leftNode = reinterpret_cast<NonLeafNodeInt*>(leftPage);
+	PageGuard leftPage = bufMgr->readPage(file, leftPageId);
+	NonLeafNode<Traits>* leftNode = leftPage.as<NonLeafNode<Traits>>();
 	if(leftNode->length != nodeOccupancy) {
-		bufMgr->unPinPage(file, leftPageId, false);
 		throw NonLeafNodeNotFullException();
 	}
+	logPageUpdate(leftPageId, leftPage.get());
+	leftPage.markDirty();
 
 	// Create a new page for right node
 	PageId rightPageId;
-	Page* rightPage;
-	bufMgr->allocPage(file, rightPageId, rightPage);
-	NonLeafNodeInt* rightNode = reinterpret_cast<NonLeafNodeInt*>(rightPage);
+	PageGuard rightPage = bufMgr->allocPage(file, rightPageId);
+	logPageUpdate(rightPageId, rightPage.get());
+	rightPage.markDirty();
+	NonLeafNode<Traits>* rightNode = rightPage.as<NonLeafNode<Traits>>();
 	initNonLeafNode(rightNode);
 	rightNode->level = leftNode->level;
 		
 	// Split keys in half
 	// Put all keys, including the one to be inserted, into a new array
-	int oriKeyArray[nodeOccupancy + 1];
+	typename Traits::Key oriKeyArray[nodeOccupancy + 1];
 	PageId oriPageNoArray[nodeOccupancy + 2];
 	int idx = 0;
 	bool isAdded = false;
 	for(int i = 0; i < nodeOccupancy + 1; i++) {
 		if(!isAdded) {
-			if(leftNode->keyArray[idx] < key  && idx < nodeOccupancy) {
+			if(idx < nodeOccupancy && Traits::less(leftNode->keyArray[idx], key)) {
 				oriKeyArray[i] = leftNode->keyArray[idx];
 				oriPageNoArray[i] = leftNode->pageNoArray[idx];
 				idx++;
@@ -308,36 +758,34 @@ void BTreeIndex::splitNonLeafNode(PageId pageId,
 	newKey = oriKeyArray[halfSize];
 	outLeftNodePageId = leftPageId;
 	outRightNodePageId = rightPageId;
-
-	// Unpin leftNode and rightNode
-	bufMgr->unPinPage(file, leftPageId, true);
-	bufMgr->unPinPage(file, rightPageId, true);
 }
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::splitLeafNode
 // -----------------------------------------------------------------------------
+template <class Traits>
 void BTreeIndex::splitLeafNode(PageId pageId, 
-								RIDKeyPair<int> ridkeypair, 
-								int& newKey,
+								RIDKeyPair<typename Traits::Key> ridkeypair, 
+								typename Traits::Key& newKey,
 								PageId& outLeftNodePageId,
 								PageId& outRightNodePageId)
 {
 	// Use the current page as left node
 	PageId leftLeafPageId = pageId;
-	Page* leftLeafPage;
-	bufMgr->readPage(file, leftLeafPageId, leftLeafPage);
-	LeafNodeInt* leftLeafNode = reinterpret_cast<LeafNodeInt*>(leftLeafPage);
+	PageGuard leftLeafPage = bufMgr->readPage(file, leftLeafPageId);
+	LeafNode<Traits>* leftLeafNode = leftLeafPage.as<LeafNode<Traits>>();
 	if(leftLeafNode->length != leafOccupancy) {
-		bufMgr->unPinPage(file, leftLeafPageId, false);
 		throw LeafNodeNotFullException();
 	}
+	logPageUpdate(leftLeafPageId, leftLeafPage.get());
+	leftLeafPage.markDirty();
 
 	// Create a new page for right node
 	PageId rightLeafPageId;
-	Page* rightLeafPage;
-	bufMgr->allocPage(file, rightLeafPageId, rightLeafPage);
-	LeafNodeInt* rightLeafNode = reinterpret_cast<LeafNodeInt*>(rightLeafPage);
+	PageGuard rightLeafPage = bufMgr->allocPage(file, rightLeafPageId);
+	logPageUpdate(rightLeafPageId, rightLeafPage.get());
+	rightLeafPage.markDirty();
+	LeafNode<Traits>* rightLeafNode = rightLeafPage.as<LeafNode<Traits>>();
 	initLeafNode(rightLeafNode);
 
 	// Update the sibling page link
@@ -346,12 +794,12 @@ void BTreeIndex::splitLeafNode(PageId pageId,
 
 	// Split keys in half
 	// Put all keys, including the one to be inserted, into a new array
-	int oriKeyArray[leafOccupancy + 1];
+	typename Traits::Key oriKeyArray[leafOccupancy + 1];
 	RecordId oriRidArray[leafOccupancy + 1];
 	int idx = 0;
 	bool isAdded = false;
 	for(int i = 0; i < leafOccupancy + 1; i++) {
-		if((isAdded || leftLeafNode->keyArray[idx] < ridkeypair.key) && idx < leafOccupancy) {
+		if(idx < leafOccupancy && (isAdded || Traits::less(leftLeafNode->keyArray[idx], ridkeypair.key))) {
 			oriKeyArray[i] = leftLeafNode->keyArray[idx];
 			oriRidArray[i] = leftLeafNode->ridArray[idx];
 			idx++;
@@ -376,31 +824,30 @@ void BTreeIndex::splitLeafNode(PageId pageId,
 	}
 	rightLeafNode->length = leafOccupancy + 1 - halfSize;
 
-	// Update numLeafNode
+	// Update numLeafNode; the new entry went into one of the halves
 	numLeafNode++;
+	numKeys++;
 
 	// Fill the return newKey, outLeftNodePageId and rightLeafPageId
 	newKey = oriKeyArray[halfSize];
 	outLeftNodePageId = leftLeafPageId;
 	outRightNodePageId = rightLeafPageId;
-	
-	// Unpin leftNode and rightNode
-	bufMgr->unPinPage(file, leftLeafPageId, true);
-	bufMgr->unPinPage(file, rightLeafPageId, true);
 }
 
 // -----------------------------------------------------------------------------
 // BTreeIndex::createNewRootNode
 // -----------------------------------------------------------------------------
-void BTreeIndex::createNewRootNode(int newKey, 
+template <class Traits>
+void BTreeIndex::createNewRootNode(typename Traits::Key newKey, 
 								PageId leftPageId, 
 								PageId rightPageId,
 								int level)
 {
 	PageId rootPageId;
-	Page* rootPage;
-	bufMgr->allocPage(file, rootPageId, rootPage);
-	NonLeafNodeInt* rootNode = reinterpret_cast<NonLeafNodeInt*>(rootPage);
+	PageGuard rootPage = bufMgr->allocPage(file, rootPageId);
+	logPageUpdate(rootPageId, rootPage.get());
+	rootPage.markDirty();
+	NonLeafNode<Traits>* rootNode = rootPage.as<NonLeafNode<Traits>>();
 	initNonLeafNode(rootNode);
 	rootNode->level = level; 
 
@@ -410,21 +857,13 @@ void BTreeIndex::createNewRootNode(int newKey,
 	rootNode->pageNoArray[1] = rightPageId;
 	rootNode->length = 1;
 
-	// Update rootPageNum
+	// Update rootPageNum; the header follows at the end of the insert
 	rootPageNum = rootPageId;
 
-	// Update header
-	Page* headerPage;
-	bufMgr->readPage(file, headerPageNum, headerPage);
-	struct IndexMetaInfo* indexMetaInfo = reinterpret_cast<struct IndexMetaInfo*>(headerPage);
-	indexMetaInfo->rootPageNo = rootPageId;
-	bufMgr->unPinPage(file, headerPageNum, true);
-
 	// Update numNonLeafNode
 	numNonLeafNode++;
-
-	// Unpin the new root page
-	bufMgr->unPinPage(file, rootPageId, true);
+	numNonLeafKeys++;
+	height++;
 }
 
 // -----------------------------------------------------------------------------
@@ -433,68 +872,80 @@ void BTreeIndex::createNewRootNode(int newKey,
 
 const void BTreeIndex::insertEntry(const void *key, const RecordId rid) 
 {
+	switch(attributeType) {
+		case INTEGER: insertKey<IntKeyTraits>(IntKeyTraits::read(key), rid); break;
+		case DOUBLE: insertKey<DoubleKeyTraits>(DoubleKeyTraits::read(key), rid); break;
+		case STRING: insertKey<StringKeyTraits>(StringKeyTraits::read(key), rid); break;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertKey
+// -----------------------------------------------------------------------------
+
+template <class Traits>
+void BTreeIndex::insertKey(const typename Traits::Key& key, const RecordId rid)
+{
+	typedef typename Traits::Key Key;
+
 	// Search the corresponding leaf node
-	LeafNodeInt* node;
 	std::vector<PageId> path;
-	PageId leafPageId = searchEntry((int*)key, node, path);
+	PageGuard leafPage = searchEntry<Traits>(key, path);
+	PageId leafPageId = leafPage.getPageNo();
+	LeafNode<Traits>* node = leafPage.as<LeafNode<Traits>>();
 
 	// Insert the rid
 	// Check if this node is full
 	if(node->length < leafOccupancy) {
 		// This node is not full. Just insert to this node.
-		int insertIdx = 0;
-		while(insertIdx < node->length) {
-			if(*(int*)key < node->keyArray[insertIdx])
-				break;
-			insertIdx++;
-		}
+		logPageUpdate(leafPageId, leafPage.get());
+		leafPage.markDirty();
+		int insertIdx = Traits::upperBound(node->keyArray, node->length, key);
 		for(int i = node->length; i > insertIdx; i--) {
 			node->keyArray[i] = node->keyArray[i-1];
 			node->ridArray[i] = node->ridArray[i-1];
 		}
-		node->keyArray[insertIdx] = *(int*)key;
+		node->keyArray[insertIdx] = key;
 		node->ridArray[insertIdx] = rid;
 		
 		// Update length
 		node->length++;
+		numKeys++;
 
 		// Unpin the page
-		bufMgr->unPinPage(file, leafPageId, true);
+		leafPage.release();
 	} else {
 		// Unpin the page now. The leaf page would be read again inside function splitLeafNode.
-		bufMgr->unPinPage(file, leafPageId, false);
+		leafPage.release();
 
 		// This node is full. Need to split.
 		PageId leftPageId;
 		PageId rightPageId;
-		RIDKeyPair<int> ridkeypair;
-		ridkeypair.set(rid, *(int*)key);
-		int newKey;
-		splitLeafNode(leafPageId, ridkeypair, newKey, leftPageId, rightPageId);
+		RIDKeyPair<Key> ridkeypair;
+		ridkeypair.set(rid, key);
+		Key newKey;
+		splitLeafNode<Traits>(leafPageId, ridkeypair, newKey, leftPageId, rightPageId);
 
 		// Insert a new key to the parent node and
 		if(path.size() == 0) {
 			// Case 1: root node is a leaf node
 			// Create a new root node
-			createNewRootNode(newKey, leftPageId, rightPageId, 1);
+			createNewRootNode<Traits>(newKey, leftPageId, rightPageId, 1);
 		} else {
 			// Case 2: root node is not a leaf node
 			// Recursively check if the parent node needs to split
 			int currentNodePos = path.size() - 1;
 			PageId parentPageId = path[currentNodePos];
-			Page* parentPage;
 			while(currentNodePos >= 0) {
-				// Get parentNode by pageId
-				bufMgr->readPage(file, parentPageId, parentPage);
-				NonLeafNodeInt* parentNode = reinterpret_cast<NonLeafNodeInt*>(parentPage);
+				// Get parentNode by pageId; it is unpinned at the end of each round
+				PageGuard parentPage = bufMgr->readPage(file, parentPageId);
+				NonLeafNode<Traits>* parentNode = parentPage.as<NonLeafNode<Traits>>();
 				
 				if(parentNode->length < nodeOccupancy) {
 					// This node is not full. Just insert the new key.
-					int insertIdx = 0;
-					for(; insertIdx < parentNode->length; insertIdx++) {
-						if(newKey < parentNode->keyArray[insertIdx])
-							break;
-					}
+					logPageUpdate(parentPageId, parentPage.get());
+					parentPage.markDirty();
+					int insertIdx = Traits::upperBound(parentNode->keyArray, parentNode->length, newKey);
 					parentNode->pageNoArray[parentNode->length + 1] = parentNode->pageNoArray[parentNode->length];
 					for(int i = parentNode->length; i > insertIdx; i--) {
 						parentNode->keyArray[i] = parentNode->keyArray[i-1];
@@ -506,14 +957,12 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 					
 					// Update length
 					parentNode->length++;
-
-					// Unpin this page
-					bufMgr->unPinPage(file, parentPageId, true);
+					numNonLeafKeys++;
 					
 					break;
 				} else {
 					// This node is full.
-					splitNonLeafNode(parentPageId, /* the node to be splitted */
+					splitNonLeafNode<Traits>(parentPageId, /* the node to be splitted */
 									newKey, /* split key */
 									leftPageId, /* left child pageId */
 									rightPageId, /* right child pageId */
@@ -524,17 +973,11 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 
 				if(currentNodePos == 0) {
 					// parentNode was the root node and is splitted. Need add a new root node.
-					createNewRootNode(newKey, leftPageId, rightPageId, 0);
-
-					// Unpin this page
-					bufMgr->unPinPage(file, parentPageId, true);
+					createNewRootNode<Traits>(newKey, leftPageId, rightPageId, 0);
 					
 					break;
 				}
 
-				// Unpin this page
-				bufMgr->unPinPage(file, parentPageId, true);
-
 				// Set next parent pageId
 				parentPageId = path[--currentNodePos];
 			}
@@ -542,8 +985,23 @@ const void BTreeIndex::insertEntry(const void *key, const RecordId rid)
 		
 	}
 
-	// Store the tree to file
-	bufMgr->flushFile(file);
+	saveTreeShape();
+
+	// Store the tree to file, or leave that to the log's checkpoints
+	if(indexLog != NULL)
+		indexLog->commit();
+	else
+		bufMgr->flushFile(file);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::syncLog
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::syncLog()
+{
+	if(indexLog != NULL)
+		indexLog->sync();
 }
 
 // -----------------------------------------------------------------------------
@@ -558,20 +1016,32 @@ const void BTreeIndex::printTreeFromRoot()
 // BTreeIndex::printTree
 // -----------------------------------------------------------------------------
 const void BTreeIndex::printTree(const PageId pageId, bool isLeafNode)
+{
+	switch(attributeType) {
+		case INTEGER: printNode<IntKeyTraits>(pageId, isLeafNode); break;
+		case DOUBLE: printNode<DoubleKeyTraits>(pageId, isLeafNode); break;
+		case STRING: printNode<StringKeyTraits>(pageId, isLeafNode); break;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::printNode
+// -----------------------------------------------------------------------------
+template <class Traits>
+void BTreeIndex::printNode(const PageId pageId, bool isLeafNode)
 {
 	std::cout << "Page id: " << pageId << "  ";
 
-	Page* page;
-	bufMgr->readPage(file, pageId, page);
+	PageGuard page = bufMgr->readPage(file, pageId);
 	if(isLeafNode) {
-		LeafNodeInt* node = reinterpret_cast<LeafNodeInt*>(page);
+		LeafNode<Traits>* node = page.as<LeafNode<Traits>>();
 		for(int i = 0; i < node->length; i++) {
 			//std::cout << node->keyArray[i] << "/ \\";
 			std::cout << node->keyArray[i] << ":" << node->ridArray[i].page_number <<  "/ \\";
 		}
 		std::cout << std::endl;
 	} else {
-		NonLeafNodeInt* node = reinterpret_cast<NonLeafNodeInt*>(page);
+		NonLeafNode<Traits>* node = page.as<NonLeafNode<Traits>>();
 		std::cout << "/" << node->pageNoArray[0] << "\\";
 		for(int i = 0; i < node->length; i++) {
 			std::cout << node->keyArray[i] << "/" << node->pageNoArray[i+1] << "\\";
@@ -579,51 +1049,61 @@ const void BTreeIndex::printTree(const PageId pageId, bool isLeafNode)
 		std::cout << std::endl;
 
 		bool isChildrenLeaf = (node->level == 1);
-		printTree(node->pageNoArray[0], isChildrenLeaf);
+		printNode<Traits>(node->pageNoArray[0], isChildrenLeaf);
 		for(int i = 0; i < node->length; i++) {
-			printTree(node->pageNoArray[i+1], isChildrenLeaf);
+			printNode<Traits>(node->pageNoArray[i+1], isChildrenLeaf);
 		}
 	}
-	
-	bufMgr->unPinPage(file, pageId, false);
 } 
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::printLeafNodesBySibLink
+// BTreeIndex::firstLeafPageNo
 // -----------------------------------------------------------------------------
-const void BTreeIndex::printLeafNodesBySibLink()
+template <class Traits>
+PageId BTreeIndex::firstLeafPageNo()
 {
-	// Find leftest leaf node
-	Page* page;
 	PageId pageId = rootPageNum;
 	
 	if(numNonLeafNode > 0) {
 		while(true) {
-			bufMgr->readPage(file, pageId, page);
-			NonLeafNodeInt* tmpNode = reinterpret_cast<NonLeafNodeInt*>(page);
-			bufMgr->unPinPage(file, pageId, false);
+			PageGuard page = bufMgr->readPage(file, pageId);
+			NonLeafNode<Traits>* tmpNode = page.as<NonLeafNode<Traits>>();
 			pageId = tmpNode->pageNoArray[0];
 			if(tmpNode->level == 1)
 				break;
 		}
 	}
-	bufMgr->readPage(file, pageId, page);
-	LeafNodeInt* node = reinterpret_cast<LeafNodeInt*>(page);
+	return pageId;
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::printLeafNodesBySibLink
+// -----------------------------------------------------------------------------
+const void BTreeIndex::printLeafNodesBySibLink()
+{
+	// Find leftest leaf node
+	PageId pageId = rootPageNum;
+	switch(attributeType) {
+		case INTEGER: pageId = firstLeafPageNo<IntKeyTraits>(); break;
+		case DOUBLE: pageId = firstLeafPageNo<DoubleKeyTraits>(); break;
+		case STRING: pageId = firstLeafPageNo<StringKeyTraits>(); break;
+	}
 	
-	// Print pageId(node) by following the sib link
+	// Print pageId(node) by following the sib link; where the link sits depends on the key type
 	// TODO: use counting
 	std::cout << "Leaf nodes: ";
 	while(true) {
 		std::cout << pageId;
-		bufMgr->unPinPage(file, pageId, false);
-		pageId = node->rightSibPageNo;
+		PageGuard page = bufMgr->readPage(file, pageId);
+		switch(attributeType) {
+			case INTEGER: pageId = page.as<LeafNodeInt>()->rightSibPageNo; break;
+			case DOUBLE: pageId = page.as<LeafNodeDouble>()->rightSibPageNo; break;
+			case STRING: pageId = page.as<LeafNodeString>()->rightSibPageNo; break;
+		}
 		if(pageId == 0)
 			break;
 		else
 			std::cout << " -> ";
-		
-		bufMgr->readPage(file, pageId, page);
-		node = reinterpret_cast<LeafNodeInt*>(page);
 	}
 	std::cout << std::endl;
 } 
@@ -631,28 +1111,26 @@ const void BTreeIndex::printLeafNodesBySibLink()
 // -----------------------------------------------------------------------------
 // BTreeIndex::preOrderTraversal
 // -----------------------------------------------------------------------------
-void BTreeIndex::preOrderTraversal(std::vector<std::vector<int>> &outPath, 
+template <class Traits>
+void BTreeIndex::preOrderTraversal(std::vector<std::vector<typename Traits::Key>> &outPath, 
 									PageId pageId, 
 									int isLeaf)
 {
 	if(isLeaf == 1) {
-		Page* page;
-		bufMgr->readPage(file, pageId, page);
-		LeafNodeInt* tmpNode = reinterpret_cast<LeafNodeInt*>(page);
-		std::vector<int> node;
+		PageGuard page = bufMgr->readPage(file, pageId);
+		LeafNode<Traits>* tmpNode = page.as<LeafNode<Traits>>();
+		std::vector<typename Traits::Key> node;
 		for(int i = 0; i < tmpNode->length; i++) {
 			node.push_back(tmpNode->keyArray[i]);
 		}
 
 		outPath.push_back(node);
-		bufMgr->unPinPage(file, pageId, false);
 		return;
 	}
 
-	Page* page;
-	bufMgr->readPage(file, pageId, page);
-	NonLeafNodeInt* tmpNode = reinterpret_cast<NonLeafNodeInt*>(page);
-	std::vector<int> node;
+	PageGuard page = bufMgr->readPage(file, pageId);
+	NonLeafNode<Traits>* tmpNode = page.as<NonLeafNode<Traits>>();
+	std::vector<typename Traits::Key> node;
 	for(int i = 0; i < tmpNode->length; i++) {
 		node.push_back(tmpNode->keyArray[i]);
 	}
@@ -663,10 +1141,10 @@ void BTreeIndex::preOrderTraversal(std::vector<std::vector<int>> &outPath,
 		children.push_back(tmpNode->pageNoArray[i]);
 	}
 	isLeaf = (tmpNode->level == 1);
-	bufMgr->unPinPage(file, pageId, false);
+	page.release();
 
 	for(unsigned int i = 0; i < children.size(); i++) {
-		preOrderTraversal(outPath, children[i], isLeaf);
+		preOrderTraversal<Traits>(outPath, children[i], isLeaf);
 	}
 
 }
@@ -674,28 +1152,26 @@ void BTreeIndex::preOrderTraversal(std::vector<std::vector<int>> &outPath,
 // -----------------------------------------------------------------------------
 // BTreeIndex::postOrderTraversal
 // -----------------------------------------------------------------------------
-void BTreeIndex::postOrderTraversal(std::vector<std::vector<int>> &outPath, 
+template <class Traits>
+void BTreeIndex::postOrderTraversal(std::vector<std::vector<typename Traits::Key>> &outPath, 
 									PageId pageId, 
 									int isLeaf)
 {
 	if(isLeaf == 1) {
-		Page* page;
-		bufMgr->readPage(file, pageId, page);
-		LeafNodeInt* tmpNode = reinterpret_cast<LeafNodeInt*>(page);
-		std::vector<int> node;
+		PageGuard page = bufMgr->readPage(file, pageId);
+		LeafNode<Traits>* tmpNode = page.as<LeafNode<Traits>>();
+		std::vector<typename Traits::Key> node;
 		for(int i = 0; i < tmpNode->length; i++) {
 			node.push_back(tmpNode->keyArray[i]);
 		}
 
 		outPath.push_back(node);
-		bufMgr->unPinPage(file, pageId, false);
 		return;
 	}
 
-	Page* page;
-	bufMgr->readPage(file, pageId, page);
-	NonLeafNodeInt* tmpNode = reinterpret_cast<NonLeafNodeInt*>(page);
-	std::vector<int> node;
+	PageGuard page = bufMgr->readPage(file, pageId);
+	NonLeafNode<Traits>* tmpNode = page.as<NonLeafNode<Traits>>();
+	std::vector<typename Traits::Key> node;
 	for(int i = 0; i < tmpNode->length; i++) {
 		node.push_back(tmpNode->keyArray[i]);
 	}
@@ -704,10 +1180,10 @@ void BTreeIndex::postOrderTraversal(std::vector<std::vector<int>> &outPath,
 		children.push_back(tmpNode->pageNoArray[i]);
 	}
 	isLeaf = (tmpNode->level == 1);
-	bufMgr->unPinPage(file, pageId, false);
+	page.release();
 
 	for(unsigned int i = 0; i < children.size(); i++) {
-		postOrderTraversal(outPath, children[i], isLeaf);
+		postOrderTraversal<Traits>(outPath, children[i], isLeaf);
 	}
 
 	outPath.push_back(node);
@@ -718,8 +1194,10 @@ void BTreeIndex::postOrderTraversal(std::vector<std::vector<int>> &outPath,
 // -----------------------------------------------------------------------------
 const std::vector<std::vector<int>> BTreeIndex::getTreePreOrder()
 {
+	if(attributeType != INTEGER)
+		throw BadIndexInfoException("the tree can only be listed for an INTEGER attribute");
 	std::vector<std::vector<int>> ret;
-	preOrderTraversal(ret, rootPageNum, numNonLeafNode == 0);
+	preOrderTraversal<IntKeyTraits>(ret, rootPageNum, numNonLeafNode == 0);
 	return ret;
 }
 
@@ -728,8 +1206,10 @@ const std::vector<std::vector<int>> BTreeIndex::getTreePreOrder()
 // -----------------------------------------------------------------------------
 const std::vector<std::vector<int>> BTreeIndex::getTreePostOrder()
 {
+	if(attributeType != INTEGER)
+		throw BadIndexInfoException("the tree can only be listed for an INTEGER attribute");
 	std::vector<std::vector<int>> ret;
-	postOrderTraversal(ret, rootPageNum, numNonLeafNode == 0);
+	postOrderTraversal<IntKeyTraits>(ret, rootPageNum, numNonLeafNode == 0);
 	return ret;
 }
 
@@ -744,12 +1224,88 @@ const void BTreeIndex::startScan(const void* lowValParm,
 {
 	
   	//If another scan is already executing, that needs to be ended here.
-  	if (scanExecuting)	
+  	if (scanCursor.isScanning())	
 	{
-	   //std::cout << "!!! scanExecuting is already on" << std::endl;	
 	   //just ends here, should not affect the current scan
 	   return;
 	}
+	scanCursor.setReadAhead(readAheadDepth);
+	scanCursor.startScan(lowValParm, lowOpParm, highValParm, highOpParm);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNext
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::scanNext(RecordId& outRid) 
+{
+	scanCursor.scanNext(outRid);
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::endScan
+// -----------------------------------------------------------------------------
+//
+const void BTreeIndex::endScan() 
+{
+	scanCursor.endScan();
+}
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setReadAhead
+// -----------------------------------------------------------------------------
+
+const void BTreeIndex::setReadAhead(const int depth)
+{
+	readAheadDepth = depth > 0 ? depth : 0;
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor::IndexCursor -- Constructor
+// -----------------------------------------------------------------------------
+
+IndexCursor::IndexCursor(BTreeIndex *index)
+	: index(index), scanExecuting(false), nextEntry(-1), readAheadDepth(BufMgr::DEFAULT_READ_AHEAD),
+	  scanLeavesPrefetched(0)
+{
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor::scanLowVal, scanHighVal, pastHighVal
+// -----------------------------------------------------------------------------
+template <>
+int& IndexCursor::scanLowVal<IntKeyTraits>() { return lowValInt; }
+template <>
+double& IndexCursor::scanLowVal<DoubleKeyTraits>() { return lowValDouble; }
+template <>
+StringKey& IndexCursor::scanLowVal<StringKeyTraits>() { return lowValString; }
+template <>
+int& IndexCursor::scanHighVal<IntKeyTraits>() { return highValInt; }
+template <>
+double& IndexCursor::scanHighVal<DoubleKeyTraits>() { return highValDouble; }
+template <>
+StringKey& IndexCursor::scanHighVal<StringKeyTraits>() { return highValString; }
+
+template <class Traits>
+bool IndexCursor::pastHighVal(const typename Traits::Key& key) {
+	// beyond highVal, or on it when the high end is open
+	const typename Traits::Key& highVal = scanHighVal<Traits>();
+	return (highOp == LT) ? !Traits::less(key, highVal) : Traits::less(highVal, key);
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor::startScan
+// -----------------------------------------------------------------------------
+
+void IndexCursor::startScan(const void* lowValParm,
+				   const Operator lowOpParm,
+				   const void* highValParm,
+				   const Operator highOpParm)
+{
+	
+  	//If another scan is already executing, that needs to be ended here.
+  	if (scanExecuting)	
+		endScan();
 	
 	//check if the operators are valid
   	if((lowOpParm != GT && lowOpParm != GTE) || (highOpParm != LT && highOpParm != LTE))
@@ -759,64 +1315,83 @@ const void BTreeIndex::startScan(const void* lowValParm,
     		highOp = highOpParm;
   	}
   	
+  	//read the bounds as keys of the index's type
+	switch(index->attributeType) {
+		case INTEGER:
+			lowValInt = IntKeyTraits::read(lowValParm);
+			highValInt = IntKeyTraits::read(highValParm);
+			startKeyScan<IntKeyTraits>();
+			break;
+		case DOUBLE:
+			lowValDouble = DoubleKeyTraits::read(lowValParm);
+			highValDouble = DoubleKeyTraits::read(highValParm);
+			startKeyScan<DoubleKeyTraits>();
+			break;
+		case STRING:
+			lowValString = StringKeyTraits::read(lowValParm);
+			highValString = StringKeyTraits::read(highValParm);
+			startKeyScan<StringKeyTraits>();
+			break;
+	}
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor::startKeyScan
+// -----------------------------------------------------------------------------
+
+template <class Traits>
+void IndexCursor::startKeyScan()
+{
+	typedef typename Traits::Key Key;
+	const Key& lowVal = scanLowVal<Traits>();
+
   	//check if value is valid
-  	lowValInt = *((int *)lowValParm);
-  	highValInt = *((int *)highValParm);
-  	if (lowValInt > highValInt) 
+  	if (Traits::less(scanHighVal<Traits>(), lowVal)) 
 	    throw BadScanrangeException();
-  	else
-    	    scanExecuting = true;
 
 	//Set up all the variables for scan. 
   	//Start from root to find out the leaf page that contains the first RecordID 
-  	currentPageNum = rootPageNum;
-
-  	//search for the corresponding leaf node
-  	LeafNodeInt* node;
+  	//The leaf stays pinned by the guard, and is unpinned by it if no entry is found
   	std::vector<PageId> path;
-  	currentPageNum = searchEntry(&lowValInt, node, path);
-	bufMgr->unPinPage(file, currentPageNum, false); // searchEntry doesn't unpin currentPageNum
-	bufMgr->readPage(file, currentPageNum, currentPageData);
-	//unpin by endscan
-	//bufMgr->unPinPage(file, currentPageNum, false);
+  	PageGuard leafPage = index->searchEntry<Traits>(lowVal, path);
+  	const PageId firstLeafPageNum = leafPage.getPageNo();
+  	LeafNode<Traits>* node = leafPage.as<LeafNode<Traits>>();
 
   	//traverse the page to locate the first RecordID 
-  	int entryIdx = std::lower_bound(node->keyArray, node->keyArray + node->length-1, lowValInt) - (node->keyArray);  
+  	int entryIdx = Traits::lowerBound(node->keyArray, node->length-1, lowVal);
        
 	
-	//normal case that entryIdx is >= lowValInt
+	//normal case that entryIdx is >= lowVal
 	//but the exception is the end of key array
-	if(node->keyArray[entryIdx] < lowValInt){
+	if(Traits::less(node->keyArray[entryIdx], lowVal)){
 		//cannot find the entry in the expected node
-		endScan();
 		throw NoSuchKeyFoundException();
   	}
         //handle the case that the found entry is bigger than the highVal
-	if(node->keyArray[entryIdx] > highValInt || (node->keyArray[entryIdx] == highValInt && highOp == LT)){
-		endScan();
+	if(pastHighVal<Traits>(node->keyArray[entryIdx])){
 		throw NoSuchKeyFoundException();
 	}
   	//the case that the entry is the last record and lowOp is GT
   	//the entry will be in the next node
 	if(entryIdx == (node->length-1) && lowOp == GT){
-  		bufMgr->unPinPage(file, currentPageNum, false);
-    		currentPageNum = node->rightSibPageNo;
-    		bufMgr->readPage(file, currentPageNum, currentPageData);
+		const PageId nextPageNum = node->rightSibPageNo;
+		if(nextPageNum == 0)
+			throw NoSuchKeyFoundException();
+  		leafPage.release();
+    		leafPage = index->bufMgr->readPage(index->file, nextPageNum);
     		nextEntry = 0;
-
   	}
   	else{
-		if(lowOp == GT && lowValInt == node->keyArray[entryIdx])
+		//the entry is not less than lowVal, so it equals it unless lowVal is less
+		if(lowOp == GT && !Traits::less(lowVal, node->keyArray[entryIdx]))
 		nextEntry = entryIdx+1;
 		else
 		nextEntry = entryIdx;
   	}
 	
-	node = (LeafNodeInt *)currentPageData;
-	int curKey = node->keyArray[nextEntry];
-	if(curKey > highValInt || (curKey == highValInt && highOp == LT)) {
+	node = leafPage.as<LeafNode<Traits>>();
+	if(pastHighVal<Traits>(node->keyArray[nextEntry])) {
              std::cout << "!!! exceed the higher bound" <<std::endl;
-             endScan();
              throw NoSuchKeyFoundException();
         }
                                                                               
@@ -825,18 +1400,27 @@ const void BTreeIndex::startScan(const void* lowValParm,
 
   	//Check if the record is valid
   	if(outRid.page_number == 0 && outRid.slot_number == 0) {
-    		endScan();
 	        std::cout << "!!! invalid record data" <<std::endl;
     		throw NoSuchKeyFoundException();
   	}
 
+	currentPage = std::move(leafPage);
+	scanExecuting = true;
+	try {
+		planScanLeaves<Traits>(firstLeafPageNum, path);
+		if(currentPage.getPageNo() != firstLeafPageNum)
+			advanceScanLeaves<Traits>();
+	} catch(...) {
+		endScan();
+		throw;
+	}
 }
   
 // -----------------------------------------------------------------------------
-// BTreeIndex::scanNext
+// IndexCursor::scanNext
 // -----------------------------------------------------------------------------
 
-const void BTreeIndex::scanNext(RecordId& outRid) 
+void IndexCursor::scanNext(RecordId& outRid) 
 {
  	
 	if (!scanExecuting){ 
@@ -847,15 +1431,26 @@ const void BTreeIndex::scanNext(RecordId& outRid)
 		throw IndexScanCompletedException();
 	}
 
-	
-	LeafNodeInt *node = reinterpret_cast<LeafNodeInt*>(currentPageData);
+	switch(index->attributeType) {
+		case INTEGER: nextKey<IntKeyTraits>(outRid); break;
+		case DOUBLE: nextKey<DoubleKeyTraits>(outRid); break;
+		case STRING: nextKey<StringKeyTraits>(outRid); break;
+	}
+}
 
-	outRid = node->ridArray[nextEntry];
-	int curKey = node->keyArray[nextEntry];
+// -----------------------------------------------------------------------------
+// IndexCursor::nextKey
+// -----------------------------------------------------------------------------
+
+template <class Traits>
+void IndexCursor::nextKey(RecordId& outRid)
+{
+	LeafNode<Traits> *node = currentPage.as<LeafNode<Traits>>();
 
+	outRid = node->ridArray[nextEntry];
 
 	//check if reach the upper bound
-	if (curKey > highValInt || (curKey == highValInt && highOp == LT))
+	if (pastHighVal<Traits>(node->keyArray[nextEntry]))
 	{	
 	    throw IndexScanCompletedException();
 	}
@@ -864,35 +1459,116 @@ const void BTreeIndex::scanNext(RecordId& outRid)
 	nextEntry++;
 
 	//handle the case that the next entry is the next node
- 	if (nextEntry >= INTARRAYLEAFSIZE || (nextEntry >= node->length)){
+ 	if (nextEntry >= LeafNode<Traits>::CAPACITY || (nextEntry >= node->length)){
     	    
 	    if(node->rightSibPageNo == 0){
 	       //no next Entry
 	       nextEntry = -1;
 	   }
 	    else{
-	      bufMgr->unPinPage(file, currentPageNum, false);
-              currentPageNum = node->rightSibPageNo;
-              bufMgr->readPage(file, currentPageNum, currentPageData);
+	      const PageId nextPageNum = node->rightSibPageNo;
+	      currentPage.release();
+              currentPage = index->bufMgr->readPage(index->file, nextPageNum);
   	      nextEntry = 0;
+  	      advanceScanLeaves<Traits>();
 	    }
 	}
 
 }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::endScan
+// IndexCursor::endScan
 // -----------------------------------------------------------------------------
 //
-const void BTreeIndex::endScan() 
+void IndexCursor::endScan() 
 {
 	if (!scanExecuting) {
 		throw ScanNotInitializedException();
 	}
 	else{
 		scanExecuting = false;
-		bufMgr->unPinPage(file, currentPageNum, false);
+		scanLeaves.clear();
+		scanLeavesPrefetched = 0;
+		currentPage.release();
 	}
 
 }
+
+// -----------------------------------------------------------------------------
+// IndexCursor::setReadAhead
+// -----------------------------------------------------------------------------
+
+void IndexCursor::setReadAhead(const int depth)
+{
+	readAheadDepth = depth > 0 ? depth : 0;
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor::planScanLeaves
+// -----------------------------------------------------------------------------
+
+template <class Traits>
+void IndexCursor::planScanLeaves(PageId leafPageNo, const std::vector<PageId> &path)
+{
+	scanLeaves.clear();
+	scanLeavesPrefetched = 0;
+	// a root that is itself a leaf has no siblings
+	if(readAheadDepth == 0 || path.empty())
+		return;
+
+	PageGuard page = index->bufMgr->readPage(index->file, path.back());
+	NonLeafNode<Traits>* parent = page.as<NonLeafNode<Traits>>();
+
+	int i = 0;
+	while(i <= parent->length && parent->pageNoArray[i] != leafPageNo)
+		i++;
+	// child i holds keys from keyArray[i-1] on, so stop at the first one that starts past the scan range
+	for(i++; i <= parent->length && !Traits::less(scanHighVal<Traits>(), parent->keyArray[i - 1]); i++)
+		scanLeaves.push_back(parent->pageNoArray[i]);
+	page.release();
+
+	prefetchScanLeaves();
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor::advanceScanLeaves
+// -----------------------------------------------------------------------------
+
+template <class Traits>
+void IndexCursor::advanceScanLeaves()
+{
+	if(readAheadDepth == 0)
+		return;
+
+	if(!scanLeaves.empty() && scanLeaves.front() == currentPage.getPageNo()) {
+		scanLeaves.pop_front();
+		if(scanLeavesPrefetched > 0)
+			scanLeavesPrefetched--;
+		prefetchScanLeaves();
+		return;
+	}
+
+	// the scan left the children of the last parent: descend again to find the next one
+	LeafNode<Traits>* node = currentPage.as<LeafNode<Traits>>();
+	if(node->length == 0 || Traits::less(scanHighVal<Traits>(), node->keyArray[0]))
+		return;
+	const typename Traits::Key key = node->keyArray[0];
+	std::vector<PageId> path;
+	// only the path is needed; the guard returned unpins the leaf right away
+	index->searchEntry<Traits>(key, path);
+	planScanLeaves<Traits>(currentPage.getPageNo(), path);
+}
+
+// -----------------------------------------------------------------------------
+// IndexCursor::prefetchScanLeaves
+// -----------------------------------------------------------------------------
+
+void IndexCursor::prefetchScanLeaves()
+{
+	std::size_t depth = std::min(scanLeaves.size(), (std::size_t)readAheadDepth);
+	if(scanLeavesPrefetched >= depth)
+		return;
+	index->bufMgr->prefetch(index->file, std::vector<PageId>(scanLeaves.begin() + scanLeavesPrefetched, scanLeaves.begin() + depth));
+	scanLeavesPrefetched = depth;
+}
 }
@@ -7,52 +7,157 @@
 
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <deque>
+#include <vector>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "index_log.h"
+#include "node_search.h"
 
 namespace badgerdb
 {
 
+
 /**
- * @brief Datatype enumeration type.
+ * @brief Number of characters of a STRING key. A longer attribute is indexed on its first STRINGSIZE characters.
  */
-enum Datatype
-{
-	INTEGER = 0,
-	DOUBLE = 1,
-	STRING = 2
-};
+const int STRINGSIZE = 10;
 
 /**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
+ * @brief Key of a STRING attribute: its first STRINGSIZE characters, padded with '\0' after the end of a shorter
+ * string. Keys order byte by byte, as memcmp() does.
  */
-enum Operator
-{ 
-	LT, 	/* Less Than */
-	LTE,	/* Less Than or Equal to */
-	GTE,	/* Greater Than or Equal to */
-	GT		/* Greater Than */
+struct StringKey {
+	char bytes[ STRINGSIZE ];
 };
 
+/**
+ * @brief Prints the characters of a STRING key up to its padding.
+ */
+inline std::ostream& operator<<( std::ostream& os, const StringKey& key )
+{
+	return os.write( key.bytes, strnlen( key.bytes, STRINGSIZE ) );
+}
+
+/*
+A key traits type tells the templates of the tree what a key of one Datatype is: the Key stored in the nodes, how it
+is read from a record or a scan bound, how two keys order, and how a key is looked up in the key array of a node.
+Every member is inline, so a node search or split compares keys with no dispatch; the index picks the traits once per
+call from the attribute type.
+*/
 
 /**
- * @brief Number of key slots in B+Tree leaf for INTEGER key.
+ * @brief Key traits of an INTEGER attribute. Nodes are searched with the SIMD kernels of NodeSearch.
  */
-//                                                  sibling ptr             key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+struct IntKeyTraits {
+	typedef int Key;
+
+	/**
+	 * Reads a key from a record field or a scan bound, which need not be aligned.
+	 */
+	static Key read( const void* value )
+	{
+		Key key;
+		memcpy( &key, value, sizeof( key ) );
+		return key;
+	}
+
+	static bool less( const Key a, const Key b )
+	{
+		return a < b;
+	}
+
+	static int upperBound( const Key* keys, const int length, const Key key )
+	{
+		return NodeSearch::upperBound( keys, length, key );
+	}
+
+	static int lowerBound( const Key* keys, const int length, const Key key )
+	{
+		return NodeSearch::lowerBound( keys, length, key );
+	}
+};
 
 /**
- * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
+ * @brief Key traits of a DOUBLE attribute. Keys follow the IEEE 754 total order: -NaN < -inf < ... < -0.0 < +0.0
+ * < ... < +inf < +NaN, so every key, NaN included, has its place in the tree.
  */
-//                                                     level     extra pageNo                  key       pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) );
+struct DoubleKeyTraits {
+	typedef double Key;
+
+	static Key read( const void* value )
+	{
+		Key key;
+		memcpy( &key, value, sizeof( key ) );
+		return key;
+	}
+
+	/**
+	 * Maps a double to an integer of the same total order: the bits of a negative double count down from the sign.
+	 */
+	static std::int64_t rank( const Key key )
+	{
+		std::int64_t bits;
+		memcpy( &bits, &key, sizeof( bits ) );
+		return bits ^ (std::int64_t)( (std::uint64_t)( bits >> 63 ) >> 1 );
+	}
+
+	static bool less( const Key a, const Key b )
+	{
+		return rank( a ) < rank( b );
+	}
+
+	static int upperBound( const Key* keys, const int length, const Key key )
+	{
+		return NodeSearch::upperBound<DoubleKeyTraits>( keys, length, key );
+	}
+
+	static int lowerBound( const Key* keys, const int length, const Key key )
+	{
+		return NodeSearch::lowerBound<DoubleKeyTraits>( keys, length, key );
+	}
+};
+
+/**
+ * @brief Key traits of a STRING attribute, keyed on fixed-width StringKey prefixes.
+ */
+struct StringKeyTraits {
+	typedef StringKey Key;
+
+	/**
+	 * Reads the key of a '\0'-terminated string, or of the first STRINGSIZE characters of a longer one.
+	 */
+	static Key read( const void* value )
+	{
+		Key key;
+		memset( key.bytes, 0, STRINGSIZE );
+		memcpy( key.bytes, value, strnlen( static_cast<const char*>( value ), STRINGSIZE ) );
+		return key;
+	}
+
+	static bool less( const Key& a, const Key& b )
+	{
+		return memcmp( a.bytes, b.bytes, STRINGSIZE ) < 0;
+	}
+
+	static int upperBound( const Key* keys, const int length, const Key& key )
+	{
+		return NodeSearch::upperBound<StringKeyTraits>( keys, length, key );
+	}
+
+	static int lowerBound( const Key* keys, const int length, const Key& key )
+	{
+		return NodeSearch::lowerBound<StringKeyTraits>( keys, length, key );
+	}
+};
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
@@ -128,6 +233,52 @@ struct IndexMetaInfo{
    * Page number of root page of the B+ Tree inside the file index file.
    */
 	PageId rootPageNo;
+
+  /**
+   * Page number of this meta page, checked against the first page of the file when the index is opened.
+   */
+	PageId headerPageNo;
+
+  /**
+   * Number of levels of the tree, 1 while the root is a leaf. 0 in an index file written before the shape of the
+   * tree was kept here.
+   */
+	int height;
+
+  /**
+   * Number of leaf nodes.
+   */
+	int numLeafNodes;
+
+  /**
+   * Number of non-leaf nodes.
+   */
+	int numNonLeafNodes;
+
+  /**
+   * Maximum number of keys in a leaf node.
+   */
+	int leafOccupancy;
+
+  /**
+   * Maximum number of keys in a non-leaf node.
+   */
+	int nodeOccupancy;
+
+  /**
+   * Number of entries in the leaves, i.e. of keys in the index.
+   */
+	std::uint64_t numKeys;
+
+  /**
+   * Number of keys in the non-leaf nodes.
+   */
+	std::uint64_t numNonLeafKeys;
+
+  /**
+   * INDEX_LAYOUT_VERSION of the code that created the index. 0 in an index file written before it was kept here.
+   */
+	int layoutVersion;
 };
 
 /*
@@ -138,9 +289,17 @@ at this level are just above the leaf nodes. Otherwise set to 0.
 */
 
 /**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all non-leaf nodes, templated over the key traits of the index.
 */
-struct NonLeafNodeInt{
+template <class Traits>
+struct NonLeafNode{
+	typedef typename Traits::Key Key;
+
+  /**
+   * Number of key slots, as many as fit in a page next to the level, the length and one extra page number.
+   */
+	static const int CAPACITY = ( Page::SIZE - 2 * sizeof( int ) - sizeof( PageId ) ) / ( sizeof( Key ) + sizeof( PageId ) );
+
   /**
    * Level of the node in the tree.
    */
@@ -149,7 +308,7 @@ struct NonLeafNodeInt{
   /**
    * Stores keys.
    */
-	int keyArray[ INTARRAYNONLEAFSIZE ];
+	Key keyArray[ CAPACITY ];
 
 	/**
    * The number of keys stored
@@ -159,23 +318,31 @@ struct NonLeafNodeInt{
   /**
    * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
    */
-	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
+	PageId pageNoArray[ CAPACITY + 1 ];
 };
 
 
 /**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
+ * @brief Structure for all leaf nodes, templated over the key traits of the index.
 */
-struct LeafNodeInt{
+template <class Traits>
+struct LeafNode{
+	typedef typename Traits::Key Key;
+
+  /**
+   * Number of key slots, as many as fit in a page next to the length and the sibling page number.
+   */
+	static const int CAPACITY = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( Key ) + sizeof( RecordId ) );
+
   /**
    * Stores keys.
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+	Key keyArray[ CAPACITY ];
 
   /**
    * Stores RecordIds.
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+	RecordId ridArray[ CAPACITY ];
 
 	/**
    * The number of keys stored
@@ -189,13 +356,249 @@ struct LeafNodeInt{
 	PageId rightSibPageNo;
 };
 
+/**
+ * @brief Nodes of an index on an INTEGER attribute.
+ */
+typedef NonLeafNode<IntKeyTraits> NonLeafNodeInt;
+typedef LeafNode<IntKeyTraits> LeafNodeInt;
+
+/**
+ * @brief Nodes of an index on a DOUBLE attribute.
+ */
+typedef NonLeafNode<DoubleKeyTraits> NonLeafNodeDouble;
+typedef LeafNode<DoubleKeyTraits> LeafNodeDouble;
 
 /**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
+ * @brief Nodes of an index on a STRING attribute.
+ */
+typedef NonLeafNode<StringKeyTraits> NonLeafNodeString;
+typedef LeafNode<StringKeyTraits> LeafNodeString;
+
+static_assert( sizeof( NonLeafNodeInt ) <= Page::SIZE && sizeof( LeafNodeInt ) <= Page::SIZE,
+               "An INTEGER node must fit in a page." );
+static_assert( sizeof( NonLeafNodeDouble ) <= Page::SIZE && sizeof( LeafNodeDouble ) <= Page::SIZE,
+               "A DOUBLE node must fit in a page." );
+static_assert( sizeof( NonLeafNodeString ) <= Page::SIZE && sizeof( LeafNodeString ) <= Page::SIZE,
+               "A STRING node must fit in a page." );
+
+/**
+ * @brief Version of the on-disk node layout, bumped whenever a node structure above changes. Version 2 sizes the
+ * INTEGER non-leaf node to fit in a page (1022 keys, where version 1 had 1023 and ran past the end of the page).
+ * An index file of another version is refused on open.
+ */
+const  int INDEX_LAYOUT_VERSION = 2;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for INTEGER key.
+ */
+const  int INTARRAYLEAFSIZE = LeafNodeInt::CAPACITY;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
+ */
+const  int INTARRAYNONLEAFSIZE = NonLeafNodeInt::CAPACITY;
+
+
+class BTreeIndex;
+
+/**
+ * @brief A range scan over a BTreeIndex. Every cursor keeps its own bounds, position and read-ahead, and holds the
+ * leaf it is on pinned, so any number of cursors can scan one open index at once, each from its own thread if need
+ * be. Cursors only read the tree: inserts must not run while a cursor of the same index is scanning, and a cursor
+ * must be done scanning before its index is destroyed.
+*/
+class IndexCursor {
+
+ public:
+
+  /**
+   * Constructs a cursor over an index, with no scan started.
+   * @param index	Index to scan
+   */
+	explicit IndexCursor(BTreeIndex *index);
+
+  /**
+	 * Begin a filtered scan of the index.  For instance, if the method is called 
+	 * using ("a",GT,"d",LTE) then we should seek all entries with a value 
+	 * greater than "a" and less than or equal to "d".
+	 * A scan the cursor is already running is ended first.
+	 * Start from root to find out the leaf page that contains the first RecordID
+	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	void startScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan, moving on to the right sibling of the
+	 * current leaf once it is done.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	void scanNext(RecordId& outRid);
+
+  /**
+	 * Terminate the current scan. Unpin the leaf it is on.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	void endScan();
+
+  /**
+	 * Set how many leaves the cursor prefetches ahead of the leaf it is on. Takes effect with the next startScan().
+   * @param depth	Number of leaves; 0 reads each leaf only when the scan reaches it
+	**/
+	void setReadAhead(const int depth);
+
+  /**
+	 * True if a scan has been started and not ended.
+	**/
+	bool isScanning() const { return scanExecuting; }
+
+ private:
+
+  /**
+   * Index being scanned.
+   */
+	BTreeIndex	*index;
+
+  /**
+   * True if an index scan has been started.
+   */
+	bool		scanExecuting;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */
+	int			nextEntry;
+
+  /**
+   * Current page being scanned, pinned until the scan moves off it.
+   */
+	PageGuard	currentPage;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+	int			lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+	double	lowValDouble;
+
+  /**
+   * Low STRING value for scan.
+   */
+	StringKey	lowValString;
+
+  /**
+   * High INTEGER value for scan.
+   */
+	int			highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+	double	highValDouble;
+
+  /**
+   * High STRING value for scan.
+   */
+	StringKey	highValString;
+	
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+	Operator	lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+	Operator	highOp;
+
+  /**
+   * Number of leaves to prefetch ahead of the leaf being scanned; 0 turns read-ahead off.
+   */
+	int			readAheadDepth;
+
+  /**
+   * Leaves known to follow the current one in the scan, in order: its right siblings under the same parent.
+   */
+	std::deque<PageId>	scanLeaves;
+
+  /**
+   * Number of leaves at the front of scanLeaves already handed to BufMgr::prefetch().
+   */
+	std::size_t	scanLeavesPrefetched;
+
+  /**
+	* Low bound of the current scan, the lowVal member of the key type.
+	**/
+  template <class Traits>
+  typename Traits::Key& scanLowVal();
+
+  /**
+	* High bound of the current scan, the highVal member of the key type.
+	**/
+  template <class Traits>
+  typename Traits::Key& scanHighVal();
+
+  /**
+	* True if a key is past the high end of the scan range.
+	**/
+  template <class Traits>
+  bool pastHighVal(const typename Traits::Key& key);
+
+  /**
+	* Position a scan whose bounds and operators are set; the body of startScan().
+	**/
+   template <class Traits>
+   void startKeyScan();
+
+  /**
+	* Return the next entry of the scan; the body of scanNext().
+	**/
+   template <class Traits>
+   void nextKey(RecordId& outRid);
+
+  /**
+	* Fill scanLeaves with the siblings to the right of a leaf under its parent that may hold keys in the scan range,
+	* and prefetch the first of them.
+   * @param leafPageNo		Leaf being scanned
+   * @param path			Path from the root to the leaf as returned by BTreeIndex::searchEntry()
+	**/
+   template <class Traits>
+   void planScanLeaves(PageId leafPageNo, const std::vector<PageId> &path);
+
+  /**
+	* Called after the scan moved on to currentPage: drop it from scanLeaves and keep readAheadDepth leaves
+	* prefetched, looking up the next parent once the leaves of the current one run out.
+	**/
+   template <class Traits>
+   void advanceScanLeaves();
+
+  /**
+	* Prefetch the leaves of scanLeaves within readAheadDepth that have not been prefetched yet.
+	**/
+   void prefetchScanLeaves();
+};
+
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single INTEGER, DOUBLE or STRING attribute of a
+ * relation. startScan(), scanNext() and endScan() run one scan at a time on a cursor of the index; more scans at
+ * once each take an IndexCursor of their own.
 */
 class BTreeIndex {
 
+	friend class IndexCursor;
+
  private:
 
   /**
@@ -239,98 +642,119 @@ class BTreeIndex {
 	int			nodeOccupancy;
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Number of non-leaf nodes.
    */
 	int			numNonLeafNode;
    
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Number of leaf nodes.
    */
 	int			numLeafNode;
 
-	// MEMBERS SPECIFIC TO SCANNING
-
   /**
-   * True if an index scan has been started.
+   * Number of levels of the tree, 1 while the root is a leaf.
    */
-	bool		scanExecuting;
+	int			height;
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Number of entries in the leaves.
    */
-	int			nextEntry;
+	std::uint64_t	numKeys;
 
   /**
-   * Page number of current page being scanned.
+   * Number of keys in the non-leaf nodes.
    */
-	PageId	currentPageNum;
+	std::uint64_t	numNonLeafKeys;
 
   /**
-   * Current Page being scanned.
+   * Write-ahead log of the index, or NULL if every insert is flushed to the file right away.
    */
-	Page		*currentPageData;
+	IndexLog	*indexLog;
 
   /**
-   * Low INTEGER value for scan.
+   * Number of leaves the scan of startScan() prefetches ahead of the leaf it is on; 0 turns read-ahead off.
    */
-	int			lowValInt;
+	int			readAheadDepth;
 
   /**
-   * Low DOUBLE value for scan.
+   * Cursor of the scan run through startScan(), scanNext() and endScan().
    */
-	double	lowValDouble;
+	IndexCursor	scanCursor;
 
   /**
-   * Low STRING value for scan.
-   */
-	std::string	lowValString;
+	* Initialize a leaf node. 
+   * @param node	   Node to be initialized.
+	**/
+  template <class Traits>
+  void initLeafNode(LeafNode<Traits>* node);
 
   /**
-   * High INTEGER value for scan.
-   */
-	int			highValInt;
+	* Initialize a non-leaf node. 
+   * @param node	   Node to be initialized.
+	**/
+  template <class Traits>
+  void initNonLeafNode(NonLeafNode<Traits>* node);
 
   /**
-   * High DOUBLE value for scan.
-   */
-	double	highValDouble;
+	* Clamp the orders given to the constructor to the capacity of the nodes of the key type; an order of 0 or less
+	* fills the nodes.
+   * @param orderNonLeaf		Maximum number of keys in a non-leaf node asked for
+   * @param orderLeaf			Maximum number of keys in a leaf node asked for
+	**/
+  template <class Traits>
+  void setOccupancy(int orderNonLeaf, int orderLeaf);
 
   /**
-   * High STRING value for scan.
-   */
-	std::string highValString;
-	
-  /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
-   */
-	Operator	lowOp;
+	* Take the orders of an index being reopened from its meta page, in place of those given to the constructor.
+   * @param orderNonLeaf		Maximum number of keys in a non-leaf node the index was built with
+   * @param orderLeaf			Maximum number of keys in a leaf node the index was built with
+   * @throws BadIndexInfoException If an order is not in [1, capacity] for nodes of the key type
+	**/
+  template <class Traits>
+  void restoreOccupancy(int orderNonLeaf, int orderLeaf);
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
-   */
-	Operator	highOp;
+	* Tell the write-ahead log, if any, that a pinned page is about to be modified by the current insert.
+   * @param pageId		Page number of the node
+   * @param page			The pinned page
+	**/
+  void logPageUpdate(PageId pageId, Page* page);
 
   /**
-	* Initialize a LeafNodeInt. 
-   * @param node	   Node to be initialized.
+	* Build the tree bottom-up from the base relation. The (key, rid) pairs are extracted with a FileScan and sorted,
+	* spilling sorted runs to temporary files when they do not fit in the memory of the buffer pool. Leaves are then
+	* packed left to right and the non-leaf levels stacked on top of them, all written sequentially into pages that
+	* are allocated in one go at the end of the index file.
+   * @param relationName		Name of the base relation
+   * @param fillFactor			Fraction of every node to fill, in (0, 1]
+   * @return  Page number of the root node.
 	**/
-  void initLeafNode(LeafNodeInt* node);
+  template <class Traits>
+  PageId bulkLoadRelation(const std::string & relationName, float fillFactor);
 
   /**
-	* Initialize a NonLeafNodeInt. 
-   * @param node	   Node to be initialized.
+	* Write the root page number and the shape of the tree to the meta page. Called by every insert, so that the
+	* counters reach the file, and the log, along with the nodes they describe.
 	**/
-  void initNonLeafNode(NonLeafNodeInt* node);
+   void saveTreeShape();
 
   /**
 	* Search and return the leaf node according to input parameter key. 
 	* Start from root to recursively find out the leaf.
-   * @param key			Key to search, pointer to integer/double/char string
-   * @param outNode 	   Reference to the target leaf node.
+   * @param key			Key to search
    * @param path			Reference to a vector which stores the path from the root node to the target node.
-   * @return  Page number of the leaf node.
+   * @return  Guard holding the leaf node pinned.
+	**/
+   template <class Traits>
+   PageGuard searchEntry(const typename Traits::Key& key, std::vector<PageId> &path);
+
+  /**
+	* Insert a key of the index's type; the body of insertEntry().
+   * @param key			Key to insert
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
 	**/
-   PageId searchEntry(int* key, LeafNodeInt*& outNode, std::vector<PageId> &path);
+   template <class Traits>
+   void insertKey(const typename Traits::Key& key, const RecordId rid);
 
   /**
 	* Split a full non-leaf node into two non-leaf nodes. 
@@ -343,11 +767,12 @@ class BTreeIndex {
    * @param outRightNodePageId	Reference to the right child node of newKey
    * @throws NonLeafNodeNotFullException  If this node is not full (i.e. no need to be splitted)
 	**/
+   template <class Traits>
    void splitNonLeafNode(PageId pageId, 
-								const int key,
+								const typename Traits::Key key,
 								PageId leftNodePageId,
 								PageId rightNodePageId,
-								int& newKey,
+								typename Traits::Key& newKey,
 								PageId& outLeftNodePageId,
 								PageId& outRightNodePageId);
   /**
@@ -359,9 +784,10 @@ class BTreeIndex {
    * @param outRightNodePageId	Reference to the right child node of newKey
    * @throws LeafNodeNotFullException  If this node is not full (i.e. no need to be splitted)
 	**/
+   template <class Traits>
    void splitLeafNode(PageId pageId, 
-								RIDKeyPair<int> ridkeypair, 
-								int& newKey,
+								RIDKeyPair<typename Traits::Key> ridkeypair, 
+								typename Traits::Key& newKey,
 								PageId& outLeftNodePageId,
 								PageId& outRightNodePageId);
 
@@ -372,17 +798,34 @@ class BTreeIndex {
    * @param rightPageId          Right child node of Key
    * @param level 	            level of the new root node
 	**/
-   void createNewRootNode(int newKey, 
+   template <class Traits>
+   void createNewRootNode(typename Traits::Key newKey, 
                            PageId leftPageId, 
                            PageId rightPageId,
                            int level);
+
+  /**
+	* Print the subtree of a node.
+   * @param pageId		         Root node of this tree
+   * @param isLeafNode		      Whether this node is a leaf node or not
+	**/
+   template <class Traits>
+   void printNode(const PageId pageId, bool isLeafNode);
+
+  /**
+	* Page number of the leftmost leaf.
+	**/
+   template <class Traits>
+   PageId firstLeafPageNo();
+
    /**
 	* Traverse the tree in pre-order.
    * @param outPath		         Reference to the traversal path
    * @param pageId   		      Current node
    * @param isLeaf               If this node is a leaf node
 	**/
-   void preOrderTraversal(std::vector<std::vector<int>> &outPath, PageId pageId, int isLeaf);
+   template <class Traits>
+   void preOrderTraversal(std::vector<std::vector<typename Traits::Key>> &outPath, PageId pageId, int isLeaf);
   
    /**
 	* Traverse the tree in post-order.
@@ -390,7 +833,8 @@ class BTreeIndex {
    * @param pageId   		      Current node
    * @param isLeaf               If this node is a leaf node
 	**/
-   void postOrderTraversal(std::vector<std::vector<int>> &outPath, PageId pageId, int isLeaf);
+   template <class Traits>
+   void postOrderTraversal(std::vector<std::vector<typename Traits::Key>> &outPath, PageId pageId, int isLeaf);
 
  public:
 
@@ -403,18 +847,32 @@ class BTreeIndex {
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
-   * @param attrType						Datatype of attribute over which index is built
+   * @param attrType						Datatype of attribute over which index is built. A STRING attribute is keyed on its
+   *                          first STRINGSIZE characters.
+   * @param orderNonLeaf				Maximum number of keys in a non-leaf node, at most the capacity of the node for the key
+   *                          type, which is also used for 0 or less
+   * @param orderLeaf						Maximum number of keys in a leaf node, likewise
+   * @param useLog							If true, inserts are logged to outIndexName + ".log" and dirty index pages stay
+   *                          in the buffer pool until a checkpoint, instead of flushing the file after every insert.
+   *                          An existing log is replayed when the index is opened.
+   * @param bulkLoad						If true, a new index is built bottom-up from the sorted entries of the relation.
+   *                          Otherwise entries are inserted one tuple at a time.
+   * @param fillFactor					Fraction of every node filled by the bulk load, in (0, 1]. Leaving room lets later
+   *                          inserts go in without splitting right away.
    * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   *                                    Also if the meta page does not describe the shape of the tree, as in index files written before it did; such an index has to be rebuilt.
+   *                                    Also if the index was written with another INDEX_LAYOUT_VERSION, or if the node orders kept in the meta page do not fit the nodes of attrType. A reopened index keeps those orders; orderNonLeaf and orderLeaf only apply to a new one.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
 						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
-                  int orderNonLeaf = INTARRAYNONLEAFSIZE, int orderLeaf = INTARRAYLEAFSIZE);
+                  int orderNonLeaf = INTARRAYNONLEAFSIZE, int orderLeaf = INTARRAYLEAFSIZE,
+                  bool useLog = false, bool bulkLoad = false, float fillFactor = 1.0);
 	
 
   /**
    * BTreeIndex Destructor. 
 	 * End any initialized scan, flush index file, after unpinning any pinned pages, from the buffer manager
-	 * and delete file instance thereby closing the index file.
+	 * and delete file instance thereby closing the index file. A write-ahead log is checkpointed and removed.
 	 * Destructor should not throw any exceptions. All exceptions should be caught in here itself. 
 	 * */
 	~BTreeIndex();
@@ -431,6 +889,12 @@ class BTreeIndex {
 	**/
 	const void insertEntry(const void* key, const RecordId rid);
 
+  /**
+	 * Force every logged insert to disk instead of waiting for the current commit group to fill up.
+	 * Does nothing if the index was opened without a log.
+	**/
+	const void syncLog();
+
   /**
 	* Print the Btree from root node
 	**/
@@ -457,6 +921,8 @@ class BTreeIndex {
    *                /   |  \     |  \
    *              1,2  3,4 5,6  7,8  9,10
    * The return value is [[7], [3,5], [3,4], [5,6], [9], [7,8], [9, 10]] [7]]
+   * Only for an index on an INTEGER attribute.
+   * @throws  BadIndexInfoException If the index is on another type of attribute
 	**/
    const std::vector<std::vector<int>> getTreePreOrder();
 
@@ -469,6 +935,8 @@ class BTreeIndex {
    *                /   |  \     |  \
    *              1,2  3,4 5,6  7,8  9,10
    * The return value is [[1,2], [3,4], [5,6], [3,5], [7,8], [9], [7]]
+   * Only for an index on an INTEGER attribute.
+   * @throws  BadIndexInfoException If the index is on another type of attribute
 	**/
    const std::vector<std::vector<int>> getTreePostOrder();
 
@@ -476,9 +944,8 @@ class BTreeIndex {
 	 * Begin a filtered scan of the index.  For instance, if the method is called 
 	 * using ("a",GT,"d",LTE) then we should seek all entries with a value 
 	 * greater than "a" and less than or equal to "d".
-	 * If another scan is already executing, that needs to be ended here.
-	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
-	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
+	 * If another scan is already executing, the call is ignored and that scan goes on.
+	 * Otherwise IndexCursor::startScan() is run on the cursor of the index.
    * @param lowVal	Low value of range, pointer to integer / double / char string
    * @param lowOp		Low operator (GT/GTE)
    * @param highVal	High value of range, pointer to integer / double / char string
@@ -505,6 +972,43 @@ class BTreeIndex {
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	**/
 	const void endScan();
+
+  /**
+	 * Set how many leaves the scan of startScan() prefetches ahead of the leaf it is on. Takes effect with the next
+	 * startScan(); an IndexCursor has a setReadAhead() of its own.
+   * @param depth	Number of leaves; 0 reads each leaf only when the scan reaches it
+	**/
+	const void setReadAhead(const int depth);
+
+  /**
+	 * Number of levels of the tree, 1 while the root is a leaf.
+	**/
+	int getHeight() const { return height; }
+
+  /**
+	 * Number of leaf nodes.
+	**/
+	int getNumLeafNodes() const { return numLeafNode; }
+
+  /**
+	 * Number of non-leaf nodes.
+	**/
+	int getNumNonLeafNodes() const { return numNonLeafNode; }
+
+  /**
+	 * Number of entries in the index.
+	**/
+	std::uint64_t getNumKeys() const { return numKeys; }
+
+  /**
+	 * Average fraction of the key slots of a leaf that are in use.
+	**/
+	double getLeafFill() const;
+
+  /**
+	 * Average fraction of the key slots of a non-leaf node that are in use; 0 while the root is a leaf.
+	**/
+	double getNonLeafFill() const;
 	
 };
 
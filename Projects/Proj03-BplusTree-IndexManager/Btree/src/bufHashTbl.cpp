@@ -5,7 +5,8 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
-#include <memory>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include "buffer.h"
 #include "bufHashTbl.h"
@@ -15,100 +16,145 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint32_t BufHashTbl::hash(const File* file, const PageId pageNo) const
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // Mix the file pointer and page number (64-bit finalizer of MurmurHash3) so that consecutive
+  // pages of one file and heap pointers with zero low bits spread over the whole table.
+  std::uint64_t key = (std::uint64_t)(std::uintptr_t)file ^ ((std::uint64_t)pageNo << 32 | pageNo);
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ULL;
+  key ^= key >> 33;
+  return (std::uint32_t)key & mask;
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+std::uint32_t BufHashTbl::probeDistance(const std::uint32_t index) const
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  return (index - hash(ht[index].file, ht[index].pageNo)) & mask;
 }
 
-BufHashTbl::~BufHashTbl()
+hashBucket* BufHashTbl::allocBuckets(const std::uint32_t size)
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete [] ht;
+  void* buckets = NULL;
+  if (posix_memalign(&buckets, CACHE_LINE_SIZE, size * sizeof(hashBucket)) != 0)
+    throw HashTableException();
+  memset(buckets, 0, size * sizeof(hashBucket));
+  return static_cast<hashBucket*>(buckets);
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+BufHashTbl::BufHashTbl(const int htSize)
+	: numEntries(0)
 {
-  int index = hash(file, pageNo);
+  // Keep the load factor at or below one half
+  HTSIZE = 2;
+  while (HTSIZE < 2 * (std::uint32_t)(htSize > 0 ? htSize : 1))
+    HTSIZE <<= 1;
+  mask = HTSIZE - 1;
+  ht = allocBuckets(HTSIZE);
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+BufHashTbl::~BufHashTbl()
+{
+  free(ht);
+}
+
+void BufHashTbl::grow()
+{
+  hashBucket* old = ht;
+  std::uint32_t oldSize = HTSIZE;
+
+  ht = allocBuckets(oldSize * 2);
+  HTSIZE = oldSize * 2;
+  mask = HTSIZE - 1;
+  for (std::uint32_t i = 0; i < oldSize; i++) {
+    if (old[i].file != NULL)
+      place(old[i]);
   }
+  free(old);
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+bool BufHashTbl::find(const File* file, const PageId pageNo, std::uint32_t &index) const
+{
+  index = hash(file, pageNo);
+  for (std::uint32_t dist = 0; dist < HTSIZE; dist++) {
+    // An empty bucket, or an entry closer to home than we are, means the key is absent:
+    // Robin Hood insertion would have placed it here.
+    if (ht[index].file == NULL || probeDistance(index) < dist)
+      return false;
+    if (ht[index].file == file && ht[index].pageNo == pageNo)
+      return true;
+    index = (index + 1) & mask;
+  }
+  return false;
+}
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  std::uint32_t index;
+  if (find(file, pageNo, index))
+    throw HashAlreadyPresentException(ht[index].file->filename(), ht[index].pageNo, ht[index].frameNo);
+
+  if (numEntries + 1 > HTSIZE / 4 * 3)
+    grow();
+
+  hashBucket entry;
+  entry.file = (File*) file;
+  entry.pageNo = pageNo;
+  entry.frameNo = frameNo;
+  place(entry);
+  numEntries++;
 }
 
-void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+void BufHashTbl::place(hashBucket entry)
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
+  std::uint32_t index = hash(entry.file, entry.pageNo);
+  std::uint32_t dist = 0;
+  while (ht[index].file != NULL) {
+    // Take the bucket from an entry that is closer to its home than we are and carry it on instead
+    std::uint32_t existing = probeDistance(index);
+    if (existing < dist) {
+      hashBucket displaced = ht[index];
+      ht[index] = entry;
+      entry = displaced;
+      dist = existing;
     }
-    tmpBuc = tmpBuc->next;
+    index = (index + 1) & mask;
+    dist++;
   }
+  ht[index] = entry;
+}
+
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const
+{
+  std::uint32_t index;
+  if (!find(file, pageNo, index))
+    return false;
+  frameNo = ht[index].frameNo; // return frameNo by reference
+  return true;
+}
 
-  throw HashNotFoundException(file->filename(), pageNo);
+void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
+{
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
-    }
-  }
+  std::uint32_t index;
+  if (!find(file, pageNo, index))
+    throw HashNotFoundException(file->filename(), pageNo);
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  // Backward-shift deletion: pull each following displaced entry one bucket closer to home
+  std::uint32_t next = (index + 1) & mask;
+  while (ht[next].file != NULL && probeDistance(next) != 0) {
+    ht[index] = ht[next];
+    index = next;
+    next = (next + 1) & mask;
+  }
+  ht[index].file = NULL;
+  numEntries--;
 }
 
 }
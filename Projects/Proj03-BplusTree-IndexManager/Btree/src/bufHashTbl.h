@@ -7,6 +7,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 #include "file.h"
 
 namespace badgerdb {
@@ -16,7 +18,7 @@ namespace badgerdb {
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * pointer a file object (more on this below). NULL if the bucket is empty.
 	 */
 	File *file;
 
@@ -29,30 +31,68 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
+* The table is a single flat, cache-line aligned array of buckets using open addressing with Robin Hood
+* probing: an entry may displace one that sits closer to its home bucket, which keeps probe sequences
+* short and lets an unsuccessful lookup stop early. Removal shifts the following entries back instead of
+* leaving tombstones. The array doubles when it becomes three quarters full, which only happens when a
+* shard of the buffer manager receives more than its share of pages.
+*
 * @warning This class is not threadsafe.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 * Size of a cache line, which is also the alignment of the bucket array
+	 */
+	static const std::size_t CACHE_LINE_SIZE = 64;
+
+	/**
+	 *	Number of buckets in the table, a power of two
+	 */
+  std::uint32_t HTSIZE;
+
+	/**
+	 *	HTSIZE - 1, used to wrap bucket indexes
 	 */
-  int HTSIZE;
+  std::uint32_t mask;
+
+	/**
+	 *	Number of occupied buckets
+	 */
+  std::uint32_t numEntries;
+
 	/**
 	 * Actual Hash table object
 	 */
-  hashBucket**  ht;
+  hashBucket*  ht;
+
+	/**
+	 * Allocates an empty, cache-line aligned array of size buckets
+	 *
+	 * @param size  	Number of buckets
+	 * @return  			The bucket array.
+   * @throws  HashTableException if the array could not be allocated
+	 */
+  static hashBucket* allocBuckets(const std::uint32_t size);
+
+	/**
+	 * Moves every entry into a bucket array twice as large
+	 */
+  void grow();
+
+	/**
+	 * Places an entry known to be absent, without checking for duplicates or growing
+	 *
+	 * @param entry  	Entry to insert
+	 */
+  void place(hashBucket entry);
 
 	/**
 	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
@@ -61,11 +101,32 @@ class BufHashTbl
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  std::uint32_t hash(const File* file, const PageId pageNo) const;
+
+	/**
+	 * Number of buckets between the home bucket of the entry held in bucket index and index itself
+	 *
+	 * @param index  	Index of an occupied bucket
+	 * @return  			Probe distance of the entry.
+	 */
+  std::uint32_t probeDistance(const std::uint32_t index) const;
+
+	/**
+	 * Finds the bucket holding (file, pageNo)
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param index		Index of the bucket returned via this reference
+	 * @return  			True if the entry is present.
+	 */
+  bool find(const File* file, const PageId pageNo, std::uint32_t &index) const;
 
  public:
 	/**
    * Constructor of BufHashTbl class
+   *
+   * @param htSize	Expected number of entries; the table rounds its size up to keep the load factor below one half
+   * @throws  HashTableException if the bucket array could not be allocated
 	 */
 	BufHashTbl(const int htSize);  // constructor
 
@@ -73,7 +134,7 @@ class BufHashTbl
    * Destructor of BufHashTbl class
 	 */
   ~BufHashTbl(); // destructor
-	
+
 	/**
    * Insert entry into hash table mapping (file, pageNo) to frameNo.
 	 *
@@ -81,18 +142,29 @@ class BufHashTbl
 	 * @param pageNo 	Page number in the file
 	 * @param frameNo Frame number assigned to that page of the file
    * @throws  HashAlreadyPresentException	if the corresponding page already exists in the hash table
-   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
+   * @throws  HashTableException if the table had to grow and could not
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
 	/**
    * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table). Unlike lookup(), a miss is reported through the return value.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only set if the page is found
+   * @return				True if the page is in the hash table.
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) const;
+
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
    * the hash table).
 	 *
 	 * @param file  	File object
 	 * @param pageNo	Page number in the file
 	 * @param frameNo Frame number reference
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
@@ -101,9 +173,9 @@ class BufHashTbl
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
-   * @throws HashNotFoundException if the page entry is not found in the hash table 
+   * @throws HashNotFoundException if the page entry is not found in the hash table
 	 */
-  void remove(const File* file, const PageId pageNo);  
+  void remove(const File* file, const PageId pageNo);
 };
 
 }
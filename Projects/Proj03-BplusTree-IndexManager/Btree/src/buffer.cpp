@@ -7,24 +7,105 @@
 
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <vector>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/badgerdb_exception.h"
 
-namespace badgerdb { 
+namespace badgerdb {
+
+const std::uint32_t BufferRing::DEFAULT_SIZE;
+
+BufferRing::BufferRing(const std::uint32_t size)
+	: slots(std::max(size, 1u)), next(0)
+{
+  for (std::size_t i = 0; i < slots.size(); i++)
+    slots[i].used = false;
+}
+
+bool BufferRing::holds(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch);
+  for (std::size_t i = 0; i < slots.size(); i++)
+  {
+    if (slots[i].used && slots[i].frameNo == frameNo && slots[i].file == file && slots[i].pageNo == pageNo)
+      return true;
+  }
+  return false;
+}
+
+PageGuard::PageGuard()
+	: bufMgr(NULL), frameNo(0), pageNo(Page::INVALID_NUMBER), page(NULL), dirty(false)
+{
+}
+
+PageGuard::PageGuard(BufMgr* bufMgr, const FrameId frameNo, const PageId pageNo, Page* page)
+	: bufMgr(bufMgr), frameNo(frameNo), pageNo(pageNo), page(page), dirty(false)
+{
+}
+
+PageGuard::PageGuard(PageGuard&& other)
+	: bufMgr(other.bufMgr), frameNo(other.frameNo), pageNo(other.pageNo), page(other.page), dirty(other.dirty)
+{
+  other.bufMgr = NULL;
+  other.page = NULL;
+}
+
+PageGuard& PageGuard::operator=(PageGuard&& other)
+{
+  if (this != &other)
+  {
+    release();
+    bufMgr = other.bufMgr;
+    frameNo = other.frameNo;
+    pageNo = other.pageNo;
+    page = other.page;
+    dirty = other.dirty;
+    other.bufMgr = NULL;
+    other.page = NULL;
+  }
+  return *this;
+}
+
+PageGuard::~PageGuard()
+{
+  try
+  {
+    release();
+  }
+  catch (PageNotPinnedException&)
+  {
+    // the page was unpinned by page number behind the guard's back; a destructor must not throw
+  }
+}
+
+void PageGuard::release()
+{
+  if (bufMgr == NULL)
+    return;
+  BufMgr* owner = bufMgr;
+  bufMgr = NULL;
+  page = NULL;
+  owner->unPinFrame(frameNo, dirty);
+  dirty = false;
+}
 
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, std::uint32_t shards, ReplacementPolicyType policyType)
+	: numBufs(bufs), bgWriterStop(false), bgDirtyRatio(0), bgPagesPerRound(0), bgIntervalMs(0),
+	  prefetchStop(false) {
 	bufDescTable = new BufDesc[bufs];
 
-  for (FrameId i = 0; i < bufs; i++) 
+  for (FrameId i = 0; i < bufs; i++)
   {
   	bufDescTable[i].frameNo = i;
   	bufDescTable[i].valid = false;
@@ -32,131 +113,406 @@ BufMgr::BufMgr(std::uint32_t bufs)
 
   bufPool = new Page[bufs];
 
+  // a power of two, so that a shard is picked by masking the page's hash
+  numShards = 1;
+  while (numShards < shards)
+    numShards <<= 1;
+
   int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-  hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+  shardTable = new BufShard[numShards];
+  for (std::uint32_t i = 0; i < numShards; i++)
+    shardTable[i].hashTable = new BufHashTbl (htsize / numShards + 1);  // allocate the buffer hash table
 
-  clockHand = bufs - 1;
+  policy = ReplacementPolicy::create(policyType, bufs);
+  bufStats.policy = policy->name();
 }
 
 
 BufMgr::~BufMgr() {
+  stopBackgroundWriter();
+
+  {
+    std::lock_guard<std::mutex> guard(prefetchMutex);
+    prefetchStop = true;
+  }
+  prefetchWake.notify_all();
+  for (std::size_t i = 0; i < prefetchers.size(); i++)
+    prefetchers[i].join();
+
   //Flush out all unwritten pages
-  for (std::uint32_t i = 0; i < numBufs; i++) 
+  for (std::uint32_t i = 0; i < numBufs; i++)
   {
   	BufDesc* tmpbuf = &bufDescTable[i];
   	if (tmpbuf->valid == true && tmpbuf->dirty == true)
 		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+			writeBack(i);
   	}
   }
 
+  for (std::uint32_t i = 0; i < numShards; i++)
+    delete shardTable[i].hashTable;
+  delete [] shardTable;
+  delete policy;
   delete [] bufDescTable;
   delete [] bufPool;
 }
 
-void BufMgr::allocBuf(FrameId & frame) 
+BufShard& BufMgr::shardOf(const File* file, const PageId pageNo)
 {
-  // perform first part of clock algorithm to search for 
-  // open buffer frame
-  // Assumes non-concurrent access to buffer manager
-  std::uint32_t numScanned = 0;
-  bool found = 0;
+  // Fibonacci hashing; the high bits of the product are well mixed even for consecutive pages
+  std::uint64_t key = ((std::uint64_t)(std::uintptr_t)file >> 4) * 0x9e3779b97f4a7c15ULL + pageNo;
+  key *= 0x9e3779b97f4a7c15ULL;
+  return shardTable[(std::uint32_t)(key >> 32) & (numShards - 1)];
+}
 
-  while (numScanned < 2*numBufs)	//Need to scn twice
+void BufMgr::allocBuf(FrameId & frame, const bool cleanOnly)
+{
+  // A frame is claimed by taking its latch exclusively, so two threads never pick the same victim
+  ReplacementPolicy::ClaimFunction claim = [this, cleanOnly](FrameId candidate)
   {
-    // advance the clock
-    advanceClock();
-    numScanned++;
+    // check to see if someone has it pinned or latched
+    return bufDescTable[candidate].pinCnt == 0 && !(cleanOnly && bufDescTable[candidate].dirty)
+      && bufDescTable[candidate].latch.try_lock();
+  };
 
-    // if invalid, use frame
-    if (! bufDescTable[clockHand].valid)
-    {
+  for (std::uint32_t attempts = 0; attempts < 2*numBufs; attempts++)
+  {
+    FrameId candidate;
+    if (!policy->victim(candidate, claim))
       break;
-    }
 
-    // is valid, check referenced bit
-    if (! bufDescTable[clockHand].refbit)
+    // if invalid, use frame; otherwise it is not pinned, use it unless it got pinned while being written back
+    if (!bufDescTable[candidate].valid)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
-      {
-        // hasn't been referenced and is not pinned, use it
-        // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        found = true;
-        break;
-      }
+      frame = candidate;
+      return;
     }
-    else
+    if (evict(candidate, cleanOnly))
     {
-      // has been referenced, clear the bit
-      bufStats.accesses++;
-      bufDescTable[clockHand].refbit = false;
+      policy->evicted(candidate);
+      frame = candidate;
+      return;
     }
+    bufDescTable[candidate].latch.unlock();
+  }
+
+  // buffer pool is full
+  throw BufferExceededException();
+} // end allocBuf
+
+void BufMgr::allocRingBuf(BufferRing* ring, FrameId & frame, std::size_t& ringSlot, const bool cleanOnly)
+{
+  BufferRing::Slot slot;
+  {
+    std::lock_guard<std::mutex> guard(ring->latch);
+    ringSlot = ring->next;
+    ring->next = (ring->next + 1) % ring->slots.size();
+    slot = ring->slots[ringSlot];
+    ring->slots[ringSlot].used = false;
   }
-  
-  // check for full buffer pool
-  if (!found && numScanned >= 2*numBufs)
+
+  // reuse the frame only if nobody but the scan has used its page since the ring read it in
+  if (slot.used)
   {
-    throw BufferExceededException();
+    BufDesc* tmpbuf = &bufDescTable[slot.frameNo];
+    if (tmpbuf->pinCnt == 0 && tmpbuf->ringOnly && tmpbuf->latch.try_lock())
+    {
+      if (tmpbuf->valid && tmpbuf->file == slot.file && tmpbuf->pageNo == slot.pageNo && tmpbuf->ringOnly
+          && evict(slot.frameNo, cleanOnly))
+      {
+        policy->evicted(slot.frameNo);
+        frame = slot.frameNo;
+        return;
+      }
+      tmpbuf->latch.unlock();
+    }
   }
-  
-  // flush any existing changes to disk if necessary
-  if (bufDescTable[clockHand].dirty)
+
+  // the ring is still filling up, or the page left the ring: the slot gets a frame from the pool
+  allocBuf(frame, cleanOnly);
+}
+
+bool BufMgr::evict(const FrameId frameNo, const bool cleanOnly)
+{
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  // a frame whose read failed is released by the last thread to unpin it; its page is no longer in the hash table
+  if (tmpbuf->loadFailed || (cleanOnly && tmpbuf->dirty))
+    return false;
+
+  // flush any existing changes to disk if necessary, while readers can still find the page here
+  if (tmpbuf->dirty.exchange(false))
   {
     bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    bufStats.foregroundWrites++;
+    writeBack(frameNo);
+
+    // the background writer is falling behind
+    bgWriterWake.notify_one();
   }
 
+  BufShard& shard = shardOf(tmpbuf->file, tmpbuf->pageNo);
+  std::lock_guard<std::mutex> guard(shard.latch);
+  if (tmpbuf->pinCnt > 0 || tmpbuf->dirty)
+    return false;
+
+  // remove previous entry from hash table
+  shard.hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
+
 	//Reset all the BufDesc entry for the frame before returning the frame
-  bufDescTable[clockHand].Clear();
+  tmpbuf->Clear();
+  return true;
+}
 
-  // return new frame number
-  frame = clockHand;
-} // end allocBuf
+void BufMgr::waitForLoad(const FrameId frameNo)
+{
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  // the thread reading the page in holds the latch exclusively until it is done
+  if (tmpbuf->loading)
+  {
+    tmpbuf->latch.lock_shared();
+    tmpbuf->latch.unlock_shared();
+  }
+
+  if (tmpbuf->loadFailed)
+  {
+    // the read failed under us: give up our pin and fail the same way
+    std::exception_ptr error = tmpbuf->loadError;
+    if (tmpbuf->pinCnt.fetch_sub(1) == 1)
+      releaseFailedFrame(frameNo);
+    std::rethrow_exception(error);
+  }
+}
+
+void BufMgr::releaseFailedFrame(const FrameId frameNo)
+{
+  // allocBuf() may have claimed the frame in the meantime; evict() turns it down, and we wait for the latch
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  tmpbuf->latch.lock();
+  tmpbuf->Clear();
+  policy->release(frameNo);
+  tmpbuf->latch.unlock();
+}
+
+
+void BufMgr::readPage(File* file, const PageId pageNo, Page*& page, BufferRing* ring)
+{
+  page = &bufPool[pinPage(file, pageNo, ring)];
+}
 
-	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+PageGuard BufMgr::readPage(File* file, const PageId pageNo, BufferRing* ring)
+{
+  FrameId frameNo = pinPage(file, pageNo, ring);
+  return PageGuard(this, frameNo, pageNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::pinPage(File* file, const PageId pageNo, BufferRing* ring)
 {
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  BufShard& shard = shardOf(file, pageNo);
+  bool resident;
+  bufStats.accesses++;
+  {
+    std::lock_guard<std::mutex> guard(shard.latch);
+    resident = shard.hashTable->tryLookup(file, pageNo, frameNo);
+    if (resident)
+      pinFrame(frameNo);
+  }
 
-    // set the referenced bit
-    bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
+  //not in the buffer pool, must allocate a new page
+  if (resident || !loadPage(file, pageNo, true, frameNo, ring))
+  {
+    bufStats.hits++;
+    // a scan coming back to a page of its own ring leaves it to the ring; any other use takes it out
+    if (ring == NULL || !ring->holds(frameNo, file, pageNo))
+    {
+      bufDescTable[frameNo].ringOnly = false;
+      policy->access(frameNo);
+    }
+    waitForLoad(frameNo);
+  }
+  return frameNo;
+}
+
+bool BufMgr::loadPage(File* file, const PageId pageNo, const bool pin, FrameId& frameNo, BufferRing* ring)
+{
+  BufShard& shard = shardOf(file, pageNo);
+
+  // alloc a new frame
+  FrameId newFrame;
+  std::size_t ringSlot = 0;
+  if (ring != NULL)
+    allocRingBuf(ring, newFrame, ringSlot, !pin);
+  else
+    allocBuf(newFrame, !pin);
+  BufDesc* tmpbuf = &bufDescTable[newFrame];
+
+  bool resident;
+  {
+    std::lock_guard<std::mutex> guard(shard.latch);
+    resident = shard.hashTable->tryLookup(file, pageNo, frameNo);
+    if (resident)
+    {
+      if (pin)
+        pinFrame(frameNo);
+    }
+    else
+    {
+      // set up the entry properly and insert in the hash table
+      tmpbuf->Set(file, pageNo);
+      if (!pin)
+        tmpbuf->pinCnt = 0;
+      tmpbuf->loading = true;
+      shard.hashTable->insert(file, pageNo, newFrame);
+      frameNo = newFrame;
+      if (ring != NULL)
+      {
+        // before anyone can find the page, so the scan's own hits on it already count as the ring's; only a use
+        // from outside the scan will keep the ring from reusing the frame
+        tmpbuf->ringOnly = true;
+        std::lock_guard<std::mutex> ringGuard(ring->latch);
+        BufferRing::Slot slot = {newFrame, file, pageNo, true};
+        ring->slots[ringSlot] = slot;
+      }
+    }
+  }
+
+  if (resident)
+  {
+    // another thread read the page in while we were looking for a frame
+    policy->release(newFrame);
+    tmpbuf->latch.unlock();
+    return false;
+  }
+
+  // read the page into the new frame
+  bufStats.diskreads++;
+  try
+  {
+    std::shared_lock<std::shared_timed_mutex> io(ioLatch);
+    // straight into the frame, with no Page built and copied on the way
+    file->readPageInto(pageNo, bufPool[frameNo]);
+  }
+  catch (...)
+  {
+    {
+      std::lock_guard<std::mutex> guard(shard.latch);
+      shard.hashTable->remove(file, pageNo);
+    }
+
+    // Threads that found the page meanwhile hold pins and wait on the latch; they cannot drop them before we let go
+    // of it. If there are any, the frame is left to them marked failed, otherwise it is released right here.
+    if (pin)
+      tmpbuf->pinCnt--;
+    if (tmpbuf->pinCnt == 0)
+    {
+      tmpbuf->Clear();
+      policy->release(frameNo);
+    }
+    else
+    {
+      tmpbuf->loadError = std::current_exception();
+      tmpbuf->loadFailed = true;
+      tmpbuf->loading = false;
+    }
+    tmpbuf->latch.unlock();
+    throw;
   }
-  catch(HashNotFoundException e) //not in the buffer pool, must allocate a new page
+  policy->admit(frameNo, file, pageNo);
+  tmpbuf->loading = false;
+  tmpbuf->latch.unlock();
+  return true;
+}
+
+void BufMgr::prefetch(File* file, const std::vector<PageId>& pageNos, BufferRing* ring)
+{
+  std::lock_guard<std::mutex> guard(prefetchMutex);
+  if (prefetchStop)
+    return;
+  if (prefetchers.empty())
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    for (std::uint32_t i = 0; i < PREFETCH_THREADS; i++)
+      prefetchers.push_back(std::thread(&BufMgr::prefetchLoop, this));
+  }
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+  std::size_t maxQueued = std::max(numBufs / 4, 1u);
+  for (std::size_t i = 0; i < pageNos.size() && prefetchQueue.size() < maxQueued; i++)
+  {
+    FrameId frameNo;
+    BufShard& shard = shardOf(file, pageNos[i]);
+    {
+      std::lock_guard<std::mutex> shardGuard(shard.latch);
+      if (shard.hashTable->tryLookup(file, pageNos[i], frameNo))
+        continue;
+    }
+    PrefetchRequest request = {file, pageNos[i], ring};
+    prefetchQueue.push_back(request);
+    prefetchWake.notify_one();
+  }
+}
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+void BufMgr::prefetchLoop()
+{
+  std::unique_lock<std::mutex> guard(prefetchMutex);
+  while (true)
+  {
+    prefetchWake.wait(guard, [this]{ return prefetchStop || !prefetchQueue.empty(); });
+    if (prefetchStop)
+      return;
+
+    PrefetchRequest request = prefetchQueue.front();
+    prefetchQueue.pop_front();
+    prefetchesInFlight[request.file]++;
+    guard.unlock();
+
+    FrameId frameNo;
+    BufShard& shard = shardOf(request.file, request.pageNo);
+    bool resident;
+    {
+      std::lock_guard<std::mutex> shardGuard(shard.latch);
+      resident = shard.hashTable->tryLookup(request.file, request.pageNo, frameNo);
+    }
+    try
+    {
+      if (!resident && loadPage(request.file, request.pageNo, false, frameNo, request.ring))
+        bufStats.prefetchReads++;
+    }
+    catch (BadgerDbException&)
+    {
+      // a prefetch is only a hint: if every clean frame is in use, the page was deleted since it was asked for or
+      // the read failed, the page is read, or the error raised, when it is needed
+    }
+    catch (...)
+    {
+      // nothing may escape the thread, or the process is terminated
+    }
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+    guard.lock();
+    if (--prefetchesInFlight[request.file] == 0)
+      prefetchesInFlight.erase(request.file);
+    prefetchDone.notify_all();
   }
 }
 
+void BufMgr::drainPrefetches(const File* file)
+{
+  std::unique_lock<std::mutex> guard(prefetchMutex);
+  prefetchQueue.erase(std::remove_if(prefetchQueue.begin(), prefetchQueue.end(),
+                                     [file](const PrefetchRequest& request) { return request.file == file; }),
+                      prefetchQueue.end());
+  prefetchDone.wait(guard, [this, file]{ return prefetchesInFlight.find(file) == prefetchesInFlight.end(); });
+}
+
 
-void BufMgr::unPinPage(File* file, const PageId pageNo, 
-			     const bool dirty) 
+void BufMgr::unPinPage(File* file, const PageId pageNo,
+			     const bool dirty)
 {
   // lookup in hashtable
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  BufShard& shard = shardOf(file, pageNo);
+  std::lock_guard<std::mutex> guard(shard.latch);
+  shard.hashTable->lookup(file, pageNo, frameNo);
 
   if (dirty == true) bufDescTable[frameNo].dirty = dirty;
 
@@ -168,49 +524,268 @@ void BufMgr::unPinPage(File* file, const PageId pageNo,
   else bufDescTable[frameNo].pinCnt--;
 }
 
-void BufMgr::flushFile(const File* file) 
+void BufMgr::unPinFrame(const FrameId frameNo, const bool dirty)
+{
+  BufDesc* tmpbuf = &bufDescTable[frameNo];
+  if (dirty) tmpbuf->dirty = true;
+
+  // the frame cannot be reused while pinned, so it still holds the page; only the count needs care
+  int pinCnt = tmpbuf->pinCnt;
+  do
+  {
+    if (pinCnt == 0)
+      throw PageNotPinnedException(tmpbuf->file->filename(), tmpbuf->pageNo, frameNo);
+  } while (!tmpbuf->pinCnt.compare_exchange_weak(pinCnt, pinCnt - 1));
+}
+
+void BufMgr::flushFile(const File* file)
 {
+  // a prefetch finishing later would leave a page of the file behind
+  drainPrefetches(file);
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
+  	std::unique_lock<std::shared_timed_mutex> frameLatch(tmpbuf->latch);
   	if(tmpbuf->valid == true && tmpbuf->file == file)
 		{
 	    if (tmpbuf->pinCnt > 0)
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
-	    if (tmpbuf->dirty == true)
+	    if (tmpbuf->dirty.exchange(false))
 			{
-				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
+				writeBack(i);
     	}
 
-    	hashTable->remove(file,tmpbuf->pageNo);
+    	BufShard& shard = shardOf(file, tmpbuf->pageNo);
+    	{
+    		std::lock_guard<std::mutex> guard(shard.latch);
+    		shard.hashTable->remove(file,tmpbuf->pageNo);
+    	}
     	tmpbuf->Clear();
+    	policy->release(i);
   	}
 		else if (tmpbuf->valid == false && tmpbuf->file == file)
-  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
+  		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid);
+  }
+
+  file->flushHeader();
+  if (file->durability() == FSYNC_ON_FLUSHFILE)
+    file->sync();
+}
+
+void BufMgr::flushDirtyPages(const File* file)
+{
+  for (std::uint32_t i = 0; i < numBufs; i++)
+	{
+  	BufDesc* tmpbuf = &(bufDescTable[i]);
+  	std::shared_lock<std::shared_timed_mutex> frameLatch(tmpbuf->latch);
+  	if (tmpbuf->valid == true && tmpbuf->file == file && tmpbuf->dirty.exchange(false))
+		{
+			bufStats.diskwrites++;
+			writeBack(i);
+  	}
+  }
+}
+
+void BufMgr::setPageWriteHook(const File* file, PageWriteHook* hook)
+{
+	std::unique_lock<std::shared_timed_mutex> io(ioLatch);
+	if (hook == NULL)
+		writeHooks.erase(file);
+	else
+		writeHooks[file] = hook;
+}
+
+bool BufMgr::writeBack(const FrameId frameNo, const bool background, const Page* image)
+{
+	BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+	std::shared_lock<std::shared_timed_mutex> io(ioLatch);
+
+	// the write-ahead rule: whoever logs changes to this file gets to force the log first
+	if (!writeHooks.empty())
+	{
+		std::map<const File*, PageWriteHook*>::iterator hook = writeHooks.find(tmpbuf->file);
+		if (hook != writeHooks.end())
+		{
+			if (background)
+				return false;
+			std::lock_guard<std::mutex> guard(hookMutex);
+			hook->second->beforePageWrite(tmpbuf->pageNo);
+		}
+	}
+
+	tmpbuf->file->writePage(tmpbuf->pageNo, image != NULL ? *image : bufPool[frameNo]);
+	return true;
+}
+
+void BufMgr::startBackgroundWriter(const double dirtyRatio, const std::uint32_t pagesPerRound,
+                                   const std::uint32_t intervalMs)
+{
+	std::lock_guard<std::mutex> guard(bgWriterMutex);
+	if (bgWriter.joinable())
+		return;
+
+	bgDirtyRatio = dirtyRatio;
+	bgPagesPerRound = pagesPerRound > 0 ? pagesPerRound : 1;
+	bgIntervalMs = intervalMs;
+	bgWriterStop = false;
+	bgWriter = std::thread(&BufMgr::backgroundWriterLoop, this);
+}
+
+void BufMgr::stopBackgroundWriter()
+{
+	{
+		std::lock_guard<std::mutex> guard(bgWriterMutex);
+		if (!bgWriter.joinable())
+			return;
+		bgWriterStop = true;
+	}
+	bgWriterWake.notify_one();
+	bgWriter.join();
+}
+
+void BufMgr::backgroundWriterLoop()
+{
+	std::unique_lock<std::mutex> guard(bgWriterMutex);
+	while (!bgWriterStop)
+	{
+		std::uint32_t budget = bgPagesPerRound;
+		guard.unlock();
+		backgroundWriteRound(budget);
+		guard.lock();
+
+		if (!bgWriterStop)
+			bgWriterWake.wait_for(guard, std::chrono::milliseconds(bgIntervalMs));
+	}
+}
+
+std::uint32_t BufMgr::backgroundWriteRound(const std::uint32_t budget)
+{
+  std::uint32_t numDirty = 0;
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    if (bufDescTable[i].dirty)
+      numDirty++;
+  }
+  std::uint32_t dirtyTarget = (std::uint32_t)(bgDirtyRatio * numBufs);
+
+  // the next budget victims are cleaned regardless of the dirty ratio
+  std::vector<FrameId> frames;
+  policy->upcoming(frames, numDirty > dirtyTarget ? numBufs : budget);
+
+  std::uint32_t written = 0;
+  for (std::uint32_t i = 0; i < frames.size() && written < budget; i++)
+  {
+    if (i >= budget && numDirty <= dirtyTarget)
+      break;
+
+    // a shared latch keeps the frame from being given to another page while it is written
+    BufDesc* tmpbuf = &bufDescTable[frames[i]];
+    if (!tmpbuf->dirty || tmpbuf->pinCnt > 0 || !tmpbuf->latch.try_lock_shared())
+      continue;
+    std::shared_lock<std::shared_timed_mutex> frameLatch(tmpbuf->latch, std::adopt_lock);
+
+    if (!tmpbuf->valid || tmpbuf->pinCnt > 0 || !tmpbuf->dirty.exchange(false))
+      continue;
+
+    // A thread changing the page has it pinned and marks it dirty when it unpins, so a copy taken with the page
+    // unpinned and still clean afterwards is a whole image of it; otherwise the copy may be torn and is dropped.
+    Page image = bufPool[frames[i]];
+    if (tmpbuf->pinCnt > 0 || tmpbuf->dirty)
+    {
+      tmpbuf->dirty = true;
+      continue;
+    }
+
+    bool done;
+    try
+    {
+      done = writeBack(frames[i], true, &image);
+    }
+    catch (...)
+    {
+      // leave the page to foreground eviction, which reports the error
+      done = false;
+    }
+    if (!done)
+    {
+      tmpbuf->dirty = true;
+      continue;
+    }
+    bufStats.diskwrites++;
+    bufStats.backgroundWrites++;
+    written++;
+    numDirty--;
   }
+  return written;
+}
+
+void BufMgr::latchPage(const Page* page, const bool exclusive)
+{
+	BufDesc* tmpbuf = &bufDescTable[page - bufPool];
+	if (exclusive)
+		tmpbuf->latch.lock();
+	else
+		tmpbuf->latch.lock_shared();
 }
 
-void BufMgr::disposePage(File* file, const PageId pageNo) 
+void BufMgr::unlatchPage(const Page* page, const bool exclusive)
+{
+	BufDesc* tmpbuf = &bufDescTable[page - bufPool];
+	if (exclusive)
+		tmpbuf->latch.unlock();
+	else
+		tmpbuf->latch.unlock_shared();
+}
+
+void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	//Deallocate from file altogether
   //See if it is in the buffer pool
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
-
-	// clear the page
-	bufDescTable[frameNo].Clear();
+  BufShard& shard = shardOf(file, pageNo);
+  bool resident;
+  {
+    std::lock_guard<std::mutex> guard(shard.latch);
+    resident = shard.hashTable->tryLookup(file, pageNo, frameNo);
+  }
 
-	hashTable->remove(file, pageNo);
+  if (resident)
+  {
+  	BufDesc* tmpbuf = &bufDescTable[frameNo];
+  	std::unique_lock<std::shared_timed_mutex> frameLatch(tmpbuf->latch);
+  	std::lock_guard<std::mutex> guard(shard.latch);
+
+  	// the frame may have been given to another page while we waited for its latch
+  	if (tmpbuf->valid && tmpbuf->file == file && tmpbuf->pageNo == pageNo)
+  	{
+			// clear the page
+			tmpbuf->Clear();
+
+			shard.hashTable->remove(file, pageNo);
+			policy->release(frameNo);
+  	}
+  }
 
-  // deallocate it in the file	
+  // deallocate it in the file
+  std::unique_lock<std::shared_timed_mutex> io(ioLatch);
   file->deletePage(pageNo);
 }
 
 
-void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
+void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
+{
+  page = &bufPool[allocFrame(file, pageNo)];
+}
+
+PageGuard BufMgr::allocPage(File* file, PageId &pageNo)
+{
+  FrameId frameNo = allocFrame(file, pageNo);
+  return PageGuard(this, frameNo, pageNo, &bufPool[frameNo]);
+}
+
+FrameId BufMgr::allocFrame(File* file, PageId &pageNo)
 {
   FrameId frameNo;
 
@@ -219,24 +794,57 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
-  bufPool[frameNo] = file->allocatePage(pageNo);
-  page = &bufPool[frameNo];
+  try
+  {
+    std::unique_lock<std::shared_timed_mutex> io(ioLatch);
+    file->allocatePageInto(pageNo, bufPool[frameNo]);
+  }
+  catch (...)
+  {
+    policy->release(frameNo);
+    bufDescTable[frameNo].latch.unlock();
+    throw;
+  }
 
   // set up the entry properly
   bufDescTable[frameNo].Set(file, pageNo);
 
   // insert in the hash table
-  hashTable->insert(file, pageNo, frameNo);
+  {
+    BufShard& shard = shardOf(file, pageNo);
+    std::lock_guard<std::mutex> guard(shard.latch);
+    shard.hashTable->insert(file, pageNo, frameNo);
+  }
+  policy->admit(frameNo, file, pageNo);
+  bufDescTable[frameNo].latch.unlock();
+  return frameNo;
+}
+
+Page* BufMgr::borrowFrame(FrameId& frameNo)
+{
+  // a pin on a frame without a page keeps victim searches off it, and everything else skips invalid frames
+  allocBuf(frameNo);
+  bufDescTable[frameNo].pinCnt = 1;
+  bufDescTable[frameNo].latch.unlock();
+  return &bufPool[frameNo];
 }
 
-void BufMgr::printSelf(void) 
+void BufMgr::returnFrame(const FrameId frameNo)
+{
+  std::lock_guard<std::shared_timed_mutex> frameLatch(bufDescTable[frameNo].latch);
+  bufDescTable[frameNo].pinCnt = 0;
+  policy->release(frameNo);
+}
+
+void BufMgr::printSelf(void)
 {
   BufDesc* tmpbuf;
 	int validFrames = 0;
-  
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	tmpbuf = &(bufDescTable[i]);
+  	std::shared_lock<std::shared_timed_mutex> frameLatch(tmpbuf->latch);
 		std::cout << "FrameNo:" << i << " ";
 		tmpbuf->Print();
 
@@ -9,7 +9,17 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "replacement_policy.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
 
 namespace badgerdb {
 
@@ -42,14 +52,14 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
+   * Number of times this page has been pinned. Only raised while holding the lock of the page's hash table shard.
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
 	 */
-  bool dirty;
+  std::atomic<bool> dirty;
 
 	/**
    * True if page is valid
@@ -57,9 +67,32 @@ class BufDesc {
   bool valid;
 
 	/**
-   * Has this buffer frame been reference recently
+   * True while only the BufferRing that read the page in has used it. A pin from outside the ring clears it, and the
+   * ring then leaves the frame to the replacement policy instead of reusing it.
+	 */
+  std::atomic<bool> ringOnly;
+
+	/**
+   * True while the page is being read into the frame. Threads that pin the page meanwhile wait on the latch.
 	 */
-  bool refbit;
+  std::atomic<bool> loading;
+
+	/**
+   * True if reading the page into the frame failed. The page is out of the hash table by then; the threads that pinned
+   * it during the read drop their pins and rethrow loadError, and the last of them releases the frame.
+	 */
+  std::atomic<bool> loadFailed;
+
+	/**
+   * Exception thrown by the failed read of the page
+	 */
+  std::exception_ptr loadError;
+
+	/**
+   * Reader/writer latch of the frame. The buffer manager holds it exclusively while it assigns the frame to another
+   * page (write back, eviction, read in); callers may hold it shared or exclusive around accesses to a pinned page.
+	 */
+  std::shared_timed_mutex latch;
 
 	/**
    * Initialize buffer frame for a new user
@@ -70,8 +103,11 @@ class BufDesc {
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
-    refbit = false;
+    ringOnly = false;
 		valid = false;
+		loading = false;
+    loadFailed = false;
+    loadError = nullptr;
   };
 
 	/**
@@ -88,7 +124,7 @@ class BufDesc {
     pinCnt = 1;
     dirty = false;
     valid = true;
-    refbit = true;
+    ringOnly = false;
   }
 
   void Print()
@@ -102,9 +138,8 @@ class BufDesc {
 			std::cout << "file:NULL ";
 
 		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "pinCnt:" << pinCnt.load() << " ";
+		std::cout << "dirty:" << dirty.load() << "\n";
   }
 
 	/**
@@ -125,30 +160,65 @@ struct BufStats
 	/**
    * Total number of accesses to buffer pool
 	 */
-  int accesses;
+  std::atomic<int> accesses;
+
+	/**
+   * Number of accesses served from the buffer pool without reading the page from disk
+	 */
+  std::atomic<int> hits;
 
 	/**
    * Number of pages read from disk (including allocs)
 	 */
-  int diskreads;
+  std::atomic<int> diskreads;
 
 	/**
    * Number of pages written back to disk
 	 */
-  int diskwrites;
+  std::atomic<int> diskwrites;
+
+	/**
+   * Number of dirty victims written back while allocating a frame, on the path of a readPage() or allocPage()
+	 */
+  std::atomic<int> foregroundWrites;
+
+	/**
+   * Number of pages written back by the background writer
+	 */
+  std::atomic<int> backgroundWrites;
+
+	/**
+   * Number of pages read from disk by prefetch(); also counted in diskreads
+	 */
+  std::atomic<int> prefetchReads;
+
+	/**
+   * Name of the replacement policy of the buffer pool
+	 */
+  const char* policy;
 
 	/**
    * Clear all values 
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = hits = diskreads = diskwrites = 0;
+		foregroundWrites = backgroundWrites = prefetchReads = 0;
+  }
+
+	/**
+   * Fraction of accesses that were hits, 0 if there were none
+	 */
+  double hitRatio() const
+  {
+		return accesses == 0 ? 0 : (double)hits / accesses;
   }
       
 	/**
    * Constructor of BufStats class 
 	 */
   BufStats()
+		: policy("")
   {
 		clear();
   }
@@ -156,25 +226,250 @@ struct BufStats
 
 
 /**
-* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+* @brief A small private set of frames that a sequential scan reads its pages into, passed as a hint to
+* BufMgr::readPage() and BufMgr::prefetch().
+*
+* Once the ring is full, a page the scan misses on goes into the ring's oldest frame instead of a victim taken from
+* the shared pool, so a scan bigger than the pool only ever occupies the ring's frames and leaves the rest of the pool
+* alone. A ring frame is only reused if it still holds the page the ring put there, unpinned and not referenced by
+* anyone else since; otherwise the ring takes a fresh frame from the pool for that slot. A ring belongs to one scan,
+* but the scan's prefetches may use it from the prefetch threads.
 */
-class BufMgr 
+class BufferRing
 {
+	friend class BufMgr;
+
+ public:
+	/**
+   * Number of frames of a ring unless told otherwise; more than BufMgr::DEFAULT_READ_AHEAD, so that pages read ahead
+   * are not reused before the scan reaches them
+	 */
+  static const std::uint32_t DEFAULT_SIZE = 16;
+
+	/**
+	 * Creates an empty ring.
+	 *
+	 * @param size	Number of frames of the ring
+	 */
+  explicit BufferRing(const std::uint32_t size = DEFAULT_SIZE);
+
  private:
 	/**
-   * Current position of clockhand in our buffer pool
+	 * @brief A frame of the ring and the page the ring read into it
+	 */
+  struct Slot
+  {
+    FrameId frameNo;
+    const File* file;
+    PageId pageNo;
+    bool used;
+  };
+
+	/**
+   * Frames of the ring
+	 */
+  std::vector<Slot> slots;
+
+	/**
+   * Slot to reuse next
+	 */
+  std::size_t next;
+
+	/**
+   * Guards slots and next
+	 */
+  std::mutex latch;
+
+	/**
+	 * Returns true if the ring read the page in frameNo and it has not been reused since.
+	 */
+  bool holds(const FrameId frameNo, const File* file, const PageId pageNo);
+};
+
+
+/**
+* @brief Pin on a page of the buffer pool, returned by BufMgr::readPage() and BufMgr::allocPage(), that unpins the
+* page when it goes out of scope, also when an exception passes through. It keeps the frame the page is in, so
+* unpinning needs no lookup in the hash table. A guard can be moved but not copied; a guard that was moved from, or
+* built empty, holds no page.
+*/
+class PageGuard
+{
+	friend class BufMgr;
+
+ public:
+	/**
+	 * Creates a guard that holds no page.
+	 */
+  PageGuard();
+
+  PageGuard(PageGuard&& other);
+
+  PageGuard& operator=(PageGuard&& other);
+
+  PageGuard(const PageGuard&) = delete;
+
+  PageGuard& operator=(const PageGuard&) = delete;
+
+	/**
+	 * Unpins the page, marked dirty if markDirty() was called.
+	 */
+  ~PageGuard();
+
+	/**
+	 * Returns the pinned page, or NULL if the guard holds none.
+	 */
+  Page* get() const { return page; }
+
+  Page* operator->() const { return page; }
+
+	/**
+	 * Returns the pinned page viewed as a T, as for the nodes of an index stored in the page.
 	 */
-  FrameId clockHand;
+  template <class T>
+  T* as() const { return reinterpret_cast<T*>(page); }
 
 	/**
+	 * Returns the number of the pinned page in its file.
+	 */
+  PageId getPageNo() const { return pageNo; }
+
+	/**
+	 * Returns the frame the pinned page is in.
+	 */
+  FrameId getFrameNo() const { return frameNo; }
+
+	/**
+	 * Returns true if the guard holds a page.
+	 */
+  bool isPinned() const { return bufMgr != NULL; }
+
+	/**
+	 * Has the page written back before its frame is reused, once the guard lets go of it.
+	 */
+  void markDirty() { dirty = true; }
+
+	/**
+	 * Unpins the page now rather than when the guard goes out of scope. Does nothing if the guard holds no page.
+	 *
+	 * @throws  PageNotPinnedException If the page was unpinned behind the guard's back
+	 */
+  void release();
+
+ private:
+  PageGuard(BufMgr* bufMgr, const FrameId frameNo, const PageId pageNo, Page* page);
+
+	/**
+   * Buffer manager the page is pinned in, or NULL if the guard holds no page
+	 */
+  BufMgr* bufMgr;
+
+	/**
+   * Frame of the pinned page
+	 */
+  FrameId frameNo;
+
+	/**
+   * Number of the pinned page in its file
+	 */
+  PageId pageNo;
+
+	/**
+   * The pinned page
+	 */
+  Page* page;
+
+	/**
+   * True if the page is to be unpinned dirty
+	 */
+  bool dirty;
+};
+
+
+/**
+* @brief Callback interface invoked by the buffer manager right before a dirty page is written back to its file.
+* A write-ahead log registers one of these for the files it protects so that the log is forced to disk before
+* any page whose changes it describes.
+*/
+class PageWriteHook
+{
+ public:
+	virtual ~PageWriteHook() {}
+
+	/**
+	 * Called before page pageNo of the hooked file is written out by the buffer manager.
+	 *
+	 * @param pageNo	Page number about to be written
+	 */
+	virtual void beforePageWrite(const PageId pageNo) = 0;
+};
+
+
+/**
+* @brief One partition of the buffer pool hash table together with the mutex guarding it
+*/
+struct BufShard
+{
+	/**
+   * Guards hashTable and the raising of pin counts of the pages it maps
+	 */
+  std::mutex latch;
+
+	/**
+   * Hash table mapping (File, page) to frame for the pages of this shard
+	 */
+  BufHashTbl *hashTable;
+};
+
+
+/**
+* @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* The buffer manager may be shared by many threads. The hash table is split into shards, each behind its own mutex, so
+* threads touching different pages rarely contend. Pin counts are atomic and every frame has a reader/writer latch:
+* the replacement policy offers victim frames and a thread claims one by taking its latch exclusively. Lock order is
+* frame latch before shard mutex and policy mutex; a shard mutex is never held while waiting for a latch, calling the
+* policy or doing I/O on a page.
+* Pages are read and written with positioned I/O on the file descriptor, so reads and write backs run in parallel under
+* ioLatch held shared; only allocating and deleting pages, which rewrite the page lists of a file, take it exclusively.
+* A frame being read in is latched exclusively by the reading thread, and threads pinning its page meanwhile wait on
+* the latch; if the read fails, each of them drops its pin and rethrows the error.
+*/
+class BufMgr 
+{
+	friend class PageGuard;
+
+ private:
+	/**
    * Number of frames in the buffer pool
 	 */
   std::uint32_t numBufs;
-	
+
 	/**
-   * Hash table mapping (File, page) to frame
+   * Number of hash table shards, a power of two
 	 */
-  BufHashTbl *hashTable;
+  std::uint32_t numShards;
+
+	/**
+   * Hash table shards mapping (File, page) to frame
+	 */
+  BufShard *shardTable;
+
+	/**
+   * Chooses the frames to reuse
+	 */
+  ReplacementPolicy *policy;
+
+	/**
+   * Held shared while pages are read from or written to File objects, which may happen in parallel, and exclusively
+   * while pages are allocated or deleted, which rewrites the page lists of the file. Also guards writeHooks.
+	 */
+  std::shared_timed_mutex ioLatch;
+
+	/**
+   * Serializes calls of the write hooks
+	 */
+  std::mutex hookMutex;
 
 	/**
    * Array of BufDesc objects to hold information corresponding to every frame allocation from 'bufPool' (the buffer pool)
@@ -187,23 +482,236 @@ class BufMgr
   BufStats bufStats;
 
 	/**
-	 * Allocate a free frame.  
+   * Write hooks registered per file, consulted before a dirty frame is written back
+	 */
+  std::map<const File*, PageWriteHook*> writeHooks;
+
+	/**
+   * Background writer thread, if started
+	 */
+  std::thread bgWriter;
+
+	/**
+   * Guards the background writer settings below and bgWriterWake
+	 */
+  std::mutex bgWriterMutex;
+
+	/**
+   * Wakes the background writer early: to stop it, or because a foreground write was needed
+	 */
+  std::condition_variable bgWriterWake;
+
+	/**
+   * Set to make the background writer exit
+	 */
+  bool bgWriterStop;
+
+	/**
+   * Fraction of frames the background writer lets stay dirty
+	 */
+  double bgDirtyRatio;
+
+	/**
+   * Most pages the background writer writes per round
+	 */
+  std::uint32_t bgPagesPerRound;
+
+	/**
+   * Milliseconds between rounds of the background writer
+	 */
+  std::uint32_t bgIntervalMs;
+
+	/**
+   * Body of the background writer thread
+	 */
+  void backgroundWriterLoop();
+
+	/**
+	 * Writes back dirty, unpinned pages that the replacement policy will offer as victims soon, and more of them if
+	 * too many frames are dirty. Each page is copied under its frame latch and the copy is written, unless the page
+	 * was pinned or dirtied while it was copied, so that a thread changing it never tears the image on disk.
+	 *
+	 * @param budget	Most pages to write
+	 * @return Number of pages written.
+	 */
+  std::uint32_t backgroundWriteRound(const std::uint32_t budget);
+
+	/**
+	 * @brief A page prefetch() was asked to read
+	 */
+  struct PrefetchRequest
+  {
+    File* file;
+    PageId pageNo;
+    BufferRing* ring;
+  };
+
+	/**
+   * Threads reading prefetched pages, started by the first prefetch()
+	 */
+  std::vector<std::thread> prefetchers;
+
+	/**
+   * Guards prefetchQueue, prefetchesInFlight and prefetchStop
+	 */
+  std::mutex prefetchMutex;
+
+	/**
+   * Wakes prefetch threads when there is work or they have to stop
+	 */
+  std::condition_variable prefetchWake;
+
+	/**
+   * Signalled whenever a prefetch thread finishes a page
+	 */
+  std::condition_variable prefetchDone;
+
+	/**
+   * Pages waiting to be prefetched, oldest first
+	 */
+  std::deque<PrefetchRequest> prefetchQueue;
+
+	/**
+   * Number of pages of each file being read by prefetch threads right now
+	 */
+  std::map<const File*, int> prefetchesInFlight;
+
+	/**
+   * Set to make the prefetch threads exit
+	 */
+  bool prefetchStop;
+
+	/**
+   * Body of a prefetch thread
+	 */
+  void prefetchLoop();
+
+	/**
+	 * Drops queued prefetches of a file and waits for those being read, so the file can be flushed or closed.
+	 *
+	 * @param file   	File object
+	 */
+  void drainPrefetches(const File* file);
+
+	/**
+	 * Reads a page that was not found in the hash table into a newly allocated frame. If another thread read the
+	 * page in meanwhile, that frame is used instead.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param pin			True to pin the page for the caller; false for a prefetch, which only reuses clean frames
+	 * @param frameNo Frame holding the page returned via this reference
+	 * @param ring		Ring to take the frame from, or NULL for the shared pool
+	 * @return True if this call read the page, false if another thread already had.
+	 */
+  bool loadPage(File* file, const PageId pageNo, const bool pin, FrameId& frameNo, BufferRing* ring = NULL);
+
+	/**
+	 * Write the page held in a dirty frame back to its file, running the file's write hook first if one is registered.
+	 *
+	 * @param frameNo	Frame whose page is written out
+	 * @param background	True when called by the background writer, which skips pages of files with a hook
+	 * @param image	Copy of the page to write in place of the frame itself, or NULL
+	 * @return False if the page was skipped.
+	 */
+  bool writeBack(const FrameId frameNo, const bool background = false, const Page* image = NULL);
+
+	/**
+	 * Allocate a free frame, asking the replacement policy for a victim. The frame is returned cleared and with its latch held exclusively;
+	 * the caller releases the latch once the frame holds its new page.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
+	 * @param cleanOnly	True to pass over frames holding dirty pages, so that nothing is written
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
-  void allocBuf(FrameId & frame);
+  void allocBuf(FrameId & frame, const bool cleanOnly = false);
 
 	/**
-   * Advance clock to next frame in the buffer pool
+	 * Allocate a frame for a page read through a ring: the ring's oldest frame if it can be reused, otherwise a frame
+	 * from allocBuf(), which then takes that slot of the ring. Returned like allocBuf() does; the caller records the
+	 * page in the slot with ringSlot once the frame holds it.
+	 *
+	 * @param ring		Ring of the scan
+	 * @param frame   	Frame ID of allocated frame returned via this variable
+	 * @param ringSlot	Slot of the ring the frame belongs to returned via this variable
+	 * @param cleanOnly	True to pass over frames holding dirty pages, so that nothing is written
+	 * @throws BufferExceededException If no such buffer is found which can be allocated
+	 */
+  void allocRingBuf(BufferRing* ring, FrameId & frame, std::size_t& ringSlot, const bool cleanOnly);
+
+	/**
+	 * Write back and unmap the page held in a frame whose latch the caller holds exclusively.
+	 *
+	 * @param frameNo	Frame to empty
+	 * @param cleanOnly	True to give up rather than write a dirty page
+	 * @return True if the frame is now free, false if the page got pinned or dirtied meanwhile.
+	 */
+  bool evict(const FrameId frameNo, const bool cleanOnly = false);
+
+	/**
+	 * Returns the hash table shard holding (file, pageNo)
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
 	 */
-  void advanceClock()
+  BufShard& shardOf(const File* file, const PageId pageNo);
+
+	/**
+	 * Body of both readPage() variants: pins the page, reading it in if needed, and returns its frame.
+	 */
+  FrameId pinPage(File* file, const PageId pageNo, BufferRing* ring);
+
+	/**
+	 * Body of both allocPage() variants: allocates the page and returns the frame it is pinned in.
+	 */
+  FrameId allocFrame(File* file, PageId& pageNo);
+
+	/**
+	 * Unpin the page in a frame the caller knows, without looking it up in the hash table.
+	 *
+	 * @param frameNo	Frame of the page
+	 * @param dirty		True if the page needs to be marked dirty
+	 * @throws  PageNotPinnedException If the page is not pinned
+	 */
+  void unPinFrame(const FrameId frameNo, const bool dirty);
+
+	/**
+	 * Pin a resident frame. The caller holds the lock of the page's shard.
+	 *
+	 * @param frameNo	Frame to pin
+	 */
+  void pinFrame(const FrameId frameNo)
   {
-		clockHand = (clockHand + 1) % numBufs;
+		bufDescTable[frameNo].pinCnt++;
   }
 
+	/**
+	 * Wait until a just pinned frame has finished reading its page in. If the read failed, the pin is dropped and
+	 * the exception of the read is rethrown.
+	 *
+	 * @param frameNo	Pinned frame
+	 */
+  void waitForLoad(const FrameId frameNo);
+
+	/**
+	 * Release a frame whose read failed, once the last pin on it is gone.
+	 *
+	 * @param frameNo	Frame number of the failed frame
+	 */
+  void releaseFailedFrame(const FrameId frameNo);
+
 
  public:
+	/**
+   * Pages a sequential scan asks prefetch() for ahead of its position unless told otherwise
+	 */
+  static const std::uint32_t DEFAULT_READ_AHEAD = 8;
+
+	/**
+   * Number of threads reading prefetched pages
+	 */
+  static const std::uint32_t PREFETCH_THREADS = 2;
+
 	/**
    * Actual buffer pool from which frames are allocated
 	 */
@@ -211,8 +719,12 @@ class BufMgr
 
 	/**
    * Constructor of BufMgr class
+   *
+   * @param bufs    Number of frames in the buffer pool
+   * @param shards  Number of hash table shards, rounded up to a power of two. Use more shards when many threads share the pool.
+   * @param policyType  Page replacement policy
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, std::uint32_t shards = 1, ReplacementPolicyType policyType = CLOCK);
 	
 	/**
    * Destructor of BufMgr class
@@ -227,8 +739,33 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @param ring		Ring of a sequential scan to read the page into if it is not in the pool, or NULL to take a
+	 *					frame from the whole pool. The scan's own hits on pages of its ring do not count as references.
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void readPage(File* file, const PageId PageNo, Page*& page, BufferRing* ring = NULL);
+
+	/**
+	 * Reads the given page from the file into a frame, like readPage() above, and returns a guard that unpins it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number inside the file to be read
+	 * @param ring		Ring of a sequential scan to read the page into, or NULL
+	 * @return Guard holding the page pinned
+	 */
+  PageGuard readPage(File* file, const PageId PageNo, BufferRing* ring = NULL);
+
+	/**
+	 * Asks for pages to be read into the buffer pool in the background, so that later readPage() calls find them there.
+	 * The pages are not pinned. Pages already in the pool are skipped, and requests are dropped when a quarter of the
+	 * pool is already queued, when no clean frame is free, or when a page does not exist: prefetching is only a hint.
+	 * flushFile() waits for the prefetches of its file.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Page numbers in the file, in the order they will be needed
+	 * @param ring		Ring of the sequential scan the pages are for, or NULL; it must outlive the prefetches, which
+	 *					flushFile() ensures when the scan flushes its file before destroying the ring
+	 */
+  void prefetch(File* file, const std::vector<PageId>& pageNos, BufferRing* ring = NULL);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
@@ -250,17 +787,101 @@ class BufMgr
 	 */
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
+	/**
+	 * Allocates a new, empty page in the file, like allocPage() above, and returns a guard that unpins it.
+	 *
+	 * @param file   	File object
+	 * @param PageNo  Page number. The number assigned to the page in the file is returned via this reference.
+	 * @return Guard holding the new page pinned
+	 */
+  PageGuard allocPage(File* file, PageId &PageNo);
+
+	/**
+	 * Takes a frame out of the buffer pool for use as scratch memory, freeing it the way a read of a new page would.
+	 * The frame holds no page and stays out of the pool, pinned, until it is handed back with returnFrame().
+	 *
+	 * @param frameNo	Frame number of the borrowed frame, returned via this reference
+	 * @return The memory of the frame
+	 * @throws  BufferExceededException If all buffer frames are pinned
+	 */
+  Page* borrowFrame(FrameId& frameNo);
+
+	/**
+	 * Puts a frame taken by borrowFrame() back into the buffer pool.
+	 *
+	 * @param frameNo	Frame number of the borrowed frame
+	 */
+  void returnFrame(const FrameId frameNo);
+
 	/**
 	 * Writes out all dirty pages of the file to disk.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
+	 * The file header, which File keeps in memory, is written back as well.
+	 * If the durability of the file is FSYNC_ON_FLUSHFILE, the file is synced with fdatasync at the end.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
    * @throws BadBufferException If any frame allocated to the file is found to be invalid
+   * @throws FileIOException If the file cannot be synced
 	 */
   void flushFile(const File* file);
 
+	/**
+	 * Writes out all dirty pages of the file to disk without evicting them from the buffer pool.
+	 * Unlike flushFile(), pinned pages are allowed and stay pinned; they are written as they are right now.
+	 * Used for checkpoints, where the pages are expected to be needed again shortly.
+	 *
+	 * @param file   	File object
+	 */
+  void flushDirtyPages(const File* file);
+
+	/**
+	 * Registers a hook to be run before any dirty page of the file is written back to disk.
+	 * Passing NULL removes a previously registered hook.
+	 *
+	 * @param file   	File object
+	 * @param hook  	Hook to run, or NULL
+	 */
+  void setPageWriteHook(const File* file, PageWriteHook* hook);
+
+	/**
+	 * Starts a thread that writes dirty, unpinned pages back ahead of the replacement policy, so that allocating a
+	 * frame rarely has to wait for a write. Each round it cleans the next pagesPerRound victims, and keeps writing
+	 * pages further down the policy's order while more than dirtyRatio of the frames are dirty; it never writes more than
+	 * pagesPerRound pages per round, which limits it to pagesPerRound * 1000 / intervalMs writes per second.
+	 * Pages of files with a PageWriteHook are left alone, since hooks expect to run on the thread using the file.
+	 * Does nothing if the writer is already running.
+	 *
+	 * @param dirtyRatio		Fraction of frames allowed to stay dirty
+	 * @param pagesPerRound	Most pages written per round
+	 * @param intervalMs		Milliseconds between rounds
+	 */
+  void startBackgroundWriter(const double dirtyRatio = 0.1, const std::uint32_t pagesPerRound = 16,
+                             const std::uint32_t intervalMs = 10);
+
+	/**
+	 * Stops the background writer and waits for it to exit. Does nothing if it is not running.
+	 */
+  void stopBackgroundWriter();
+
+	/**
+	 * Latch the contents of a pinned page against other threads. Shared latches may be held by many readers at once,
+	 * an exclusive one by a single writer. Release it with unlatchPage() before unpinning the page.
+	 *
+	 * @param page  	Page returned by readPage() or allocPage() and still pinned
+	 * @param exclusive	True to latch for writing, false for reading
+	 */
+  void latchPage(const Page* page, const bool exclusive);
+
+	/**
+	 * Release a latch taken by latchPage().
+	 *
+	 * @param page  	Latched page
+	 * @param exclusive	Must match the value passed to latchPage()
+	 */
+  void unlatchPage(const Page* page, const bool exclusive);
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
@@ -275,6 +896,14 @@ class BufMgr
 	 */
   void  printSelf();
 
+	/**
+   * Number of frames in the buffer pool
+	 */
+  std::uint32_t getNumBufs() const
+  {
+		return numBufs;
+  }
+
 	/**
    * Get buffer pool usage statistics
 	 */
@@ -12,8 +12,8 @@
 
 namespace badgerdb {
 
-BadBufferException::BadBufferException(FrameId frameNoIn, bool dirtyIn, bool validIn, bool refbitIn)
-    : BadgerDbException(""), frameNo(frameNoIn), dirty(dirtyIn), valid(validIn), refbit(refbitIn) {
+BadBufferException::BadBufferException(FrameId frameNoIn, bool dirtyIn, bool validIn)
+    : BadgerDbException(""), frameNo(frameNoIn), dirty(dirtyIn), valid(validIn) {
   std::stringstream ss;
   ss << "This buffer is bad: " << frameNo;
   message_.assign(ss.str());
@@ -0,0 +1,22 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "index_log_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+IndexLogException::IndexLogException(const std::string& name, const std::string& op)
+    : BadgerDbException(""), filename_(name) {
+  std::stringstream ss;
+  ss << "Index log " << op << " failed: " << filename_;
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,44 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a page is accessed in a way its
+ *        layout does not support, such as viewing a record in place on a
+ *        PAX page or reading a column of a row page.
+ */
+class PageLayoutException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a page layout exception for the given page.
+   *
+   * @param page_num    Number of the page.
+   * @param access      Description of the unsupported access.
+   */
+  PageLayoutException(const PageId page_num, const std::string& access);
+
+  /**
+   * Returns the page number of the page that caused this exception.
+   */
+  PageId page_number() const { return page_number_; }
+
+ protected:
+  /**
+   * Page number of the page that caused this exception.
+   */
+  const PageId page_number_;
+};
+
+}
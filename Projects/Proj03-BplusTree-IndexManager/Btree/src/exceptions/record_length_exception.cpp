@@ -0,0 +1,29 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "record_length_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+RecordLengthException::RecordLengthException(
+    const PageId page_num, const std::size_t length,
+    const std::size_t expected)
+    : BadgerDbException(""),
+      page_number_(page_num),
+      length_(length),
+      expected_length_(expected) {
+  std::stringstream ss;
+  ss << "Record of " << length_ << " bytes does not fit fixed-length page "
+     << page_number_ << ", which holds records of " << expected_length_
+     << " bytes.";
+  message_.assign(ss.str());
+}
+
+}
@@ -0,0 +1,66 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a record whose length differs from
+ *        the record length of a fixed-length page is written to it.
+ */
+class RecordLengthException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a record length exception for the given page.
+   *
+   * @param page_num    Number of the fixed-length page.
+   * @param length      Length of the record in bytes.
+   * @param expected    Record length of the page in bytes.
+   */
+  RecordLengthException(const PageId page_num,
+                        const std::size_t length,
+                        const std::size_t expected);
+
+  /**
+   * Returns the page number of the page that caused this exception.
+   */
+  PageId page_number() const { return page_number_; }
+
+  /**
+   * Returns the length of the record in bytes.
+   */
+  std::size_t length() const { return length_; }
+
+  /**
+   * Returns the record length of the page in bytes.
+   */
+  std::size_t expected_length() const { return expected_length_; }
+
+ protected:
+  /**
+   * Page number of the page that caused this exception.
+   */
+  const PageId page_number_;
+
+  /**
+   * Length of the record.
+   */
+  const std::size_t length_;
+
+  /**
+   * Record length of the page.
+   */
+  const std::size_t expected_length_;
+};
+
+}
@@ -7,15 +7,19 @@
 
 #include "file.h"
 
-#include <fstream>
 #include <iostream>
-#include <memory>
 #include <string>
+#include <cerrno>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "file_iterator.h"
@@ -23,8 +27,12 @@
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+File::DescriptorMap File::open_fds_;
 File::CountMap File::open_counts_;
+File::DurabilityMap File::open_durabilities_;
+File::HeaderMap File::open_headers_;
+const std::uint32_t File::MAPPED_FORMAT_MAGIC;
+const PageId File::PAGES_PER_MAP;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -44,14 +52,7 @@ bool File::isOpen(const std::string& filename) {
 }
 
 bool File::exists(const std::string& filename) {
-	std::fstream file(filename);
-	if(file)
-	{
-		file.close();
-		return true;
-	}
-
-	return false;
+	return ::access(filename.c_str(), R_OK | W_OK) == 0;
 }
 
 File::~File() {
@@ -64,24 +65,60 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+PageId File::getNumUsedPages() {
+  const FileHeader& header = readHeader();
+  // page 0 is the file header
+  return header.num_pages - 1 - header.num_free_pages;
+}
+
+File::File(const std::string& name, const bool create_new)
+: filename_(name), fd_(-1), cached_header_(NULL) {
   openIfNeeded(create_new);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */, 0 /* record_length */};
     writeHeader(header);
+    flushHeader();
   }
 }
 
+void File::loadHeader() {
+  std::uint32_t magic;
+  readAt(&magic, sizeof(magic), 0 /* pos */);
+  cached_header_->mapped = magic == MAPPED_FORMAT_MAGIC;
+  cached_header_->dirty = false;
+
+  FileHeader& header = cached_header_->header;
+  if (cached_header_->mapped) {
+    readAt(&header, sizeof(FileHeader), sizeof(MAPPED_FORMAT_MAGIC) /* pos */);
+  } else {
+    // The original header has no tail pointer.
+    readAt(&header, offsetof(FileHeader, last_used_page), 0 /* pos */);
+    header.last_used_page = Page::INVALID_NUMBER;
+    header.record_length = 0;
+    header.num_columns = 0;
+  }
+}
+
+off_t File::pagePosition(const PageId page_number) const {
+  if (!cached_header_->mapped) {
+    return offsetof(FileHeader, last_used_page) +
+        ((off_t)(page_number - 1) * Page::SIZE);
+  }
+  // One block for the header, then one map block ahead of every group.
+  const PageId index = page_number - 1;
+  return (off_t)(2 + index + index / PAGES_PER_MAP) * Page::SIZE;
+}
+
 void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    fd_ = open_fds_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
@@ -89,43 +126,150 @@ void File::openIfNeeded(const bool create_new) {
         throw FileExistsException(filename_);
       }
       // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags = flags | O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    fd_ = ::open(filename_.c_str(), flags, 0644);
+    if (fd_ < 0) {
+      throw FileIOException(filename_, "open", errno);
+    }
+    open_fds_[filename_] = fd_;
     open_counts_[filename_] = 1;
+    open_durabilities_[filename_] = FLUSH;
+    cached_header_ = &open_headers_[filename_];
+    cached_header_->mapped = false;
+    cached_header_->dirty = false;
+    if (!create_new) {
+      loadHeader();
+    }
+    return;
   }
+  cached_header_ = &open_headers_[filename_];
 }
 
 void File::close() {
 	if(open_counts_[filename_] > 0)
   	--open_counts_[filename_];
 
-  stream_.reset();
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    // The last File object on the file writes the cached header back.
+    if (cached_header_ != NULL) {
+      flushHeader();
+    }
+    open_headers_.erase(filename_);
+    DescriptorMap::iterator it = open_fds_.find(filename_);
+    if (it != open_fds_.end()) {
+      ::close(it->second);
+      open_fds_.erase(it);
+    }
     open_counts_.erase(filename_);
+    open_durabilities_.erase(filename_);
   }
+  fd_ = -1;
+  cached_header_ = NULL;
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  std::lock_guard<std::mutex> guard(cached_header_->mutex);
+  return cached_header_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  std::lock_guard<std::mutex> guard(cached_header_->mutex);
+  cached_header_->header = header;
+  cached_header_->dirty = true;
+}
+
+void File::flushHeader() const {
+  // Held across the write, so that an older header never lands on top of a
+  // newer one.
+  std::lock_guard<std::mutex> guard(cached_header_->mutex);
+  if (!cached_header_->dirty) {
+    return;
+  }
+  const FileHeader& header = cached_header_->header;
+  if (cached_header_->mapped) {
+    char block[sizeof(MAPPED_FORMAT_MAGIC) + sizeof(FileHeader)];
+    std::memcpy(block, &MAPPED_FORMAT_MAGIC, sizeof(MAPPED_FORMAT_MAGIC));
+    std::memcpy(block + sizeof(MAPPED_FORMAT_MAGIC), &header, sizeof(FileHeader));
+    writeAt(block, sizeof(block), 0 /* pos */);
+  } else {
+    writeAt(&header, offsetof(FileHeader, last_used_page), 0 /* pos */);
+  }
+  cached_header_->dirty = false;
+}
+
+void File::setDurability(const Durability durability) {
+  const Durability previous = open_durabilities_[filename_];
+  if ((previous == DSYNC) != (durability == DSYNC)) {
+    // O_DSYNC cannot be changed with fcntl; open the file again and move the
+    // new description onto the descriptor every File object already holds.
+    int flags = O_RDWR | (durability == DSYNC ? O_DSYNC : 0);
+    int fd = ::open(filename_.c_str(), flags);
+    if (fd < 0) {
+      throw FileIOException(filename_, "reopen", errno);
+    }
+    if (::dup2(fd, fd_) < 0) {
+      int error = errno;
+      ::close(fd);
+      throw FileIOException(filename_, "reopen", error);
+    }
+    ::close(fd);
+  }
+  open_durabilities_[filename_] = durability;
+}
+
+Durability File::durability() const {
+  DurabilityMap::const_iterator it = open_durabilities_.find(filename_);
+  return it == open_durabilities_.end() ? FLUSH : it->second;
+}
+
+void File::sync() const {
+  flushHeader();
+  if (::fdatasync(fd_) != 0) {
+    throw FileIOException(filename_, "sync", errno);
+  }
+}
+
+void File::readAt(void* buffer, const std::size_t count, const off_t pos) const {
+  char* bytes = static_cast<char*>(buffer);
+  std::size_t done = 0;
+  while (done < count) {
+    ssize_t n = ::pread(fd_, bytes + done, count - done, pos + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, "read", errno);
+    }
+    if (n == 0) {
+      // Past the end of the file.
+      std::memset(bytes + done, 0, count - done);
+      return;
+    }
+    done += n;
+  }
+}
+
+void File::writeAt(const void* buffer, const std::size_t count, const off_t pos) const {
+  const char* bytes = static_cast<const char*>(buffer);
+  std::size_t done = 0;
+  while (done < count) {
+    ssize_t n = ::pwrite(fd_, bytes + done, count - done, pos + done);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, "write", errno);
+    }
+    done += n;
+  }
 }
 
 
@@ -136,18 +280,64 @@ PageFile PageFile::create(const std::string& filename) {
   return PageFile(filename, true /* create_new */);
 }
 
+PageFile PageFile::create(const std::string& filename,
+                          const std::uint16_t record_length) {
+  return PageFile(filename, true /* create_new */, record_length);
+}
+
+PageFile PageFile::create(const std::string& filename,
+                          const std::vector<std::uint16_t>& column_widths) {
+  assert(!column_widths.empty() && column_widths.size() <= Page::MAX_COLUMNS);
+  PageFile file(filename, true /* create_new */);
+  FileHeader header = file.readHeader();
+  header.record_length = 0;
+  header.num_columns = column_widths.size();
+  for (std::size_t i = 0; i < column_widths.size(); ++i) {
+    header.column_widths[i] = column_widths[i];
+    header.record_length += column_widths[i];
+  }
+  file.writeHeader(header);
+  file.flushHeader();
+  return file;
+}
+
 PageFile PageFile::open(const std::string& filename) {
   return PageFile(filename, false /* create_new */);
 }
 
-PageFile::PageFile(const std::string& name, const bool create_new)
+PageFile::PageFile(const std::string& name, const bool create_new,
+                   const std::uint16_t record_length)
 : File(name, create_new)
 {
+  if (create_new) {
+    // New page files get the mapped format; the header takes the whole first
+    // block and the allocation maps start out as holes, which read as zeros.
+    cached_header_->mapped = true;
+    FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */, record_length};
+    writeHeader(header);
+    flushHeader();
+  }
 }
 
 PageFile::~PageFile() {
 }
 
+std::vector<std::uint16_t> PageFile::column_widths() const {
+  const FileHeader header = readHeader();
+  return std::vector<std::uint16_t>(header.column_widths,
+                                    header.column_widths + header.num_columns);
+}
+
+void PageFile::formatPage(const FileHeader& header, Page& page) {
+  if (header.num_columns != 0) {
+    page.initializeColumns(header.num_columns, header.column_widths);
+  } else {
+    page.initialize(header.record_length);
+  }
+}
+
 PageFile::PageFile(const PageFile& other)
 : File(other.filename_, false /* create_new */)
 {
@@ -163,98 +353,58 @@ PageFile& PageFile::operator=(const PageFile& rhs) {
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePageInto(new_page_number, new_page);
+  return new_page;
+}
+
+void PageFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  FileHeader header = readHeader();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+    // Reuse the head of the free list; deletePage() left it initialized.
+    readPageInto(header.first_free_page, new_page, true /* allow_free */);
     new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   }
 	else
 	{
+    formatPage(header, new_page);
     new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
-
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
     ++header.num_pages;
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
-  }
-  writeHeader(header);
+	new_page_number = new_page.page_number();
 
-  return new_page;
+  linkUsedPage(header, new_page);
+  writeAt(&new_page, Page::SIZE, pagePosition(new_page_number));
+  writeHeader(header);
 }
 
 Page PageFile::readPage(const PageId page_number) const {
+  Page page;
+  readPageInto(page_number, page);
+  return page;
+}
+
+void PageFile::readPageInto(const PageId page_number, Page& page) const {
   FileHeader header = readHeader();
 
 	if (page_number >= header.num_pages)
 	{
 		throw InvalidPageException(page_number, filename_);
 	}
-	return readPage(page_number, false /* allow_free */);
+	readPageInto(page_number, page, false /* allow_free */);
 }
 
-Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
-  Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(reinterpret_cast<char*>(&page.data_[0]), Page::DATA_SIZE);
+void PageFile::readPageInto(const PageId page_number, Page& page,
+                            const bool allow_free) const {
+  readAt(&page, Page::SIZE, pagePosition(page_number));
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
@@ -277,33 +427,49 @@ void PageFile::deletePage(const PageId page_number) {
   FileHeader header = readHeader();
 
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
-  } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
-  }
+  unlinkUsedPage(header, page_number, existing_page.next_page_number());
+
   // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
+  formatPage(header, existing_page);
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
   writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
 }
 
+std::size_t PageFile::listUsedPages(PageId& page_number,
+                                   PageId* page_numbers,
+                                   const std::size_t max_pages) const {
+  assert(cached_header_->mapped);
+  const FileHeader header = readHeader();
+  std::uint8_t map[Page::SIZE];
+  std::int64_t map_group = -1;
+  std::size_t count = 0;
+  while (page_number != Page::INVALID_NUMBER && count < max_pages) {
+    if (page_number >= header.num_pages) {
+      page_number = Page::INVALID_NUMBER;
+      break;
+    }
+    const PageId index = page_number - 1;
+    if (map_group != (std::int64_t)(index / PAGES_PER_MAP)) {
+      map_group = index / PAGES_PER_MAP;
+      readAt(map, Page::SIZE, mapPosition(map_group));
+    }
+    const std::uint8_t bits = map[(index % PAGES_PER_MAP) / 8];
+    if (bits == 0 && index % 8 == 0) {
+      // Eight unused pages in a row.
+      page_number += 8;
+      continue;
+    }
+    if (bits & (1u << (index % 8))) {
+      page_numbers[count++] = page_number;
+    }
+    ++page_number;
+  }
+  return count;
+}
+
 FileIterator PageFile::begin() {
   const FileHeader& header = readHeader();
   return FileIterator(this, header.first_used_page);
@@ -315,20 +481,123 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(reinterpret_cast<const char*>(&new_page.data_[0]),
-                 Page::DATA_SIZE);
-  stream_->flush();
+  // Header and data are contiguous on disk; write them with one call.  The
+  // block is assembled in raw memory, since a Page would be cleared first.
+  char block[Page::SIZE];
+  std::memcpy(block, &header, sizeof(PageHeader));
+  std::memcpy(block + sizeof(PageHeader), new_page.data_, Page::DATA_SIZE);
+  writeAt(block, Page::SIZE, pagePosition(page_number));
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readAt(&header, sizeof(PageHeader), pagePosition(page_number));
   return header;
 }
 
+void PageFile::writePageHeader(const PageId page_number,
+                               const PageHeader& header) {
+  writeAt(&header, sizeof(PageHeader), pagePosition(page_number));
+}
+
+PageId PageFile::usedPageBefore(const FileHeader& header,
+                                const PageId page_number) const {
+  if (header.first_used_page == Page::INVALID_NUMBER ||
+      header.first_used_page >= page_number) {
+    return Page::INVALID_NUMBER;
+  }
+
+  if (!cached_header_->mapped) {
+    // Walk the used list up to the last page before the given one.
+    PageId previous = header.first_used_page;
+    PageId next = readPageHeader(previous).next_page_number;
+    while (next != Page::INVALID_NUMBER && next < page_number) {
+      previous = next;
+      next = readPageHeader(previous).next_page_number;
+    }
+    return previous;
+  }
+
+  // Appends and deletes at the tail never need to look at the maps.
+  if (header.last_used_page < page_number) {
+    return header.last_used_page;
+  }
+
+  // Scan the allocation maps backwards from the bit just below the page.
+  // first_used_page is set below page_number, so this finds a page.
+  PageId index = page_number - 2;
+  std::uint8_t map[Page::SIZE];
+  while (true) {
+    const PageId group = index / PAGES_PER_MAP;
+    readAt(map, Page::SIZE, mapPosition(group));
+    PageId bit = index % PAGES_PER_MAP;
+    std::int64_t byte = bit / 8;
+    // Drop the bits of pages at or after page_number in the first byte.
+    std::uint8_t bits = map[byte] & (std::uint8_t)((2u << (bit % 8)) - 1);
+    while (true) {
+      if (bits != 0) {
+        const int highest = 31 - __builtin_clz(bits);
+        return group * PAGES_PER_MAP + byte * 8 + highest + 1;
+      }
+      if (--byte < 0) {
+        break;
+      }
+      bits = map[byte];
+    }
+    assert(group > 0);
+    index = group * PAGES_PER_MAP - 1;
+  }
+}
+
+void PageFile::linkUsedPage(FileHeader& header, Page& page) {
+  const PageId page_number = page.page_number();
+  const PageId previous = usedPageBefore(header, page_number);
+  if (previous == Page::INVALID_NUMBER) {
+    page.set_next_page_number(header.first_used_page);
+    header.first_used_page = page_number;
+  } else {
+    PageHeader previous_header = readPageHeader(previous);
+    page.set_next_page_number(previous_header.next_page_number);
+    previous_header.next_page_number = page_number;
+    writePageHeader(previous, previous_header);
+  }
+  if (page.next_page_number() == Page::INVALID_NUMBER) {
+    header.last_used_page = page_number;
+  }
+  if (cached_header_->mapped) {
+    markUsed(page_number, true);
+  }
+}
+
+void PageFile::unlinkUsedPage(FileHeader& header, const PageId page_number,
+                              const PageId next_page_number) {
+  const PageId previous = usedPageBefore(header, page_number);
+  if (previous == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
+  } else {
+    PageHeader previous_header = readPageHeader(previous);
+    previous_header.next_page_number = next_page_number;
+    writePageHeader(previous, previous_header);
+  }
+  if (cached_header_->mapped) {
+    if (header.last_used_page == page_number) {
+      header.last_used_page = previous;
+    }
+    markUsed(page_number, false);
+  }
+}
+
+void PageFile::markUsed(const PageId page_number, const bool used) {
+  const PageId index = page_number - 1;
+  const off_t pos = mapPosition(index / PAGES_PER_MAP) +
+      (index % PAGES_PER_MAP) / 8;
+  const std::uint8_t mask = (std::uint8_t)(1u << (index % 8));
+  std::uint8_t byte;
+  readAt(&byte, 1, pos);
+  byte = used ? (byte | mask) : (byte & ~mask);
+  writeAt(&byte, 1, pos);
+}
+
 
 
 
@@ -362,8 +631,13 @@ BlobFile& BlobFile::operator=(const BlobFile& rhs) {
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
-  FileHeader header = readHeader();
 	Page new_page;
+	allocatePageInto(new_page_number, new_page);
+	return new_page;
+}
+
+void BlobFile::allocatePageInto(PageId &new_page_number, Page& new_page) {
+  FileHeader header = readHeader();
 
 	new_page_number = header.num_pages;
 
@@ -373,23 +647,45 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 	++header.num_pages;
 
+	new_page.initialize();
 	writePage(new_page_number, new_page);
 	writeHeader(header);
+}
 
-	return new_page;
+PageId BlobFile::allocatePages(const PageId count) {
+  FileHeader header = readHeader();
+	const PageId first_page_number = header.num_pages;
+
+	if (header.first_used_page == Page::INVALID_NUMBER) {
+		header.first_used_page = first_page_number;
+	}
+
+	header.num_pages += count;
+	writeHeader(header);
+
+	return first_page_number;
+}
+
+PageId BlobFile::first_page_number() const {
+	return readHeader().first_used_page;
 }
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readPageInto(page_number, page);
 	return page;
 }
 
+void BlobFile::readPageInto(const PageId page_number, Page& page) const {
+	// Page 0 is the file header; pages past the end have never been allocated.
+	if (page_number == Page::INVALID_NUMBER || page_number >= readHeader().num_pages) {
+		throw InvalidPageException(page_number, filename_);
+	}
+	readAt(&page, Page::SIZE, pagePosition(page_number));
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeAt(&new_page, Page::SIZE, pagePosition(new_page_number));
 }
 
 //delePage should not be called for a blob_file, not supported
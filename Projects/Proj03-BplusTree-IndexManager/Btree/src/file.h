@@ -7,10 +7,14 @@
 
 #pragma once
 
-#include <fstream>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <map>
-#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
 
 #include "page.h"
 
@@ -18,6 +22,18 @@ namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief How hard writes to a file try to reach stable storage.
+ */
+enum Durability
+{
+	NONE,								/* Writes go to the OS, which writes them back when it sees fit */
+	FLUSH,							/* Every write is handed to the OS right away; the default. Since File writes with
+											   pwrite and keeps no buffer of its own this is the same as NONE */
+	FSYNC_ON_FLUSHFILE,	/* As FLUSH, and BufMgr::flushFile() ends with one fdatasync of the file */
+	DSYNC								/* The file is opened with O_DSYNC: every write returns once it is on stable storage */
+};
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -42,6 +58,31 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file.  Only kept by files in
+   * the mapped format; always Page::INVALID_NUMBER for files in the original
+   * format, whose header ends with first_free_page.
+   */
+  PageId last_used_page;
+
+  /**
+   * Length of every record for a page file of fixed-length pages, or 0 if its
+   * pages are slotted.  Only kept by files in the mapped format.
+   */
+  std::uint32_t record_length;
+
+  /**
+   * Number of columns of a page file of PAX pages, or 0 if its records are
+   * stored by row.  Only kept by files in the mapped format.
+   */
+  std::uint16_t num_columns;
+
+  /**
+   * Width of each column of a page file of PAX pages; record_length is their
+   * sum.
+   */
+  std::uint16_t column_widths[Page::MAX_COLUMNS];
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +93,12 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page &&
+        record_length == rhs.record_length &&
+        num_columns == rhs.num_columns &&
+        std::equal(column_widths, column_widths + num_columns,
+                   rhs.column_widths);
   }
 };
 
@@ -60,15 +106,21 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
+ * The File class wraps a descriptor of an underlying file on disk.  Files contain
  * fixed-sized pages, and they never deallocate space (though they do reuse
  * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_fds_ map) and just returns a file object with
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
  *
- * @warning This class is not threadsafe.
+ * Pages are read and written with pread/pwrite at their own offset, so there is no
+ * shared file position and reads and writes of pages may run in parallel.  The
+ * cached header has a mutex of its own, so reading it, replacing it and
+ * flushing it may run in parallel with them too.
+ *
+ * @warning Opening and closing files, and allocating or deleting pages, is not threadsafe;
+ *          BufMgr serializes allocations and deletions with its I/O latch.
  */
 
 
@@ -124,6 +176,16 @@ class File {
    */
   virtual Page allocatePage(PageId &new_page_number) = 0;
 
+  /**
+   * Allocates a new page in the file and sets up the given page as its
+   * contents, without building a temporary Page.  BufMgr allocates straight
+   * into a buffer frame this way.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param page              Page to hold the new page.
+   */
+  virtual void allocatePageInto(PageId &new_page_number, Page& page) = 0;
+
   /**
    * Reads an existing page from the file.
    *
@@ -134,6 +196,18 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads an existing page from the file straight into the given page,
+   * without building a temporary Page.  BufMgr reads into its buffer frames
+   * this way.  If an exception is thrown the contents of page are undefined.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPageInto(const PageId page_number, Page& page) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -157,6 +231,41 @@ class File {
    */
   const std::string& filename() const { return filename_; }
 
+  /**
+   * Sets the durability of the file.  The setting is shared by every File
+   * object open on the same file and lasts until the file is closed.
+   *
+   * @param durability  New durability.
+   * @throws  FileIOException   If the file cannot be reopened with or without
+   *                            O_DSYNC.
+   */
+  void setDurability(const Durability durability);
+
+  /**
+   * Returns the durability of the file.
+   *
+   * @return Durability set with setDurability(), FLUSH if none was set.
+   */
+  Durability durability() const;
+
+  /**
+   * Writes back the file header and forces every write made so far to
+   * stable storage with fdatasync, whatever the durability of the file.
+   *
+   * @throws  FileIOException   If the sync fails.
+   */
+  void sync() const;
+
+  /**
+   * Writes the file header back to disk if it changed since it was last
+   * written.  The header is kept in memory, shared by every File object open
+   * on the same file, and is otherwise only written when the file is closed
+   * or BufMgr::flushFile() is called on it.
+   *
+   * @throws  FileIOException   If the write fails.
+   */
+  void flushHeader() const;
+
  	/**
    * Returns pageid of first page in the file.
    *
@@ -164,7 +273,13 @@ class File {
    */
 	PageId getFirstPageNo();
 
- protected:
+  /**
+   * Returns the number of used pages in the file, from the cached header.
+   *
+   * @return  Number of allocated pages that are not free.
+   */
+  PageId getNumUsedPages();
+
   /**
    * Returns the position of the page with the given number in the file (as an
    * offset from the beginning of the file).
@@ -172,14 +287,71 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  off_t pagePosition(const PageId page_number) const;
+
+  /**
+   * Marks the header of a file in the mapped format.  A file in the original
+   * format starts with num_pages instead, which never gets this large.
+   */
+  static const std::uint32_t MAPPED_FORMAT_MAGIC = 0xBADB0001;
+
+  /**
+   * Number of pages whose use is recorded by one allocation map block of a
+   * file in the mapped format.
+   */
+  static const PageId PAGES_PER_MAP = Page::SIZE * 8;
+
+ protected:
+  /**
+   * Header of an open file, shared by all File objects open on it.
+   */
+  struct CachedHeader {
+    /**
+     * Current header, possibly newer than the one on disk.
+     */
+    FileHeader header;
+
+    /**
+     * True if the file is in the mapped format: the header fills the first
+     * block of the file and every PAGES_PER_MAP pages are preceded by a block
+     * with one bit per page telling whether it is used.  Otherwise the file
+     * is in the original format: a bare header followed by the pages.
+     */
+    bool mapped;
+
+    /**
+     * True if header has changed since it was last written to disk.
+     */
+    bool dirty;
+
+    /**
+     * Guards header and dirty, which threads scanning, flushing or
+     * allocating pages of the file reach through different File objects.
+     */
+    std::mutex mutex;
+  };
+
+  /**
+   * Reads the header of the file from disk into the cached header, finding
+   * out from the start of the file which format it is in.
+   */
+  void loadHeader();
+
+  /**
+   * Returns the position of the allocation map block covering the given group
+   * of PAGES_PER_MAP pages of a file in the mapped format.
+   *
+   * @param group   Page group; page p belongs to group (p - 1) / PAGES_PER_MAP.
+   * @return  Position of the map block in file.
+   */
+  static off_t mapPosition(const PageId group) {
+    return (off_t)(1 + (off_t)group * (PAGES_PER_MAP + 1)) * Page::SIZE;
   }
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -190,48 +362,89 @@ class File {
   void openIfNeeded(const bool create_new);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <fd_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file.  This is the cached copy; no I/O is
+   * done.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  Only the cached copy is changed; see
+   * flushHeader().
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
+  /**
+   * Reads count bytes from the file starting at offset pos.  Bytes past the
+   * end of the file read as zeros.
+   *
+   * @param buffer  Where to put the bytes.
+   * @param count   Number of bytes to read.
+   * @param pos     Offset in the file.
+   * @throws  FileIOException   If the read fails.
+   */
+  void readAt(void* buffer, const std::size_t count, const off_t pos) const;
+
+  /**
+   * Writes count bytes to the file starting at offset pos.
+   *
+   * @param buffer  Bytes to write.
+   * @param count   Number of bytes to write.
+   * @param pos     Offset in the file.
+   * @throws  FileIOException   If the write fails.
+   */
+  void writeAt(const void* buffer, const std::size_t count, const off_t pos) const;
+
+  typedef std::map<std::string, int> DescriptorMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, Durability> DurabilityMap;
+  typedef std::map<std::string, CachedHeader> HeaderMap;
 
   /**
-   * Streams for opened files.
+   * Descriptors of opened files.
    */
-  static StreamMap open_streams_;
+  static DescriptorMap open_fds_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Durability of opened files.
+   */
+  static DurabilityMap open_durabilities_;
+
+  /**
+   * Headers of opened files.
+   */
+  static HeaderMap open_headers_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor of underlying filesystem object, or -1 if closed.
    */
-  std::shared_ptr<std::fstream> stream_;
+  int fd_;
+
+  /**
+   * Entry of open_headers_ for this file, or NULL if closed.  Map nodes do
+   * not move, so the pointer stays valid while the file is open.
+   */
+  CachedHeader* cached_header_;
 
   friend class FileIterator;
 };
@@ -240,19 +453,42 @@ class PageFile : public File {
  public:
 
   /**
-   * Creates a new file.
+   * Creates a new file, in the mapped format.
    *
    * @param filename  Name of the file.
    * @throws  FileExistsException     If the requested file already exists.
    */
   static PageFile create(const std::string& filename);
 
+  /**
+   * Creates a new file, in the mapped format, whose pages hold fixed-length
+   * records of the given length instead of slotted ones.
+   *
+   * @param filename       Name of the file.
+   * @param record_length  Length of every record stored in the file.
+   * @throws  FileExistsException     If the requested file already exists.
+   */
+  static PageFile create(const std::string& filename,
+                         const std::uint16_t record_length);
+
+  /**
+   * Creates a new file, in the mapped format, whose pages are PAX pages:
+   * fixed-length records stored column by column, one minipage per column.
+   *
+   * @param filename       Name of the file.
+   * @param column_widths  Width of each column in bytes, in record order; at
+   *                       most Page::MAX_COLUMNS columns.
+   * @throws  FileExistsException     If the requested file already exists.
+   */
+  static PageFile create(const std::string& filename,
+                         const std::vector<std::uint16_t>& column_widths);
+
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_fds_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -264,12 +500,15 @@ class PageFile : public File {
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param record_length  Record length of the pages of a new file, or 0 for
+   *                       slotted pages.  Ignored when opening a file.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  PageFile(const std::string& name, const bool create_new);
+  PageFile(const std::string& name, const bool create_new,
+           const std::uint16_t record_length = 0);
 
   /**
    * Copy constructor.
@@ -287,6 +526,19 @@ class PageFile : public File {
    */
   PageFile& operator=(const PageFile& rhs);
 
+  /**
+   * Returns the length of every record in this file, or 0 if its pages are
+   * slotted.
+   */
+  std::uint16_t record_length() const { return readHeader().record_length; }
+
+  /**
+   * Returns the width of each column of a file of PAX pages.
+   *
+   * @return  Column widths, empty if the file stores its records by row.
+   */
+  std::vector<std::uint16_t> column_widths() const;
+
   /**
    * Destructor that automatically closes the underlying file if no other
    * File objects are using it.
@@ -294,12 +546,23 @@ class PageFile : public File {
   ~PageFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file, reusing a deleted page if there is one.
+   * In the mapped format this reads at most the previous used page's header
+   * and one allocation map block; files in the original format walk the used
+   * list.
    *
    * @return The new page.
    */
   Page allocatePage(PageId &new_page_number);
 
+  /**
+   * Allocates a new page in the file into the given page.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param page              Page to hold the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& page);
+
   /**
    * Reads an existing page from the file.
    *
@@ -310,6 +573,16 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPageInto(const PageId page_number, Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -320,12 +593,32 @@ class PageFile : public File {
   void writePage(const PageId page_number, const Page& new_page);
 
   /**
-   * Deletes a page from the file.
+   * Deletes a page from the file, with the same cost as allocatePage().
    *
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Returns whether the file is in the mapped format, whose allocation maps
+   * tell which pages are used.  Files in the original format only have the
+   * used list.
+   */
+  bool is_mapped() const { return cached_header_->mapped; }
+
+  /**
+   * Lists used pages of a file in the mapped format in page number order,
+   * reading only the allocation maps, not the pages.
+   *
+   * @param page_number   Page to start at.  Set to the page to go on from, or
+   *                      to Page::INVALID_NUMBER once the last page is listed.
+   * @param page_numbers  Receives the numbers of the pages listed.
+   * @param max_pages     Most pages to list.
+   * @return  Number of pages listed.
+   */
+  std::size_t listUsedPages(PageId& page_number, PageId* page_numbers,
+                            const std::size_t max_pages) const;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -344,19 +637,30 @@ class PageFile : public File {
  private:
 
   /**
-   * Reads a page from the file.  If <allow_free> is not set, an exception
-   * will be thrown if the page read from disk is not currently in use.
+   * Initializes a page as an empty page in the format the file header calls
+   * for: PAX, fixed-length or slotted.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * @param header   Header of this file.
+   * @param page     Page to initialize.
+   */
+  static void formatPage(const FileHeader& header, Page& page);
+
+  /**
+   * Reads a page from the file into the given page.  If <allow_free> is not
+   * set, an exception will be thrown if the page read from disk is not
+   * currently in use.
+   *
+   * No bounds checking is performed; a page past the end of the file reads
+   * as zeros, which is an unused page.
    *
    * @param page_number   Number of page to read.
+   * @param page          Page to read into.
    * @param allow_free    Whether to allow reading a free (unused) page.
-   * @return  The page.
    * @throws  InvalidPageException  If the page is free (unused) and
    *                                allow_free is false.
    */
-  Page readPage(const PageId page_number, const bool allow_free) const;
+  void readPageInto(const PageId page_number, Page& page,
+                    const bool allow_free) const;
 
   /**
    * Writes a page into the file at the given page number with the given header.
@@ -379,6 +683,57 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Writes only the header of the given page to disk.  No bounds checking is
+   * performed.
+   *
+   * @param page_number   Number of page whose header is to be written.
+   * @param header        Header to write.
+   */
+  void writePageHeader(const PageId page_number, const PageHeader& header);
+
+  /**
+   * Returns the largest used page number smaller than the given one.  Files
+   * in the mapped format answer from the tail pointer or the allocation maps;
+   * files in the original format walk the used list.
+   *
+   * @param header        Current file header.
+   * @param page_number   Page number to look before.
+   * @return  Previous used page, or Page::INVALID_NUMBER if there is none.
+   */
+  PageId usedPageBefore(const FileHeader& header,
+                        const PageId page_number) const;
+
+  /**
+   * Links a page that is not in the used list into it, keeping the list in
+   * page number order.  Sets the page's next page number; the caller writes
+   * the page and the header.
+   *
+   * @param header  File header, updated in place.
+   * @param page    Page to link, with its page number set.
+   */
+  void linkUsedPage(FileHeader& header, Page& page);
+
+  /**
+   * Unlinks a page from the used list.  The caller writes the page and the
+   * header.
+   *
+   * @param header            File header, updated in place.
+   * @param page_number       Number of the page to unlink.
+   * @param next_page_number  Page following it in the used list.
+   */
+  void unlinkUsedPage(FileHeader& header, const PageId page_number,
+                      const PageId next_page_number);
+
+  /**
+   * Sets or clears the bit of a page in the allocation map of a file in the
+   * mapped format.
+   *
+   * @param page_number   Number of page.
+   * @param used          New value of the bit.
+   */
+  void markUsed(const PageId page_number, const bool used);
+
   friend class FileIterator;
 };
 
@@ -395,10 +750,10 @@ class BlobFile : public File {
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the descriptor associated with this File object are inserted into the
+	 * open_fds_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
@@ -448,16 +803,52 @@ class BlobFile : public File {
    */
   Page allocatePage(PageId &new_page_number);
 
+  /**
+   * Allocates a new page in the file into the given page.
+   *
+   * @param new_page_number   Set to the number of the new page.
+   * @param page              Page to hold the new page.
+   */
+  void allocatePageInto(PageId &new_page_number, Page& page);
+
+  /**
+   * Allocates a run of consecutive pages at the end of the file with a single
+   * header update.  Unlike allocatePage(), nothing is written to the pages
+   * themselves; the caller must write every one of them before reading it.
+   *
+   * @param count   Number of pages to allocate.
+   * @return  Page number of the first allocated page.
+   */
+  PageId allocatePages(const PageId count);
+
+  /**
+   * Returns the number of the first page allocated in the file, or
+   * Page::INVALID_NUMBER if none has been.
+   */
+  PageId first_page_number() const;
+
   /**
    * Reads an existing page from the file.
    *
    * @param page_number   Number of page to read.
    * @return  The page.
-   * @throws  InvalidPageException  If the page doesn't exist in the file or is
-   *                                not currently used.
+   * @throws  InvalidPageException  If the page has not been allocated: it is
+   *                                the file header or lies past the end of
+   *                                the file.
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file into the given page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page has not been allocated: it is
+   *                                the file header or lies past the end of
+   *                                the file.
+   */
+  void readPageInto(const PageId page_number, Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -103,6 +103,14 @@ class FileIterator {
 	inline Page operator*() const
   { return file_->readPage(current_page_number_); }
 
+  /**
+   * Returns the number of the current page without reading the page.
+   *
+   * @return  Page number.
+   */
+	inline PageId page_number() const
+  { return current_page_number_; }
+
  private:
   /**
    * File we're iterating over.
@@ -5,116 +5,625 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include "filescan.h"
 #include "exceptions/end_of_file_exception.h"
 
 namespace badgerdb { 
 
-FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
+namespace {
+
+/**
+ * Returns whether a op b holds.
+ */
+template <class T>
+bool compare(const T& a, const Operator op, const T& b)
+{
+  switch (op)
+  {
+    case LT: return a < b;
+    case LTE: return a <= b;
+    case GTE: return a >= b;
+    case GT: return a > b;
+    case EQ: return a == b;
+    case NE: return a != b;
+  }
+  return false;
+}
+
+}
+
+ScanPredicate::ScanPredicate()
+{
+}
+
+ScanPredicate& ScanPredicate::addInt(const std::size_t offset, const Operator op, const int value)
+{
+  Comparison comparison = {INTEGER, offset, sizeof(int), op, value, 0, ""};
+  comparisons.push_back(comparison);
+  return *this;
+}
+
+ScanPredicate& ScanPredicate::addDouble(const std::size_t offset, const Operator op, const double value)
+{
+  Comparison comparison = {DOUBLE, offset, sizeof(double), op, 0, value, ""};
+  comparisons.push_back(comparison);
+  return *this;
+}
+
+ScanPredicate& ScanPredicate::addString(const std::size_t offset, const std::size_t length, const Operator op,
+                                        const std::string& value)
+{
+  Comparison comparison = {STRING, offset, length, op, 0, 0, value};
+  comparisons.push_back(comparison);
+  return *this;
+}
+
+bool ScanPredicate::Comparison::test(const char* field) const
+{
+  switch (type)
+  {
+    case INTEGER:
+    {
+      int fieldValue;
+      memcpy(&fieldValue, field, sizeof(fieldValue));
+      return compare(fieldValue, op, intValue);
+    }
+    case DOUBLE:
+    {
+      double fieldValue;
+      memcpy(&fieldValue, field, sizeof(fieldValue));
+      return compare(fieldValue, op, doubleValue);
+    }
+    case STRING:
+      return compare(strncmp(field, stringValue.c_str(), length), op, 0);
+  }
+  return false;
+}
+
+bool ScanPredicate::matches(std::string_view record) const
+{
+  for (const Comparison& comparison : comparisons)
+  {
+    if (comparison.offset + comparison.length > record.size() || !comparison.test(record.data() + comparison.offset))
+      return false;
+  }
+  return true;
+}
+
+void ScanPredicate::filter(Page& page, std::vector<SlotId>& slots) const
+{
+  slots.clear();
+  for (PageIterator iter = page.begin(); iter != page.end(); ++iter)
+  {
+    slots.push_back(iter.getCurrentRecord().slot_number);
+  }
+
+  const PageId pageNo = page.page_number();
+  for (const Comparison& comparison : comparisons)
+  {
+    // On a PAX page, find the column holding the field; one that spans columns is read from the whole record
+    std::uint16_t column = 0;
+    std::size_t columnOffset = comparison.offset;
+    bool inColumn = false;
+    if (page.num_columns() != 0)
+    {
+      while (column < page.num_columns() && columnOffset >= page.column_width(column))
+      {
+        columnOffset -= page.column_width(column);
+        column++;
+      }
+      inColumn = column < page.num_columns() && columnOffset + comparison.length <= page.column_width(column);
+    }
+
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < slots.size(); i++)
+    {
+      const RecordId rid = {pageNo, slots[i]};
+      bool satisfied;
+      if (inColumn)
+      {
+        satisfied = comparison.test(page.getColumnView(rid, column).data() + columnOffset);
+      }
+      else
+      {
+        const std::string record = page.num_columns() != 0 ? page.getRecord(rid) : std::string();
+        std::string_view view = page.num_columns() != 0 ? std::string_view(record) : page.getRecordView(rid);
+        satisfied = comparison.offset + comparison.length <= view.size() &&
+            comparison.test(view.data() + comparison.offset);
+      }
+      if (satisfied)
+        slots[kept++] = slots[i];
+    }
+    slots.resize(kept);
+  }
+}
+
+FileScan::FileScan(const std::string &name, BufMgr *bufferMgr, const std::uint32_t readAhead)
 {
   file = new PageFile(name, false);	//dont create new file
 	bufMgr = bufferMgr;
-	curDirtyFlag = false;
-  curPage = NULL;
-	filePageIter = file->begin();
+	this->readAhead = readAhead;
+	prefetched = 0;
+	columnMode = false;
+	column = 0;
+	filtered = false;
+	selectionIndex = 0;
+
+	// the rest of the page chain is followed as the scan goes
+	const PageId firstPageNo = file->getFirstPageNo();
+	chainEnd = firstPageNo == Page::INVALID_NUMBER;
+	if (!chainEnd)
+		pagesAhead.push_back(firstPageNo);
+
+	std::uint32_t ringSize = std::max(BufferRing::DEFAULT_SIZE, 2 * readAhead);
+	if (file->getNumUsedPages() > bufMgr->getNumBufs() / 4 && ringSize <= bufMgr->getNumBufs() / 4)
+		ring.reset(new BufferRing(ringSize));
 }
 
 FileScan::~FileScan()
 {
   // generally must unpin last page of the scan
-  if (curPage != NULL)
-  {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-		curDirtyFlag = false;
-    filePageIter = file->begin();
-  }
+  curPage.release();
   bufMgr->flushFile(file);
   delete file;
 }
 
-void FileScan::scanNext(RecordId& outRid)
+void FileScan::prefetchAhead()
 {
-  std::string rec;
+	while (!chainEnd && pagesAhead.size() < readAhead)
+	{
+		followChain();
+		if (prefetched < pagesAhead.size())
+		{
+			bufMgr->prefetch(file, std::vector<PageId>(pagesAhead.begin() + prefetched, pagesAhead.end()), ring.get());
+			prefetched = pagesAhead.size();
+		}
+	}
+}
 
-  if (filePageIter == file->end())
+void FileScan::followChain()
+{
+	PageId nextPageNo;
+	if (pagesAhead.empty())
+	{
+		nextPageNo = curPage->next_page_number();
+	}
+	else
 	{
-		throw EndOfFileException();
+		// prefetched a step earlier, so this mostly waits out a read already under way
+		PageGuard lastPage = bufMgr->readPage(file, pagesAhead.back(), ring.get());
+		nextPageNo = lastPage->next_page_number();
 	}
+	if (nextPageNo == Page::INVALID_NUMBER)
+		chainEnd = true;
+	else
+		pagesAhead.push_back(nextPageNo);
+}
 
-  // special case of the first record of the first page of the file
-  if (curPage == NULL)
+bool FileScan::nextPage()
+{
+	// with no page ahead known, the current page says which one is next
+	if (pagesAhead.empty() && !chainEnd && curPage.isPinned())
+		followChain();
+	curPage.release();
+	if (pagesAhead.empty())
+		return false;
+
+	const PageId pageNo = pagesAhead.front();
+	pagesAhead.pop_front();
+	if (prefetched > 0)
+		prefetched--;
+
+	// read the next page of the file, which the read-ahead should already have brought in
+	curPage = bufMgr->readPage(file, pageNo, ring.get());
+	prefetchAhead();
+	return true;
+}
+
+void FileScan::firstOnPage()
+{
+  if (filtered)
   {
-    // need to get the first page of the file
-		filePageIter = file->begin();
-    if(filePageIter == file->end())
-		{
-			throw EndOfFileException();
-		}
-	 
-		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
+    predicate.filter(*curPage.get(), selection);
+    selectionIndex = 0;
+    if (!selection.empty())
+      pageRecordIter = PageIterator(curPage.get(), {curPage->page_number(), selection[0]});
+    return;
+  }
+  pageRecordIter = curPage->begin();
+}
 
-		// get the first record off the page
-    pageRecordIter = curPage->begin(); 
+void FileScan::nextOnPage()
+{
+  if (filtered)
+  {
+    selectionIndex++;
+    if (selectionIndex < selection.size())
+      pageRecordIter = PageIterator(curPage.get(), {curPage->page_number(), selection[selectionIndex]});
+    return;
+  }
+  pageRecordIter++;
+}
 
-		if(pageRecordIter != curPage->end()) 
-		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
+bool FileScan::onRecord()
+{
+  if (filtered)
+    return selectionIndex < selection.size();
+  // Past the last record the iterator is on the invalid slot, as curPage->end() is
+  return pageRecordIter.getCurrentRecord().slot_number != Page::INVALID_SLOT;
+}
 
-			outRid = pageRecordIter.getCurrentRecord();
-			return;
-		}
+void FileScan::scanNext(RecordId& outRid)
+{
+  if (!advance(outRid))
+  {
+    throw EndOfFileException();
   }
+}
 
-	// Loop, looking for a record that satisfied the predicate.
-	// First try and get the next record off the current page
-	pageRecordIter++;
+bool FileScan::scanNextBatch(std::vector<RecordId>& outRids, const std::size_t max)
+{
+  return nextBatch(outRids, NULL, max);
+}
+
+bool FileScan::scanNextBatch(std::vector<RecordId>& outRids, std::vector<std::string_view>& outRecords,
+                             const std::size_t max)
+{
+  return nextBatch(outRids, &outRecords, max);
+}
+
+bool FileScan::nextBatch(std::vector<RecordId>& outRids, std::vector<std::string_view>* outRecords,
+                         const std::size_t max)
+{
+  assert(max > 0);
+  outRids.clear();
+  if (outRecords != NULL)
+    outRecords->clear();
+  RecordId rid;
+  if (!advance(rid))
+    return false;
 
-  while (pageRecordIter == curPage->end())
+  // The rest of the batch comes off the same page, which stays pinned
+  const bool inPlace = outRecords != NULL && !columnMode && curPage->num_columns() == 0;
+  bool viewed = false;
+  if (filtered)
   {
-    // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
-    curPage = NULL;
-    curDirtyFlag = false;
+    // The selection already holds the slots
+    const std::size_t end = std::min(selection.size(), selectionIndex + max);
+    outRids.resize(end - selectionIndex);
+    for (std::size_t i = selectionIndex; i < end; i++)
+      outRids[i - selectionIndex] = {curPage->page_number(), selection[i]};
+    selectionIndex = end - 1;
+  }
+  else
+  {
+    // Ask the page for the rest in one call, views included when they can point into it
+    const std::size_t room = std::min<std::size_t>(max, curPage->getNumRecords());
+    outRids.resize(room);
+    outRids[0] = rid;
+    std::string_view* views = NULL;
+    if (inPlace)
+    {
+      outRecords->resize(room);
+      views = outRecords->data();
+      views[0] = curPage->getRecordView(rid);
+      views++;
+      viewed = true;
+    }
+    const std::size_t count = 1 + curPage->getRecordViews(rid.slot_number, room - 1, outRids.data() + 1, views);
+    outRids.resize(count);
+    if (inPlace)
+      outRecords->resize(count);
+  }
+  // The next record is looked for after the last of the batch
+  pageRecordIter = PageIterator(curPage.get(), outRids.back());
 
-    filePageIter++;
-    if (filePageIter == file->end())
+  if (outRecords == NULL || viewed)
+    return true;
+  outRecords->resize(outRids.size());
+  if (columnMode)
+  {
+    for (std::size_t i = 0; i < outRids.size(); i++)
+      (*outRecords)[i] = curPage->getColumnView(outRids[i], column);
+  }
+  else if (curPage->num_columns() != 0)
+  {
+    // Gather all the records first, so the buffer does not move under the views
+    const std::size_t length = curPage->record_length();
+    batchBuffer.resize(outRids.size() * length);
+    for (std::size_t i = 0; i < outRids.size(); i++)
     {
-      curPage = NULL;
-			throw EndOfFileException();
+      const std::string record = curPage->getRecord(outRids[i]);
+      memcpy(&batchBuffer[i * length], record.data(), length);
     }
+    for (std::size_t i = 0; i < outRids.size(); i++)
+      (*outRecords)[i] = std::string_view(&batchBuffer[i * length], length);
+  }
+  else
+  {
+    for (std::size_t i = 0; i < outRids.size(); i++)
+      (*outRecords)[i] = curPage->getRecordView(outRids[i]);
+  }
+  return true;
+}
 
-    // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+bool FileScan::advance(RecordId& outRid)
+{
+  // special case of the first record of the first page of the file
+  if (!curPage.isPinned())
+  {
+    // need to get the first page of the file
+    if (!nextPage())
+		{
+			return false;
+		}
+
+		// get the first record off the page
+    firstOnPage();
+  }
+  else
+  {
+    // First try and get the next record off the current page
+    nextOnPage();
+  }
+
+  while (!onRecord())
+  {
+    // unpin the current page and move on to the next one
+    if (!nextPage())
+    {
+			return false;
+    }
 
     // get the first record off the page
-    pageRecordIter = curPage->begin(); 
+    firstOnPage();
   }
 
   // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
-
 	// return rid of the record
 	outRid = pageRecordIter.getCurrentRecord();
-	return;
+	return true;
 }
 
 // returns pointer to the current record.  page is left pinned
 // and the scan logic is required to unpin the page 
 std::string FileScan::getRecord()
 {
+  if (columnMode)
+    return std::string(getRecordView());
   return *pageRecordIter;
 }
 
+std::string_view FileScan::getRecordView()
+{
+  if (columnMode)
+    return curPage->getColumnView(pageRecordIter.getCurrentRecord(), column);
+  if (curPage->num_columns() != 0)
+  {
+    recordBuffer = *pageRecordIter;
+    return recordBuffer;
+  }
+  return pageRecordIter.getRecordView();
+}
+
+void FileScan::projectColumn(const std::uint16_t column)
+{
+  columnMode = true;
+  this->column = column;
+}
+
+void FileScan::setPredicate(const ScanPredicate& predicate)
+{
+  this->predicate = predicate;
+  filtered = !predicate.empty();
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
-  curDirtyFlag = true;
+  curPage.markDirty();
+}
+
+ParallelFileScan::ParallelFileScan(const std::string &name, BufMgr *bufferMgr, const std::size_t morselPages)
+  : bufMgr(bufferMgr), maxPages(0), numListed(0), nextPageNo(Page::INVALID_NUMBER), chunkMorsels(1),
+    morselPages(std::max<std::size_t>(morselPages, 1)), numWorkers(0), stopped(false)
+{
+  file = new PageFile(name, false);	//dont create new file
+}
+
+ParallelFileScan::~ParallelFileScan()
+{
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelFileScan::setPredicate(const ScanPredicate& predicate)
+{
+  this->predicate = predicate;
+}
+
+void ParallelFileScan::run(const std::vector<RecordSink>& sinks)
+{
+  if (sinks.empty())
+    return;
+
+  // Nothing is listed yet; the first worker to claim a morsel lists the first chunk.
+  numWorkers = sinks.size();
+  ranges.reset(new MorselRange[numWorkers]);
+  for (std::size_t i = 0; i < numWorkers; i++)
+  {
+    ranges[i] = 0;
+  }
+  maxPages = file->getNumUsedPages();
+  pageIds.reset(new PageId[maxPages]);
+  numListed = 0;
+  nextPageNo = file->getFirstPageNo();
+  // A page chain is followed through the pool, so a chunk is kept small enough to still be there when it is scanned
+  chunkMorsels = std::min<std::size_t>(2 * numWorkers,
+                                       std::max<std::size_t>(bufMgr->getNumBufs() / 4 / morselPages, 1));
+  stopped = false;
+
+  std::exception_ptr failure;
+  std::mutex failureMutex;
+  std::vector<std::thread> workers;
+  for (std::size_t i = 0; i < numWorkers; i++)
+  {
+    workers.push_back(std::thread([this, i, &sinks, &failure, &failureMutex]() {
+      try
+      {
+        work(i, sinks[i]);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(failureMutex);
+        if (!failure)
+          failure = std::current_exception();
+        stopped = true;
+      }
+    }));
+  }
+  for (std::size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i].join();
+  }
+  ranges.reset();
+  pageIds.reset();
+  if (failure)
+    std::rethrow_exception(failure);
+}
+
+void ParallelFileScan::work(const std::size_t worker, const RecordSink& sink)
+{
+  std::vector<SlotId> slots;
+  std::string recordBuffer;
+  std::size_t morsel;
+  while (!stopped && claimMorsel(worker, morsel))
+  {
+    scanMorsel(morsel, sink, slots, recordBuffer);
+  }
+}
+
+bool ParallelFileScan::claimMorsel(const std::size_t worker, std::size_t& morsel)
+{
+  while (!claimListedMorsel(worker, morsel))
+  {
+    std::lock_guard<std::mutex> lock(chainMutex);
+    // Another worker may have listed a chunk while this one waited for the chain.
+    bool unclaimed = false;
+    for (std::size_t i = 0; i < numWorkers; i++)
+    {
+      const std::uint64_t range = ranges[i].load();
+      unclaimed = unclaimed || (range >> 32) < (range & 0xffffffff);
+    }
+    if (!unclaimed && !listChunk())
+      return false;
+  }
+  return true;
+}
+
+bool ParallelFileScan::listChunk()
+{
+  if (stopped || nextPageNo == Page::INVALID_NUMBER)
+    return false;
+
+  const std::size_t first = numListed;
+  const std::size_t limit = std::min(first + chunkMorsels * morselPages, maxPages);
+  std::size_t count = first;
+  if (file->is_mapped())
+  {
+    // the allocation maps tell the used pages without reading any of them
+    count += file->listUsedPages(nextPageNo, &pageIds[first], limit - first);
+  }
+  else
+  {
+    // A file in the original format only has the page chain.  A worker scans the page soon after, so reading it into
+    // the pool now is no wasted work.
+    while (nextPageNo != Page::INVALID_NUMBER && count < limit)
+    {
+      pageIds[count++] = nextPageNo;
+      PageGuard page = bufMgr->readPage(file, nextPageNo);
+      nextPageNo = page->next_page_number();
+    }
+  }
+  if (count == maxPages)
+    nextPageNo = Page::INVALID_NUMBER;
+  if (count == first)
+    return false;
+  numListed = count;
+
+  // Deal the new morsels out in contiguous shares, so each worker goes on with pages of its own.  Every range is
+  // empty, and claims only ever shrink one, so no claim races with the new ranges.
+  const std::uint64_t firstMorsel = first / morselPages;
+  const std::uint64_t numMorsels = (count - first + morselPages - 1) / morselPages;
+  for (std::size_t i = 0; i < numWorkers; i++)
+  {
+    const std::uint64_t begin = firstMorsel + numMorsels * i / numWorkers;
+    const std::uint64_t end = firstMorsel + numMorsels * (i + 1) / numWorkers;
+    ranges[i] = (begin << 32) | end;
+  }
+  return true;
+}
+
+bool ParallelFileScan::claimListedMorsel(const std::size_t worker, std::size_t& morsel)
+{
+  // Own morsels first, from the front.
+  MorselRange& own = ranges[worker];
+  std::uint64_t range = own.load();
+  while ((range >> 32) < (range & 0xffffffff))
+  {
+    if (own.compare_exchange_weak(range, range + (std::uint64_t(1) << 32)))
+    {
+      morsel = range >> 32;
+      return true;
+    }
+  }
+
+  // Then steal from the back of the others, starting with the next worker.
+  for (std::size_t i = 1; i < numWorkers; i++)
+  {
+    MorselRange& victim = ranges[(worker + i) % numWorkers];
+    range = victim.load();
+    while ((range >> 32) < (range & 0xffffffff))
+    {
+      if (victim.compare_exchange_weak(range, range - 1))
+      {
+        morsel = (range & 0xffffffff) - 1;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void ParallelFileScan::scanMorsel(const std::size_t morsel, const RecordSink& sink, std::vector<SlotId>& slots,
+                                  std::string& recordBuffer)
+{
+  const std::size_t end = std::min(numListed.load(), (morsel + 1) * morselPages);
+  for (std::size_t i = morsel * morselPages; i < end; i++)
+  {
+    // unpinned when the sink throws too
+    PageGuard page = bufMgr->readPage(file, pageIds[i]);
+    predicate.filter(*page.get(), slots);
+    for (std::size_t j = 0; j < slots.size(); j++)
+    {
+      const RecordId rid = {page->page_number(), slots[j]};
+      if (page->num_columns() != 0)
+      {
+        recordBuffer = page->getRecord(rid);
+        sink(rid, recordBuffer);
+      }
+      else
+      {
+        sink(rid, page->getRecordView(rid));
+      }
+    }
+  }
 }
 
 }
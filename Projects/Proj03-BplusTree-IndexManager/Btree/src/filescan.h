@@ -8,7 +8,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <vector>
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
@@ -17,6 +24,101 @@
 
 namespace badgerdb {
 
+/**
+ * @brief A conjunction of comparisons of record fields against constants.  A FileScan given one evaluates it on
+ * the bytes of each page and returns only the records that satisfy it.
+ */
+class ScanPredicate
+{
+ public:
+
+  /**
+   * Constructs a predicate with no comparisons, which every record satisfies.
+   */
+  ScanPredicate();
+
+  /**
+   * Adds the comparison of the int at the given offset of a record with a value.
+   *
+   * @param offset  Byte offset of the field in the record
+   * @param op      Comparison the field must satisfy against value
+   * @param value   Value to compare against
+   * @return This predicate, so that comparisons can be chained
+   */
+  ScanPredicate& addInt(const std::size_t offset, const Operator op, const int value);
+
+  /**
+   * Adds the comparison of the double at the given offset of a record with a value.
+   *
+   * @param offset  Byte offset of the field in the record
+   * @param op      Comparison the field must satisfy against value
+   * @param value   Value to compare against
+   * @return This predicate, so that comparisons can be chained
+   */
+  ScanPredicate& addDouble(const std::size_t offset, const Operator op, const double value);
+
+  /**
+   * Adds the comparison of the string of at most length characters at the given offset of a record with a value,
+   * in strncmp() order.
+   *
+   * @param offset  Byte offset of the field in the record
+   * @param length  Length of the field in bytes
+   * @param op      Comparison the field must satisfy against value
+   * @param value   Value to compare against
+   * @return This predicate, so that comparisons can be chained
+   */
+  ScanPredicate& addString(const std::size_t offset, const std::size_t length, const Operator op,
+                           const std::string& value);
+
+  /**
+   * Returns true if the predicate has no comparisons.
+   */
+  bool empty() const { return comparisons.empty(); }
+
+  /**
+   * Returns whether a record satisfies every comparison.  A record too short to hold a field fails its comparison.
+   *
+   * @param record  Bytes of the record
+   * @return True if the record satisfies the predicate
+   */
+  bool matches(std::string_view record) const;
+
+  /**
+   * Evaluates the predicate over every record of a page at once.  The comparisons are applied one after the
+   * other, each to all the records that passed the ones before it, reading the field straight from the page or,
+   * on a PAX page, from the minipage of its column.
+   *
+   * @param page    Page to evaluate the predicate on
+   * @param slots   Set to the slots of the records that satisfy the predicate, in slot order
+   */
+  void filter(Page& page, std::vector<SlotId>& slots) const;
+
+ private:
+  /**
+   * One comparison of the conjunction.
+   */
+  struct Comparison
+  {
+    Datatype      type;
+    std::size_t   offset;
+    std::size_t   length;
+    Operator      op;
+    int           intValue;
+    double        doubleValue;
+    std::string   stringValue;
+
+    /**
+     * Returns whether the field starting at the given byte satisfies the comparison.
+     */
+    bool test(const char* field) const;
+  };
+
+  /**
+   * Comparisons a record has to satisfy.
+   */
+  std::vector<Comparison> comparisons;
+};
+
 /**
  * @brief This class is used to sequentially scan records in a relation.
  */
@@ -24,16 +126,77 @@ class FileScan
 {
  public:
 
-  FileScan(const std::string &name, BufMgr *bufMgr);
+  /**
+   * Opens a scan over a relation.
+   *
+   * @param name       Name of the relation file
+   * @param bufMgr     Buffer manager to read pages through
+   * @param readAhead  Number of pages to keep prefetching ahead of the scan; 0 reads each page only when it is reached
+   *
+   * A relation of more than a quarter of the buffer pool is read through a BufferRing, so that scanning it does not
+   * push the rest of the pool out.
+   */
+  FileScan(const std::string &name, BufMgr *bufMgr,
+           const std::uint32_t readAhead = BufMgr::DEFAULT_READ_AHEAD);
 
   ~FileScan();
 
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
+  /**
+   * Returns the next records of the scan, at most max of them and all from one page: the rest of the current page
+   * or, once that is done, the start of the next page that has any.  The page stays pinned until the next call, so
+   * a whole page is handed over with no per-record bookkeeping.  Afterwards getRecord() and getRecordView() refer
+   * to the last record of the batch.
+   *
+   * @param outRids  Set to the IDs of the records
+   * @param max      Largest number of records to return; must be positive
+   * @return False, with outRids empty, once the scan has returned every record
+   */
+  bool scanNextBatch(std::vector<RecordId>& outRids, const std::size_t max);
+
+  /**
+   * Like scanNextBatch(outRids, max), but also returns a view of each record, or of the projected column in column
+   * mode.  The views stay valid until the next call to scanNext() or scanNextBatch(); records of a PAX page are
+   * gathered into a buffer of the scan.
+   *
+   * @param outRids     Set to the IDs of the records
+   * @param outRecords  Set to the records, in the same order
+   * @param max         Largest number of records to return; must be positive
+   * @return False, with both vectors empty, once the scan has returned every record
+   */
+  bool scanNextBatch(std::vector<RecordId>& outRids, std::vector<std::string_view>& outRecords,
+                     const std::size_t max);
+
   //read current record, returning pointer and length
   std::string getRecord();
 
+  /**
+   * Returns the current record without copying it.  The view points into the current page, which the scan keeps
+   * pinned, so it stays valid until the next call to scanNext() or the end of the scan.  A record of a PAX page is
+   * gathered from its minipages into a buffer of the scan instead, which the next call overwrites.
+   */
+  std::string_view getRecordView();
+
+  /**
+   * Puts the scan in column mode: from now on getRecord() and getRecordView() return only the given column of the
+   * current record, read from the column's minipage without touching the rest of the record.  The relation must be
+   * a file of PAX pages.
+   *
+   * @param column  Index of the column
+   * @throws PageLayoutException  From getRecord() and getRecordView(), if the current page is not a PAX page
+   */
+  void projectColumn(const std::uint16_t column);
+
+  /**
+   * Restricts the scan to the records that satisfy a predicate.  The predicate is evaluated over all the records
+   * of each page as the scan reaches it, so scanNext() only ever returns records that satisfy it.
+   *
+   * @param predicate  Predicate the records have to satisfy
+   */
+  void setPredicate(const ScanPredicate& predicate);
+
   //marks current page of scan dirty
   void markDirty();
 
@@ -49,17 +212,275 @@ class FileScan
 	BufMgr				*bufMgr;
 
   /**
-   * Current page being scanned.
+   * Current page being scanned, pinned until the scan moves off it.
+   */
+  PageGuard     curPage;
+
+  /**
+   * Numbers of the used pages that follow the current page, as far as the scan has followed the page chain: at most
+   * readAhead of them once the scan is under way, the first page of the file before it starts.
+   */
+  std::deque<PageId> pagesAhead;
+
+  /**
+   * Pages to prefetch ahead of the current page.
+   */
+  std::uint32_t readAhead;
+
+  /**
+   * Number of pages at the front of pagesAhead already handed to BufMgr::prefetch().
    */
-  Page*         curPage;
+  std::size_t   prefetched;
+
+  /**
+   * True once the last used page of the file is the current page or in pagesAhead.
+   */
+  bool          chainEnd;
+
+  /**
+   * Ring the scan reads its pages into, if the relation is large enough next to the buffer pool to flush it
+   * otherwise; NULL if the scan reads through the whole pool.
+   */
+  std::unique_ptr<BufferRing> ring;
 
-  FileIterator  filePageIter;
   PageIterator  pageRecordIter;
 
   /**
-   * True if page has been updated
+   * True if the scan is in column mode.
+   */
+  bool          columnMode;
+
+  /**
+   * Column the scan returns in column mode.
+   */
+  std::uint16_t column;
+
+  /**
+   * Holds the current record of a PAX page for getRecordView().
+   */
+  std::string   recordBuffer;
+
+  /**
+   * Follows the page chain until readAhead pages past the current one are known, handing each page to the buffer
+   * manager to prefetch as soon as it is found.  The next page number of a page is read from the page itself, which
+   * by then is in the pool or on its way there, so the chain is never read behind the buffer manager.
+   */
+  void prefetchAhead();
+
+  /**
+   * Appends the page following the last known one to pagesAhead, or sets chainEnd if there is none.
+   */
+  void followChain();
+
+  /**
+   * Lets go of the current page and reads the next one.  Returns false, with no page pinned, at the end of the file.
+   */
+  bool nextPage();
+
+  /**
+   * Positions the scan on the first record of the current page that it returns, if any.
+   */
+  void firstOnPage();
+
+  /**
+   * Moves the scan to the next record of the current page that it returns, if any.
+   */
+  void nextOnPage();
+
+  /**
+   * Returns true if the scan is on a record of the current page.
+   */
+  bool onRecord();
+
+  /**
+   * Moves the scan to its next record, reading pages as needed.  Returns false at the end of the scan.
+   */
+  bool advance(RecordId& outRid);
+
+  /**
+   * Body of both scanNextBatch() variants; outRecords is NULL when no views are wanted.
+   */
+  bool nextBatch(std::vector<RecordId>& outRids, std::vector<std::string_view>* outRecords, const std::size_t max);
+
+  /**
+   * Holds the records of a PAX page gathered for scanNextBatch().
+   */
+  std::string   batchBuffer;
+
+  /**
+   * Predicate of the scan, if filtered.
+   */
+  ScanPredicate predicate;
+
+  /**
+   * True if the scan has a predicate.
+   */
+  bool          filtered;
+
+  /**
+   * Slots of the records of the current page that satisfy the predicate.
+   */
+  std::vector<SlotId> selection;
+
+  /**
+   * Index in selection of the current record.
+   */
+  std::size_t   selectionIndex;
+};
+
+/**
+ * @brief Scans a relation on several threads at once.  The used pages of the file are split into morsels, runs of
+ * consecutive pages; each worker thread starts with an equal share of them and, once its own are done, steals the
+ * last unclaimed morsel of another worker, so threads that fall behind get help until every page is done.  Every
+ * worker runs its own page loop and hands the records it finds to its own sink, so sinks need no synchronization.
+ * The page chain is followed a chunk of morsels at a time, by whichever worker first runs out of morsels, so the
+ * scan starts on the first chunk while the rest of the file is still unlisted.
+ */
+class ParallelFileScan
+{
+ public:
+
+  /**
+   * Function a worker thread calls with every record it returns.  The view is valid only during the call; a record
+   * of a PAX page is gathered into a buffer of the worker.
+   */
+  typedef std::function<void(const RecordId&, std::string_view)> RecordSink;
+
+  /**
+   * Number of pages of a morsel unless the scan is told otherwise.
+   */
+  static const std::size_t DEFAULT_MORSEL_PAGES = 16;
+
+  /**
+   * Opens a parallel scan over a relation.
+   *
+   * @param name         Name of the relation file
+   * @param bufMgr       Buffer manager to read pages through; it is shared by all the worker threads
+   * @param morselPages  Number of pages of a morsel
+   */
+  ParallelFileScan(const std::string &name, BufMgr *bufMgr, const std::size_t morselPages = DEFAULT_MORSEL_PAGES);
+
+  ~ParallelFileScan();
+
+  /**
+   * Restricts the scan to the records that satisfy a predicate, evaluated a page at a time as in FileScan.
+   *
+   * @param predicate  Predicate the records have to satisfy
+   */
+  void setPredicate(const ScanPredicate& predicate);
+
+  /**
+   * Scans the whole relation, with one worker thread per sink, and returns once every page has been scanned.  Each
+   * record goes to exactly one sink.  If a sink throws, the scan stops early and the first exception is rethrown.
+   *
+   * @param sinks  Sink of each worker thread
+   */
+  void run(const std::vector<RecordSink>& sinks);
+
+ private:
+  /**
+   * Morsels a worker has not claimed yet: the next one to take from the front in the high half, one past the last in
+   * the low half.  The owner takes from the front and thieves from the back, each with one compare-and-swap of the
+   * whole range.
+   */
+  typedef std::atomic<std::uint64_t> MorselRange;
+
+  /**
+   * Body of worker thread worker: scans its own morsels, then stolen ones, feeding sink.
+   */
+  void work(const std::size_t worker, const RecordSink& sink);
+
+  /**
+   * Claims the next morsel of worker, or steals one from another worker, listing the next chunk of the file when
+   * every listed morsel is taken.  Returns false once no morsel is left.
+   */
+  bool claimMorsel(const std::size_t worker, std::size_t& morsel);
+
+  /**
+   * Claims a listed morsel: the next one of worker, or one stolen from another worker.  Returns false if every
+   * listed morsel is taken.
+   */
+  bool claimListedMorsel(const std::size_t worker, std::size_t& morsel);
+
+  /**
+   * Lists the next chunk of morsels and deals them out to the workers.  Called with chainMutex held once every
+   * listed morsel is taken.  Returns false at the end of the file.  Pages of a file in the mapped format are listed
+   * from its allocation maps; a file in the original format falls back to following its page chain through the
+   * buffer pool, one page read at a time.
+   */
+  bool listChunk();
+
+  /**
+   * Scans the pages of one morsel, feeding sink.
+   */
+  void scanMorsel(const std::size_t morsel, const RecordSink& sink, std::vector<SlotId>& slots,
+                  std::string& recordBuffer);
+
+  /**
+   * File which is being scanned.
+   */
+  PageFile      *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+  BufMgr        *bufMgr;
+
+  /**
+   * Numbers of the used pages of the file in scan order, listed as run() goes.  Room for every used page is made
+   * when run() starts, so listing more never moves the pages already listed.
+   */
+  std::unique_ptr<PageId[]> pageIds;
+
+  /**
+   * Room in pageIds.
+   */
+  std::size_t   maxPages;
+
+  /**
+   * Number of pages listed in pageIds.
+   */
+  std::atomic<std::size_t> numListed;
+
+  /**
+   * Page to go on listing from, or Page::INVALID_NUMBER once the whole file is listed.
+   */
+  PageId        nextPageNo;
+
+  /**
+   * Morsels listed at a time.
+   */
+  std::size_t   chunkMorsels;
+
+  /**
+   * Held while the next chunk is listed, by one worker at a time.
+   */
+  std::mutex    chainMutex;
+
+  /**
+   * Pages per morsel.
+   */
+  std::size_t   morselPages;
+
+  /**
+   * Predicate of the scan, if filtered.
+   */
+  ScanPredicate predicate;
+
+  /**
+   * Unclaimed morsels of each worker during run().
+   */
+  std::unique_ptr<MorselRange[]> ranges;
+
+  /**
+   * Number of workers of the current run().
+   */
+  std::size_t   numWorkers;
+
+  /**
+   * Set when a worker fails, to stop the others.
    */
-  bool  	      curDirtyFlag;
+  std::atomic<bool> stopped;
 };
 
 }
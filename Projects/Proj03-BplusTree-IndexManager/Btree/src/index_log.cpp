@@ -0,0 +1,317 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "index_log.h"
+#include "exceptions/index_log_exception.h"
+
+namespace badgerdb
+{
+
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page must be exactly Page::SIZE bytes to be logged as raw bytes.");
+
+/**
+ * Unchanged bytes between two changed ranges that are cheaper to log than a second range header.
+ */
+static const std::size_t MERGE_GAP = 2 * sizeof(std::uint16_t);
+
+static std::uint32_t checksum(const LogRecordHeader& header, const char* payload)
+{
+	std::uint32_t hash = 2166136261u;
+	const char* bytes = reinterpret_cast<const char*>(&header) + sizeof(header.checksum);
+	for(std::size_t i = 0; i < sizeof(LogRecordHeader) - sizeof(header.checksum); i++)
+		hash = (hash ^ (unsigned char)bytes[i]) * 16777619u;
+	for(std::size_t i = 0; i < header.length; i++)
+		hash = (hash ^ (unsigned char)payload[i]) * 16777619u;
+	return hash;
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::IndexLog -- Constructor
+// -----------------------------------------------------------------------------
+
+IndexLog::IndexLog(const std::string& logName, BufMgr* bufMgrIn, File* fileIn,
+					std::uint32_t groupCommitSize, std::uint64_t checkpointBytes)
+	: logName(logName), bufMgr(bufMgrIn), file(fileIn),
+		groupCommitSize(groupCommitSize), checkpointBytes(checkpointBytes),
+		nextLsn(0), durableLsn(0), pendingCommits(0)
+{
+	fd = ::open(logName.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+	if(fd < 0)
+		throw IndexLogException(logName, "open");
+
+	// Anything already in the log is durable; recover() decides what to do with it.
+	nextLsn = durableLsn = ::lseek(fd, 0, SEEK_END);
+
+	bufMgr->setPageWriteHook(file, this);
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::~IndexLog -- destructor
+// -----------------------------------------------------------------------------
+
+IndexLog::~IndexLog()
+{
+	// A destructor must not throw, so failures here are left for recover() to sort out
+	try {
+		// pins taken by an insert that never reached commit()
+		for(std::map<PageId, Page*>::iterator it = updatedPages.begin(); it != updatedPages.end(); ++it)
+			bufMgr->unPinPage(file, it->first, false);
+		bufMgr->setPageWriteHook(file, NULL);
+	} catch(...) {
+	}
+	::close(fd);
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::beforeUpdate
+// -----------------------------------------------------------------------------
+
+void IndexLog::beforeUpdate(const PageId pageNo, Page* page)
+{
+	if(updatedPages.find(pageNo) != updatedPages.end())
+		return;
+
+	beforeImages[pageNo] = *page;
+
+	// Take a pin of our own so the page cannot be written back before its diff is logged.
+	Page* pinned;
+	bufMgr->readPage(file, pageNo, pinned);
+	updatedPages[pageNo] = pinned;
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::commit
+// -----------------------------------------------------------------------------
+
+void IndexLog::commit()
+{
+	for(std::map<PageId, Page*>::iterator it = updatedPages.begin(); it != updatedPages.end(); ++it) {
+		appendDiff(it->first, beforeImages[it->first], *(it->second));
+	}
+
+	LogRecordHeader header;
+	header.type = LOG_COMMIT;
+	header.numRanges = 0;
+	header.pageNo = Page::INVALID_NUMBER;
+	append(header, std::vector<char>());
+
+	for(std::map<PageId, Page*>::iterator it = updatedPages.begin(); it != updatedPages.end(); ++it) {
+		bufMgr->unPinPage(file, it->first, false);
+	}
+	updatedPages.clear();
+	beforeImages.clear();
+
+	// Group commit: one force per groupCommitSize inserts
+	if(++pendingCommits >= groupCommitSize)
+		sync();
+
+	if(nextLsn >= checkpointBytes)
+		checkpoint();
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::appendDiff
+// -----------------------------------------------------------------------------
+
+void IndexLog::appendDiff(const PageId pageNo, const Page& before, const Page& after)
+{
+	const char* oldBytes = reinterpret_cast<const char*>(&before);
+	const char* newBytes = reinterpret_cast<const char*>(&after);
+
+	std::vector<char> payload;
+	std::uint16_t numRanges = 0;
+	std::size_t i = 0;
+	while(i < Page::SIZE) {
+		if(oldBytes[i] == newBytes[i]) {
+			i++;
+			continue;
+		}
+
+		// Grow the range while the next changed byte is close enough to be worth merging
+		std::size_t start = i;
+		std::size_t end = i + 1;
+		for(std::size_t j = end; j < Page::SIZE && j - end < MERGE_GAP; j++) {
+			if(oldBytes[j] != newBytes[j])
+				end = j + 1;
+		}
+
+		std::uint16_t offset = start;
+		std::uint16_t length = end - start;
+		payload.insert(payload.end(), reinterpret_cast<char*>(&offset), reinterpret_cast<char*>(&offset) + sizeof(offset));
+		payload.insert(payload.end(), reinterpret_cast<char*>(&length), reinterpret_cast<char*>(&length) + sizeof(length));
+		payload.insert(payload.end(), newBytes + start, newBytes + end);
+		numRanges++;
+		i = end;
+	}
+
+	if(numRanges == 0)
+		return;
+
+	LogRecordHeader header;
+	header.type = LOG_PAGE_DIFF;
+	header.numRanges = numRanges;
+	header.pageNo = pageNo;
+	pageLsn[pageNo] = append(header, payload);
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::append
+// -----------------------------------------------------------------------------
+
+std::uint64_t IndexLog::append(LogRecordHeader& header, const std::vector<char>& payload)
+{
+	header.length = payload.size();
+	header.checksum = checksum(header, payload.data());
+
+	const char* headerBytes = reinterpret_cast<const char*>(&header);
+	logBuffer.insert(logBuffer.end(), headerBytes, headerBytes + sizeof(LogRecordHeader));
+	logBuffer.insert(logBuffer.end(), payload.begin(), payload.end());
+
+	nextLsn += sizeof(LogRecordHeader) + payload.size();
+	return nextLsn;
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::sync
+// -----------------------------------------------------------------------------
+
+void IndexLog::sync()
+{
+	if(logBuffer.empty())
+		return;
+
+	std::size_t written = 0;
+	while(written < logBuffer.size()) {
+		ssize_t n = ::write(fd, logBuffer.data() + written, logBuffer.size() - written);
+		if(n < 0)
+			throw IndexLogException(logName, "write");
+		written += n;
+	}
+	if(::fdatasync(fd) != 0)
+		throw IndexLogException(logName, "fdatasync");
+
+	logBuffer.clear();
+	durableLsn = nextLsn;
+	pendingCommits = 0;
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::beforePageWrite
+// -----------------------------------------------------------------------------
+
+void IndexLog::beforePageWrite(const PageId pageNo)
+{
+	std::map<PageId, std::uint64_t>::iterator it = pageLsn.find(pageNo);
+	if(it != pageLsn.end() && it->second > durableLsn)
+		sync();
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::checkpoint
+// -----------------------------------------------------------------------------
+
+void IndexLog::checkpoint()
+{
+	sync();
+	bufMgr->flushDirtyPages(file);
+	// the pages have to be on disk, not just handed to the OS, before the log that could redo them is dropped
+	file->sync();
+
+	// Every change described by the log is now in the index file, so the log can start over.
+	if(::ftruncate(fd, 0) != 0)
+		throw IndexLogException(logName, "truncate");
+	nextLsn = durableLsn = 0;
+	pageLsn.clear();
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::recover
+// -----------------------------------------------------------------------------
+
+std::uint32_t IndexLog::recover()
+{
+	std::vector<char> log(durableLsn);
+	std::size_t readBytes = 0;
+	while(readBytes < log.size()) {
+		ssize_t n = ::pread(fd, log.data() + readBytes, log.size() - readBytes, readBytes);
+		if(n < 0)
+			throw IndexLogException(logName, "read");
+		if(n == 0)
+			break;
+		readBytes += n;
+	}
+
+	// Page diffs of the insert being read; applied only once its commit record shows up
+	std::vector<std::size_t> pendingDiffs;
+	std::uint32_t numReplayed = 0;
+	std::size_t pos = 0;
+	while(pos + sizeof(LogRecordHeader) <= readBytes) {
+		LogRecordHeader header;
+		memcpy(&header, &log[pos], sizeof(LogRecordHeader));
+		if(pos + sizeof(LogRecordHeader) + header.length > readBytes ||
+				checksum(header, &log[pos + sizeof(LogRecordHeader)]) != header.checksum)
+			break;
+
+		if(header.type == LOG_PAGE_DIFF) {
+			pendingDiffs.push_back(pos);
+		} else if(header.type == LOG_COMMIT) {
+			for(std::size_t k = 0; k < pendingDiffs.size(); k++) {
+				LogRecordHeader diff;
+				memcpy(&diff, &log[pendingDiffs[k]], sizeof(LogRecordHeader));
+				const char* range = &log[pendingDiffs[k] + sizeof(LogRecordHeader)];
+
+				// The file header is only forced at checkpoints, so pages allocated since then may lie past
+				// the end of the file.  Allocate them again, as the empty pages their first diffs were
+				// taken against.
+				while(diff.pageNo > file->getNumUsedPages()) {
+					PageId newPageNo;
+					Page* newPage;
+					bufMgr->allocPage(file, newPageNo, newPage);
+					bufMgr->unPinPage(file, newPageNo, true);
+				}
+
+				Page* page;
+				bufMgr->readPage(file, diff.pageNo, page);
+				char* bytes = reinterpret_cast<char*>(page);
+				for(std::uint16_t r = 0; r < diff.numRanges; r++) {
+					std::uint16_t offset, length;
+					memcpy(&offset, range, sizeof(offset));
+					memcpy(&length, range + sizeof(offset), sizeof(length));
+					range += sizeof(offset) + sizeof(length);
+					memcpy(bytes + offset, range, length);
+					range += length;
+				}
+				bufMgr->unPinPage(file, diff.pageNo, true);
+			}
+			pendingDiffs.clear();
+			numReplayed++;
+		} else {
+			break;
+		}
+		pos += sizeof(LogRecordHeader) + header.length;
+	}
+
+	checkpoint();
+	return numReplayed;
+}
+
+// -----------------------------------------------------------------------------
+// IndexLog::remove
+// -----------------------------------------------------------------------------
+
+void IndexLog::remove(const std::string& logName)
+{
+	std::remove(logName.c_str());
+}
+
+}
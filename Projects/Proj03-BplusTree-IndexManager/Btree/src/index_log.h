@@ -0,0 +1,246 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Kinds of records stored in an index log.
+ */
+enum LogRecordType
+{
+	LOG_PAGE_DIFF = 1,	/* Changed byte ranges of one index page */
+	LOG_COMMIT = 2			/* End of one insertEntry; its page diffs may be replayed */
+};
+
+/**
+ * @brief Fixed header in front of every record in the index log.
+ * A LOG_PAGE_DIFF payload is numRanges repetitions of (uint16 offset, uint16 length, bytes).
+ * A LOG_COMMIT record has no payload.
+ */
+struct LogRecordHeader
+{
+  /**
+   * FNV-1a checksum of the rest of the header and the payload. A torn record at the
+   * tail of the log fails this check and ends recovery.
+   */
+	std::uint32_t checksum;
+
+  /**
+   * One of LogRecordType.
+   */
+	std::uint16_t type;
+
+  /**
+   * Number of byte ranges in the payload.
+   */
+	std::uint16_t numRanges;
+
+  /**
+   * Page the ranges apply to.
+   */
+	PageId pageNo;
+
+  /**
+   * Payload length in bytes.
+   */
+	std::uint32_t length;
+};
+
+/**
+ * @brief Redo-only write-ahead log for a B+ tree index file.
+ *
+ * Every page an insert is about to modify is registered through beforeUpdate(), which saves a
+ * before-image and keeps the page pinned. When the insert completes, commit() turns each page into
+ * a LOG_PAGE_DIFF record holding only the bytes that changed and closes the insert with a LOG_COMMIT
+ * record. Records are buffered and written with one fdatasync per group of commits, so dirty index
+ * pages can stay cached in the BufMgr instead of being flushed on every insert.
+ *
+ * The log registers itself as the PageWriteHook of the index file, so a page evicted by the buffer
+ * manager is never written before the log records describing it. Redo records are physical byte
+ * ranges, which makes replay idempotent no matter which pages reached disk before a crash.
+ * A checkpoint writes every dirty index page, syncs the index file and truncates the log.
+ *
+ * @warning This class is not threadsafe.
+ */
+class IndexLog : public PageWriteHook
+{
+ public:
+  /**
+   * Number of committed inserts buffered before the log is forced to disk.
+   */
+	static const std::uint32_t DEFAULT_GROUP_COMMIT_SIZE = 64;
+
+  /**
+   * Log size in bytes after which a checkpoint is taken.
+   */
+	static const std::uint64_t DEFAULT_CHECKPOINT_BYTES = 8 * 1024 * 1024;
+
+  /**
+   * Opens (or creates) the log of an index file and hooks it into the buffer manager.
+   *
+   * @param logName           Name of the log file.
+   * @param bufMgrIn          Buffer Manager Instance
+   * @param fileIn            Index file protected by this log.
+   * @param groupCommitSize   Committed inserts per log force.
+   * @param checkpointBytes   Log size that triggers a checkpoint.
+   * @throws  IndexLogException  If the log file cannot be opened.
+   */
+	IndexLog(const std::string& logName, BufMgr* bufMgrIn, File* fileIn,
+					std::uint32_t groupCommitSize = DEFAULT_GROUP_COMMIT_SIZE,
+					std::uint64_t checkpointBytes = DEFAULT_CHECKPOINT_BYTES);
+
+  /**
+   * Unhooks from the buffer manager and closes the log. Does not checkpoint; the owner does that
+   * on a clean shutdown. Never throws.
+   */
+	~IndexLog();
+
+  /**
+   * Registers a page that the current insert is about to modify. Must be called while the page is
+   * pinned and before it is changed. Calling it again for the same page within one insert is a no-op.
+   *
+   * @param pageNo  Page number in the index file.
+   * @param page    The pinned page.
+   */
+	void beforeUpdate(const PageId pageNo, Page* page);
+
+  /**
+   * Ends the current insert: logs the changes of every registered page, releases them, and forces
+   * the log once a full group of inserts has been committed. Checkpoints if the log has grown large.
+   */
+	void commit();
+
+  /**
+   * Forces every buffered log record to disk.
+   * @throws  IndexLogException  If the log cannot be written.
+   */
+	void sync();
+
+  /**
+   * Writes all dirty pages of the index file and empties the log.
+   */
+	void checkpoint();
+
+  /**
+   * Replays every complete insert found in the log into the index file through the buffer manager,
+   * then checkpoints. Stops at the first torn or incomplete record. Pages past the end of the file,
+   * allocated after the last checkpoint by inserts whose file header never reached disk, are
+   * allocated again before their diffs are applied.
+   *
+   * @return  Number of inserts replayed.
+   */
+	std::uint32_t recover();
+
+  /**
+   * Forces the log if it still holds undurable changes of the page (write-ahead rule).
+   *
+   * @param pageNo  Page about to be written by the buffer manager.
+   */
+	void beforePageWrite(const PageId pageNo);
+
+  /**
+   * Deletes the log file. Only safe right after a checkpoint.
+   *
+   * @param logName   Name of the log file.
+   */
+	static void remove(const std::string& logName);
+
+ private:
+  /**
+   * Appends the changed byte ranges of one page to the log buffer.
+   *
+   * @param pageNo  Page number.
+   * @param before  Page contents before the insert.
+   * @param after   Page contents now.
+   */
+	void appendDiff(const PageId pageNo, const Page& before, const Page& after);
+
+  /**
+   * Appends a record to the log buffer and returns its LSN (the byte offset just past it).
+   */
+	std::uint64_t append(LogRecordHeader& header, const std::vector<char>& payload);
+
+  /**
+   * Name of the log file.
+   */
+	std::string logName;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr* bufMgr;
+
+  /**
+   * Index file protected by this log.
+   */
+	File* file;
+
+  /**
+   * File descriptor of the log.
+   */
+	int fd;
+
+  /**
+   * Committed inserts per log force.
+   */
+	std::uint32_t groupCommitSize;
+
+  /**
+   * Log size that triggers a checkpoint.
+   */
+	std::uint64_t checkpointBytes;
+
+  /**
+   * Records not written to disk yet.
+   */
+	std::vector<char> logBuffer;
+
+  /**
+   * LSN of the end of the log, including buffered records.
+   */
+	std::uint64_t nextLsn;
+
+  /**
+   * Every record before this LSN is on disk.
+   */
+	std::uint64_t durableLsn;
+
+  /**
+   * Inserts committed since the last force.
+   */
+	std::uint32_t pendingCommits;
+
+  /**
+   * Before-images of the pages registered by the current insert.
+   */
+	std::map<PageId, Page> beforeImages;
+
+  /**
+   * Pinned pages registered by the current insert.
+   */
+	std::map<PageId, Page*> updatedPages;
+
+  /**
+   * LSN of the last record touching each page changed since the last checkpoint.
+   */
+	std::map<PageId, std::uint64_t> pageLsn;
+};
+
+}
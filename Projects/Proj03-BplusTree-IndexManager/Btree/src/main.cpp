@@ -6,12 +6,25 @@
  */
 
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <random>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
+#include "node_search.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
+#include "bufHashTbl.h"
 #include "exceptions/insufficient_space_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
@@ -19,6 +32,13 @@
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/page_layout_exception.h"
+#include "exceptions/record_length_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/page_not_pinned_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -72,6 +92,7 @@ void intTests();
 void errorCases();
 void scanCases();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int keyScan(BTreeIndex *index, const void* lowVal, Operator lowOp, const void* highVal, Operator highOp);
 void indexTests();
 void largeIndexTests();
 void test_tree();
@@ -82,6 +103,31 @@ void test4();
 void test5();
 void test6();
 void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
 void errorTests();
 void deleteRelation();
 
@@ -155,6 +201,31 @@ int main(int argc, char **argv)
 	test5();
 	test6();
 	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
+	test26();
+	test27();
+	test28();
+	test29();
+	test30();
+	test31();
+	test32();
 
   return 1;
 }
@@ -252,7 +323,8 @@ void test_tree()
 	
 		createRelationForward();
 		int order = 3;
-		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order,
+			false /* useLog */, false /* bulkLoad */);
 
 		// Construct expected result for pre order
 		std::vector<std::vector<int>> expectPreOrder = {
@@ -319,7 +391,8 @@ void test_tree()
 	{ // Backward case
 		createRelationBackward();
 		int order = 3;
-		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order,
+			false /* useLog */, false /* bulkLoad */);
 
 		// Construct expected result for pre order
 		std::vector<std::vector<int>> expectPreOrder = {
@@ -453,6 +526,161 @@ void test7()
 	
 }
 
+void test8()
+{
+	// Build a logged index, insert more keys and die without flushing the buffer pool.
+	// Reopening the index has to replay the log to find the new keys. Small nodes make the inserts split leaves and
+	// non-leaf nodes, so that a commit spans several pages and the pool evicts logged pages along the way.
+	std::cout << "--------------------------------" << std::endl;
+	std::cout << "Test 8: index log crash recovery" << std::endl;
+	relationSize = 1000;
+	createRelationForward();
+	const int order = 8;
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	std::cout << std::flush;
+	pid_t pid = fork();
+	if(pid == 0)
+	{
+		// Only the forking thread lives on in the child, so the prefetch threads of bufMgr are gone while its
+		// mutexes and condition variables still count them; the child works through a buffer manager of its own.
+		BufMgr* childBufMgr = new BufMgr(100);
+		std::vector<RecordId> rids;
+		{
+			FileScan fscan(relationName, childBufMgr);
+			try
+			{
+				RecordId scanRid;
+				while(1)
+				{
+					fscan.scanNext(scanRid);
+					rids.push_back(scanRid);
+				}
+			}
+			catch(EndOfFileException e)
+			{
+			}
+		}
+
+		BTreeIndex* index = new BTreeIndex(relationName, intIndexName, childBufMgr, offsetof(tuple,i), INTEGER,
+			order, order, true /* useLog */);
+		for(int i = 0; i < relationSize; i++)
+		{
+			int key = relationSize + i;
+			index->insertEntry(&key, rids[i]);
+		}
+		index->syncLog();
+		_exit(0);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER,
+			order, order, true /* useLog */);
+		checkPassFail((index.getHeight() >= 4), true)
+		checkPassFail(index.getNumKeys(), (std::uint64_t)(2 * relationSize))
+		checkPassFail(intScan(&index, 0, GTE, 2 * relationSize, LT), 2 * relationSize)
+		checkPassFail(intScan(&index, relationSize, GTE, relationSize + 10, LT), 10)
+	}
+	if(File::exists(intIndexName + ".log"))
+	{
+		std::cout << "\nTest FAILS at line no:" << __LINE__ << std::endl;
+		exit(1);
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	std::cout << "Test 8: index log crash recovery Passed" << std::endl;
+}
+
+void test9()
+{
+	// Bulk load through a buffer pool too small to sort the relation in memory, leaving room in every
+	// node, then keep inserting into the bulk loaded tree.
+	std::cout << "------------------------------------" << std::endl;
+	std::cout << "Test 9: bulk load with external sort" << std::endl;
+	relationSize = 20000;
+	createRelationRandom();
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	BufMgr* smallBufMgr = new BufMgr(10);
+	{
+		BTreeIndex index(relationName, intIndexName, smallBufMgr, offsetof(tuple,i), INTEGER,
+			INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE, false /* useLog */, true /* bulkLoad */, 0.7 /* fillFactor */);
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(intScan(&index, 9000, GTE, 12000, LTE), 3001)
+
+		int key = 0;
+		RecordId zeroRid;
+		index.startScan(&key, GTE, &key, LTE);
+		index.scanNext(zeroRid);
+		index.endScan();
+		for(key = relationSize; key < relationSize + 100; key++)
+		{
+			index.insertEntry(&key, zeroRid);
+		}
+		checkPassFail(intScan(&index, relationSize, GTE, relationSize + 100, LT), 100)
+		checkPassFail(intScan(&index, 0, GTE, relationSize + 100, LT), relationSize + 100)
+	}
+	delete smallBufMgr;
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+
+	// A fill factor so low that every node gets as few entries as it can: still two children or more in every
+	// non-leaf node, that is no node without a key. The same relation inserted a tuple at a time, the
+	// default, scans the same.
+	relationSize = 1000;
+	createRelationForward();
+	const int order = 8;
+	for(int bulkLoad = 1; bulkLoad >= 0; bulkLoad--)
+	{
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order,
+				false /* useLog */, bulkLoad == 1, 0.01 /* fillFactor */);
+			checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+			checkPassFail(intScan(&index, 500, GTE, 600, LT), 100)
+			std::vector<std::vector<int>> preOrder = index.getTreePreOrder();
+			int emptyNodes = 0;
+			for(std::size_t i = 0; i < preOrder.size(); i++)
+			{
+				if(preOrder[i].empty())
+					emptyNodes++;
+			}
+			checkPassFail(emptyNodes, 0)
+		}
+		File::remove(intIndexName);
+	}
+	deleteRelation();
+	std::cout << "Test 9: bulk load with external sort Passed" << std::endl;
+}
+
 void scanCases()
 {
 	
@@ -829,6 +1057,35 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 	return numResults;
 }
 
+// Counts the entries of a scan over an index of any key type, with no output
+int keyScan(BTreeIndex * index, const void* lowVal, Operator lowOp, const void* highVal, Operator highOp)
+{
+	RecordId scanRid;
+	int numResults = 0;
+	try
+	{
+		index->startScan(lowVal, lowOp, highVal, highOp);
+	}
+	catch(NoSuchKeyFoundException e)
+	{
+		return 0;
+	}
+	while(1)
+	{
+		try
+		{
+			index->scanNext(scanRid);
+		}
+		catch(IndexScanCompletedException e)
+		{
+			break;
+		}
+		numResults++;
+	}
+	index->endScan();
+	return numResults;
+}
+
 
 // -----------------------------------------------------------------------------
 // errorTests
@@ -1004,3 +1261,2077 @@ void deleteRelation()
 		std::cout << "remove " << relationName  << "failed" << std::endl;
 	}
 }
+
+/**
+ * Creates a page file of numPages pages, each holding one record: its own page number.
+ */
+std::vector<PageId> createNumberedPages(const std::string& fileName, const int numPages)
+{
+	try
+	{
+		File::remove(fileName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	std::vector<PageId> pageIds;
+	PageFile file = PageFile::create(fileName);
+	for(int i = 0; i < numPages; i++)
+	{
+		PageId pageNo;
+		Page page = file.allocatePage(pageNo);
+		page.insertRecord(std::to_string(pageNo));
+		file.writePage(pageNo, page);
+		pageIds.push_back(pageNo);
+	}
+	return pageIds;
+}
+
+/**
+ * Returns the frame a hash table maps a page to, or -1 if the page is not in the table.
+ */
+int frameOf(const BufHashTbl& table, const File* file, const PageId pageNo)
+{
+	FrameId frameNo;
+	if(!table.tryLookup(file, pageNo, frameNo))
+		return -1;
+	return frameNo;
+}
+
+void test10()
+{
+	// Robin Hood probing moves entries around as others are inserted and removed. Every entry stays findable,
+	// and a page that is not in the table is a miss, reported through the return value of tryLookup.
+	std::cout << "--------------------------" << std::endl;
+	std::cout << "Test 10: buffer hash table" << std::endl;
+	const std::string hashName = "relA.hash";
+	createNumberedPages(hashName, 1);
+	{
+		// two File objects, so the table holds the same page numbers for two files
+		PageFile fileA = PageFile::open(hashName);
+		PageFile fileB = PageFile::open(hashName);
+
+		// 12 entries in 16 buckets: probe sequences run into each other and entries get displaced
+		BufHashTbl small(8);
+		for(PageId pageNo = 1; pageNo <= 6; pageNo++)
+		{
+			small.insert(&fileA, pageNo, pageNo);
+			small.insert(&fileB, pageNo, 100 + pageNo);
+		}
+		for(PageId pageNo = 1; pageNo <= 6; pageNo++)
+		{
+			checkPassFail(frameOf(small, &fileA, pageNo), (int)pageNo)
+			checkPassFail(frameOf(small, &fileB, pageNo), (int)(100 + pageNo))
+		}
+		checkPassFail(frameOf(small, &fileA, 7), -1)
+		checkPassFail(frameOf(small, &fileB, 0), -1)
+
+		// removing shifts the entries after it back; the rest are still found
+		for(PageId pageNo = 1; pageNo <= 6; pageNo += 2)
+			small.remove(&fileA, pageNo);
+		for(PageId pageNo = 1; pageNo <= 6; pageNo++)
+		{
+			checkPassFail(frameOf(small, &fileA, pageNo), (pageNo % 2 == 1) ? -1 : (int)pageNo)
+			checkPassFail(frameOf(small, &fileB, pageNo), (int)(100 + pageNo))
+		}
+
+		bool thrown = false;
+		try
+		{
+			small.remove(&fileA, 1);
+		}
+		catch(HashNotFoundException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+		thrown = false;
+		try
+		{
+			small.insert(&fileB, 2, 0);
+		}
+		catch(HashAlreadyPresentException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+		checkPassFail(frameOf(small, &fileB, 2), 102)
+
+		// a table far too small for its entries keeps growing
+		BufHashTbl large(4);
+		for(PageId pageNo = 1; pageNo <= 1000; pageNo++)
+			large.insert(&fileA, pageNo, pageNo % 97);
+		for(PageId pageNo = 3; pageNo <= 1000; pageNo += 3)
+			large.remove(&fileA, pageNo);
+		int found = 0;
+		for(PageId pageNo = 1; pageNo <= 1000; pageNo++)
+		{
+			const int frameNo = frameOf(large, &fileA, pageNo);
+			if(frameNo == ((pageNo % 3 == 0) ? -1 : (int)(pageNo % 97)))
+				found++;
+		}
+		checkPassFail(found, 1000)
+	}
+	File::remove(hashName);
+	std::cout << "Test 10: buffer hash table Passed" << std::endl;
+}
+
+void test11()
+{
+	// Threads reading pages through a pool much smaller than the file always get the page they asked for, and
+	// every pin is counted: a page pinned once by each thread takes exactly that many unpins.
+	std::cout << "----------------------------------" << std::endl;
+	std::cout << "Test 11: concurrent buffer manager" << std::endl;
+	const std::string pinName = "relA.pins";
+	std::vector<PageId> pageIds = createNumberedPages(pinName, 64);
+	const int numThreads = 4;
+	const std::uint32_t numBufs = 16;
+	BufMgr* pinBufMgr = new BufMgr(numBufs, 4);
+	{
+		PageFile file = PageFile::open(pinName);
+		std::atomic<int> errors(0);
+		std::vector<std::thread> workers;
+		for(int t = 0; t < numThreads; t++)
+		{
+			workers.push_back(std::thread([&pinBufMgr, &file, &pageIds, &errors, t]() {
+				std::mt19937 rng(t + 1);
+				for(int i = 0; i < 5000; i++)
+				{
+					const PageId pageNo = pageIds[rng() % pageIds.size()];
+					const RecordId rid = {pageNo, 1};
+					Page* page;
+					pinBufMgr->readPage(&file, pageNo, page);
+					if(page->getRecord(rid) != std::to_string(pageNo))
+						errors++;
+					pinBufMgr->unPinPage(&file, pageNo, false);
+				}
+			}));
+		}
+		for(int t = 0; t < numThreads; t++)
+			workers[t].join();
+		checkPassFail(errors.load(), 0)
+
+		workers.clear();
+		for(int t = 0; t < numThreads; t++)
+		{
+			workers.push_back(std::thread([&pinBufMgr, &file, &pageIds]() {
+				Page* page;
+				pinBufMgr->readPage(&file, pageIds[0], page);
+			}));
+		}
+		for(int t = 0; t < numThreads; t++)
+			workers[t].join();
+		for(int t = 0; t < numThreads; t++)
+			pinBufMgr->unPinPage(&file, pageIds[0], false);
+		bool thrown = false;
+		try
+		{
+			pinBufMgr->unPinPage(&file, pageIds[0], false);
+		}
+		catch(PageNotPinnedException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		// A read that fails gives its frame back, also when other threads found the page while it was being read;
+		// they fail the same way.
+		std::atomic<int> failures(0);
+		workers.clear();
+		for(int t = 0; t < numThreads; t++)
+		{
+			workers.push_back(std::thread([&pinBufMgr, &file, &failures]() {
+				try
+				{
+					Page* page;
+					pinBufMgr->readPage(&file, 1000, page);
+				}
+				catch(InvalidPageException e)
+				{
+					failures++;
+				}
+			}));
+		}
+		for(int t = 0; t < numThreads; t++)
+			workers[t].join();
+		checkPassFail(failures.load(), numThreads)
+
+		thrown = false;
+		try
+		{
+			for(std::uint32_t i = 0; i < numBufs; i++)
+			{
+				Page* page;
+				pinBufMgr->readPage(&file, pageIds[i], page);
+			}
+		}
+		catch(BufferExceededException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, false)
+		for(std::uint32_t i = 0; i < numBufs; i++)
+			pinBufMgr->unPinPage(&file, pageIds[i], false);
+
+		// throws if a pin was lost
+		pinBufMgr->flushFile(&file);
+	}
+	delete pinBufMgr;
+	File::remove(pinName);
+	std::cout << "Test 11: concurrent buffer manager Passed" << std::endl;
+}
+
+void test12()
+{
+	// Three pages fill a pool of three frames, the first and the third are hit, and a fourth page comes in.
+	// Clock and 2Q evict the first page, which came in first; LRU-2 and ARC evict the second, the only one seen once.
+	std::cout << "-----------------------------" << std::endl;
+	std::cout << "Test 12: replacement policies" << std::endl;
+	const std::string policyName = "relA.policy";
+	std::vector<PageId> pageIds = createNumberedPages(policyName, 4);
+	const ReplacementPolicyType policyTypes[] = {CLOCK, LRU_K, TWO_Q, ARC};
+	const int victims[] = {0, 1, 0, 1};
+	{
+		PageFile file = PageFile::open(policyName);
+		for(int i = 0; i < 4; i++)
+		{
+			BufMgr policyBufMgr(3, 1, policyTypes[i]);
+			const int accesses[] = {0, 1, 2, 0, 2, 3};
+			for(int j = 0; j < 6; j++)
+			{
+				Page* page;
+				policyBufMgr.readPage(&file, pageIds[accesses[j]], page);
+				policyBufMgr.unPinPage(&file, pageIds[accesses[j]], false);
+			}
+
+			policyBufMgr.clearBufStats();
+			for(int j = 0; j < 3; j++)
+			{
+				if(j == victims[i])
+					continue;
+				Page* page;
+				policyBufMgr.readPage(&file, pageIds[j], page);
+				policyBufMgr.unPinPage(&file, pageIds[j], false);
+			}
+			checkPassFail(policyBufMgr.getBufStats().diskreads, 0)
+
+			Page* page;
+			policyBufMgr.readPage(&file, pageIds[victims[i]], page);
+			policyBufMgr.unPinPage(&file, pageIds[victims[i]], false);
+			checkPassFail(policyBufMgr.getBufStats().diskreads, 1)
+			policyBufMgr.flushFile(&file);
+		}
+	}
+	File::remove(policyName);
+	std::cout << "Test 12: replacement policies Passed" << std::endl;
+}
+
+/**
+ * Returns true if every page of a file holds, as its first record, the page number followed by ":" and round.
+ */
+bool pagesOnDiskAt(const std::string& fileName, const std::vector<PageId>& pageIds, const int round)
+{
+	PageFile file = PageFile::open(fileName);
+	for(std::size_t i = 0; i < pageIds.size(); i++)
+	{
+		const RecordId rid = {pageIds[i], 1};
+		if(file.readPage(pageIds[i]).getRecord(rid) != std::to_string(pageIds[i]) + ":" + std::to_string(round))
+			return false;
+	}
+	return true;
+}
+
+void test13()
+{
+	// The background writer writes pages while they keep being changed. Once it has caught up, the file holds the
+	// last version of every page, as it also does after flushFile.
+	std::cout << "---------------------------------" << std::endl;
+	std::cout << "Test 13: background page writer" << std::endl;
+	const std::string writerName = "relA.writer";
+	std::vector<PageId> pageIds = createNumberedPages(writerName, 24);
+	BufMgr* writerBufMgr = new BufMgr(32);
+	{
+		PageFile file = PageFile::open(writerName);
+		writerBufMgr->startBackgroundWriter(0.0, 8, 1);
+		const int numRounds = 20;
+		for(int round = 0; round < numRounds; round++)
+		{
+			for(std::size_t i = 0; i < pageIds.size(); i++)
+			{
+				const RecordId rid = {pageIds[i], 1};
+				Page* page;
+				writerBufMgr->readPage(&file, pageIds[i], page);
+				writerBufMgr->latchPage(page, true);
+				page->updateRecord(rid, std::to_string(pageIds[i]) + ":" + std::to_string(round));
+				writerBufMgr->unlatchPage(page, true);
+				writerBufMgr->unPinPage(&file, pageIds[i], true);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(2));
+		}
+
+		// every page is unpinned, so the writer cleans them all
+		bool caughtUp = false;
+		for(int wait = 0; wait < 5000 && !caughtUp; wait++)
+		{
+			caughtUp = pagesOnDiskAt(writerName, pageIds, numRounds - 1);
+			if(!caughtUp)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		checkPassFail(caughtUp, true)
+		checkPassFail((writerBufMgr->getBufStats().backgroundWrites > 0), true)
+
+		writerBufMgr->flushFile(&file);
+		checkPassFail(pagesOnDiskAt(writerName, pageIds, numRounds - 1), true)
+		writerBufMgr->stopBackgroundWriter();
+	}
+	delete writerBufMgr;
+	File::remove(writerName);
+	std::cout << "Test 13: background page writer Passed" << std::endl;
+}
+
+void test14()
+{
+	// Pages read ahead by prefetch() are hits when they are read.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 14: prefetched pages" << std::endl;
+	const std::string prefetchName = "relA.prefetch";
+	std::vector<PageId> pageIds = createNumberedPages(prefetchName, 32);
+	BufMgr* prefetchBufMgr = new BufMgr(64);
+	{
+		PageFile file = PageFile::open(prefetchName);
+		std::vector<PageId> ahead(pageIds.begin(), pageIds.begin() + 16);
+		prefetchBufMgr->prefetch(&file, ahead);
+		for(int wait = 0; wait < 5000 && prefetchBufMgr->getBufStats().prefetchReads < 16; wait++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		checkPassFail(prefetchBufMgr->getBufStats().prefetchReads, 16)
+
+		prefetchBufMgr->clearBufStats();
+		int matching = 0;
+		for(std::size_t i = 0; i < ahead.size(); i++)
+		{
+			const RecordId rid = {ahead[i], 1};
+			Page* page;
+			prefetchBufMgr->readPage(&file, ahead[i], page);
+			if(page->getRecord(rid) == std::to_string(ahead[i]))
+				matching++;
+			prefetchBufMgr->unPinPage(&file, ahead[i], false);
+		}
+		checkPassFail(matching, 16)
+		checkPassFail(prefetchBufMgr->getBufStats().hits, 16)
+		checkPassFail(prefetchBufMgr->getBufStats().diskreads, 0)
+
+		// the rest was not asked for
+		Page* page;
+		prefetchBufMgr->readPage(&file, pageIds[16], page);
+		prefetchBufMgr->unPinPage(&file, pageIds[16], false);
+		checkPassFail(prefetchBufMgr->getBufStats().diskreads, 1)
+		prefetchBufMgr->flushFile(&file);
+	}
+	delete prefetchBufMgr;
+	File::remove(prefetchName);
+	std::cout << "Test 14: prefetched pages Passed" << std::endl;
+}
+
+void test15()
+{
+	// Threads with File objects of their own on one file read and write their pages at the same time. Positioned
+	// reads and writes share no file offset, so no thread reads or writes another thread's page.
+	std::cout << "-----------------------------" << std::endl;
+	std::cout << "Test 15: positioned file I/O" << std::endl;
+	const std::string ioName = "relA.io";
+	std::vector<PageId> pageIds = createNumberedPages(ioName, 64);
+	const int numThreads = 4;
+	const int numRounds = 20;
+	{
+		std::vector<PageFile> files;
+		for(int t = 0; t < numThreads; t++)
+			files.push_back(PageFile::open(ioName));
+
+		std::atomic<int> errors(0);
+		std::vector<std::thread> workers;
+		for(int t = 0; t < numThreads; t++)
+		{
+			workers.push_back(std::thread([&files, &pageIds, &errors, t, numThreads, numRounds]() {
+				for(int round = 0; round < numRounds; round++)
+				{
+					for(std::size_t i = t; i < pageIds.size(); i += numThreads)
+					{
+						const RecordId rid = {pageIds[i], 1};
+						Page page = files[t].readPage(pageIds[i]);
+						const std::string expected = std::to_string(pageIds[i]) +
+							(round == 0 ? "" : ":" + std::to_string(round - 1));
+						if(page.getRecord(rid) != expected)
+							errors++;
+						page.updateRecord(rid, std::to_string(pageIds[i]) + ":" + std::to_string(round));
+						files[t].writePage(pageIds[i], page);
+					}
+				}
+			}));
+		}
+		for(int t = 0; t < numThreads; t++)
+			workers[t].join();
+		checkPassFail(errors.load(), 0)
+	}
+	checkPassFail(pagesOnDiskAt(ioName, pageIds, numRounds - 1), true)
+	File::remove(ioName);
+	std::cout << "Test 15: positioned file I/O Passed" << std::endl;
+}
+
+void test16()
+{
+	// Pages written through the buffer manager are in the file after flushFile with every durability. The setting
+	// is shared by the File objects open on the file, and goes back to FLUSH once the file is closed.
+	std::cout << "--------------------------" << std::endl;
+	std::cout << "Test 16: durability modes" << std::endl;
+	const std::string durableName = "relA.durable";
+	const Durability modes[] = {NONE, FLUSH, FSYNC_ON_FLUSHFILE, DSYNC};
+	for(int i = 0; i < 4; i++)
+	{
+		std::vector<PageId> pageIds = createNumberedPages(durableName, 8);
+		{
+			PageFile file = PageFile::open(durableName);
+			PageFile other = PageFile::open(durableName);
+			checkPassFail(file.durability(), FLUSH)
+			file.setDurability(modes[i]);
+			checkPassFail(other.durability(), modes[i])
+
+			for(std::size_t j = 0; j < pageIds.size(); j++)
+			{
+				const RecordId rid = {pageIds[j], 1};
+				Page* page;
+				bufMgr->readPage(&file, pageIds[j], page);
+				page->updateRecord(rid, std::to_string(pageIds[j]) + ":" + std::to_string(i));
+				bufMgr->unPinPage(&file, pageIds[j], true);
+			}
+			bufMgr->flushFile(&file);
+			checkPassFail(pagesOnDiskAt(durableName, pageIds, i), true)
+		}
+		{
+			PageFile file = PageFile::open(durableName);
+			checkPassFail(file.durability(), FLUSH)
+		}
+		File::remove(durableName);
+	}
+	std::cout << "Test 16: durability modes Passed" << std::endl;
+}
+
+/**
+ * Returns the numbers of the used pages of a file in the order FileIterator visits them.
+ */
+std::vector<PageId> usedPages(PageFile& file)
+{
+	std::vector<PageId> pages;
+	for(FileIterator iter = file.begin(); iter != file.end(); ++iter)
+		pages.push_back((*iter).page_number());
+	return pages;
+}
+
+/**
+ * Returns true if the used pages of a file are exactly 1 to count, in order.
+ */
+bool usedPagesInOrder(PageFile& file, const PageId count)
+{
+	std::vector<PageId> pages = usedPages(file);
+	if(pages.size() != count)
+		return false;
+	for(PageId i = 0; i < count; i++)
+	{
+		if(pages[i] != i + 1)
+			return false;
+	}
+	return true;
+}
+
+void test17()
+{
+	// Deleted pages are reused and relinked in page order, both in new files and in files
+	// written in the original format without a tail pointer or allocation maps.
+	std::cout << "--------------------------------------" << std::endl;
+	std::cout << "Test 17: page allocation and legacy files" << std::endl;
+	const std::string legacyName = relationName + ".legacy";
+	const PageId numPages = 50;
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	try
+	{
+		File::remove(legacyName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile file = PageFile::create(relationName);
+		for(PageId i = 1; i <= numPages; i++)
+		{
+			PageId pageNo;
+			Page page = file.allocatePage(pageNo);
+			page.insertRecord(std::to_string(pageNo));
+			file.writePage(pageNo, page);
+		}
+		checkPassFail(usedPagesInOrder(file, numPages), true)
+
+		// Free pages in the middle, at the head and at the tail, then take them all back.
+		const PageId deleted[] = {10, 20, 1, 30, numPages};
+		for(PageId pageNo : deleted)
+			file.deletePage(pageNo);
+		checkPassFail(usedPages(file).size(), numPages - 5)
+		checkPassFail(usedPages(file).front(), 2)
+		checkPassFail(usedPages(file).back(), numPages - 1)
+		for(int i = 0; i < 5; i++)
+		{
+			PageId pageNo;
+			Page page = file.allocatePage(pageNo);
+			page.insertRecord(std::to_string(pageNo));
+			file.writePage(pageNo, page);
+		}
+		checkPassFail(usedPagesInOrder(file, numPages), true)
+
+		// With the free list empty the next page goes on the tail.
+		PageId pageNo;
+		file.allocatePage(pageNo);
+		checkPassFail(pageNo, numPages + 1)
+		checkPassFail(usedPagesInOrder(file, numPages + 1), true)
+	}
+	{
+		PageFile file = PageFile::open(relationName);
+		checkPassFail(usedPagesInOrder(file, numPages + 1), true)
+		int matching = 0;
+		for(FileIterator iter = file.begin(); iter != file.end(); ++iter)
+		{
+			Page page = *iter;
+			if(page.begin() != page.end() && *page.begin() == std::to_string(page.page_number()))
+				matching++;
+		}
+		checkPassFail(matching, numPages)
+
+		// Copy the first 20 pages into a file in the original format: a 16 byte header
+		// followed directly by the pages.
+		const PageId legacyPages = 20;
+		std::ifstream in(relationName, std::ios::binary);
+		std::ofstream out(legacyName, std::ios::binary);
+		const PageId legacyHeader[4] = {legacyPages + 1 /* num_pages */, 1 /* first_used_page */,
+																		0 /* num_free_pages */, 0 /* first_free_page */};
+		out.write(reinterpret_cast<const char*>(legacyHeader), sizeof(legacyHeader));
+		Page page;
+		for(PageId i = 1; i <= legacyPages; i++)
+		{
+			in.seekg(file.pagePosition(i), std::ios::beg);
+			in.read(reinterpret_cast<char*>(&page), Page::SIZE);
+			if(i == legacyPages)
+			{
+				// Page 20 ends the used list of the copy.
+				memset(reinterpret_cast<char*>(&page) + offsetof(PageHeader, next_page_number), 0,
+										sizeof(PageId));
+			}
+			out.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+		}
+	}
+
+	{
+		PageFile legacy = PageFile::open(legacyName);
+		checkPassFail(legacy.pagePosition(2), (off_t)(sizeof(PageId) * 4 + Page::SIZE))
+		checkPassFail(usedPagesInOrder(legacy, 20), true)
+		legacy.deletePage(7);
+		legacy.deletePage(20);
+		PageId pageNo;
+		legacy.allocatePage(pageNo);
+		checkPassFail(pageNo, 20)
+		legacy.allocatePage(pageNo);
+		checkPassFail(pageNo, 7)
+		legacy.allocatePage(pageNo);
+		checkPassFail(pageNo, 21)
+		checkPassFail(usedPagesInOrder(legacy, 21), true)
+	}
+	{
+		PageFile legacy = PageFile::open(legacyName);
+		checkPassFail(usedPagesInOrder(legacy, 21), true)
+		Page page = legacy.readPage(3);
+		checkPassFail(*page.begin(), std::to_string(3))
+	}
+
+	File::remove(legacyName);
+	File::remove(relationName);
+	std::cout << "Test 17: page allocation and legacy files Passed" << std::endl;
+}
+
+/**
+ * Returns the file header of a page file as it is on disk.
+ */
+FileHeader headerOnDisk(const std::string& fileName)
+{
+	FileHeader header;
+	std::ifstream in(fileName, std::ios::binary);
+	in.seekg(sizeof(File::MAPPED_FORMAT_MAGIC), std::ios::beg);
+	in.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+	return header;
+}
+
+void test18()
+{
+	// File objects open on the same file share one header in memory, which reaches the disk
+	// on flushFile and on the last close.
+	std::cout << "----------------------------" << std::endl;
+	std::cout << "Test 18: cached file headers" << std::endl;
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		PageFile file = PageFile::create(relationName);
+		PageId pageNo;
+		for(int i = 0; i < 3; i++)
+			file.allocatePage(pageNo);
+		checkPassFail(headerOnDisk(relationName).num_pages, 1)
+
+		PageFile alias = PageFile::open(relationName);
+		Page page = alias.readPage(3);
+		checkPassFail(page.page_number(), 3)
+		alias.allocatePage(pageNo);
+		checkPassFail(pageNo, 4)
+		checkPassFail(usedPagesInOrder(file, 4), true)
+
+		bufMgr->flushFile(&file);
+		checkPassFail(headerOnDisk(relationName).num_pages, 5)
+		checkPassFail(headerOnDisk(relationName).last_used_page, 4)
+
+		file.deletePage(2);
+		checkPassFail(headerOnDisk(relationName).num_free_pages, 0)
+	}
+	checkPassFail(headerOnDisk(relationName).num_free_pages, 1)
+	checkPassFail(headerOnDisk(relationName).first_free_page, 2)
+	{
+		PageFile file = PageFile::open(relationName);
+		checkPassFail(usedPages(file).size(), 3)
+
+		// the header is read and flushed by one thread while pages are allocated through the pool by another
+		std::atomic<bool> done(false);
+		bool ordered = true;
+		PageFile alias = PageFile::open(relationName);
+		std::thread reader([&alias, &done, &ordered]() {
+			PageId last = 0;
+			while(!done)
+			{
+				const PageId used = alias.getNumUsedPages();
+				ordered = ordered && used >= last;
+				last = used;
+				alias.flushHeader();
+			}
+		});
+		for(int i = 0; i < 200; i++)
+		{
+			PageId pageNo;
+			bufMgr->allocPage(&file, pageNo).markDirty();
+		}
+		done = true;
+		reader.join();
+		checkPassFail(ordered, true)
+		bufMgr->flushFile(&file);
+		checkPassFail(file.getNumUsedPages(), 203)
+		checkPassFail(headerOnDisk(relationName).num_pages, 204)
+	}
+
+	File::remove(relationName);
+	std::cout << "Test 18: cached file headers Passed" << std::endl;
+}
+
+void test19()
+{
+	// readPageInto fills a page in place with what readPage returns, and turns down the same pages: deleted ones,
+	// the header of a blob file and pages past the end. A buffer manager read of such a page pins nothing.
+	std::cout << "----------------------------" << std::endl;
+	std::cout << "Test 19: reads into a frame" << std::endl;
+	const std::string intoName = "relA.into";
+	const std::string blobName = "relA.blob";
+	std::vector<PageId> pageIds = createNumberedPages(intoName, 8);
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		PageFile file = PageFile::open(intoName);
+		file.deletePage(pageIds[3]);
+
+		const RecordId rid = {pageIds[2], 1};
+		Page page;
+		file.readPageInto(pageIds[2], page);
+		checkPassFail(page.getRecord(rid), file.readPage(pageIds[2]).getRecord(rid))
+		checkPassFail(page.page_number(), pageIds[2])
+
+		int thrown = 0;
+		const PageId missing[] = {pageIds[3], pageIds[7] + 100};
+		for(int i = 0; i < 2; i++)
+		{
+			try
+			{
+				file.readPageInto(missing[i], page);
+			}
+			catch(InvalidPageException e)
+			{
+				thrown++;
+			}
+			try
+			{
+				Page* framePage;
+				bufMgr->readPage(&file, missing[i], framePage);
+			}
+			catch(InvalidPageException e)
+			{
+				thrown++;
+			}
+		}
+		checkPassFail(thrown, 4)
+		// throws if a failed read left a pin behind
+		bufMgr->flushFile(&file);
+
+		BlobFile blob = BlobFile::create(blobName);
+		PageId blobPageNo;
+		blob.allocatePage(blobPageNo);
+		blob.readPageInto(blobPageNo, page);
+		thrown = 0;
+		const PageId blobMissing[] = {Page::INVALID_NUMBER, blobPageNo + 1};
+		for(int i = 0; i < 2; i++)
+		{
+			try
+			{
+				blob.readPageInto(blobMissing[i], page);
+			}
+			catch(InvalidPageException e)
+			{
+				thrown++;
+			}
+		}
+		checkPassFail(thrown, 2)
+	}
+	File::remove(blobName);
+	File::remove(intoName);
+	std::cout << "Test 19: reads into a frame Passed" << std::endl;
+}
+
+void test20()
+{
+	// Record views read the same bytes as the copying accessors, in place on the page.
+	std::cout << "---------------------------" << std::endl;
+	std::cout << "Test 20: record views" << std::endl;
+	relationSize = 2000;
+	createRelationRandom();
+
+	int numRecords = 0;
+	int matching = 0;
+	{
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				std::string_view view = fscan.getRecordView();
+				if(view == fscan.getRecord() && view.size() == sizeof(RECORD))
+					matching++;
+				numRecords++;
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+	}
+	checkPassFail(numRecords, relationSize)
+	checkPassFail(matching, relationSize)
+
+	{
+		Page page = file1->readPage(file1->getFirstPageNo());
+		const char* begin = reinterpret_cast<const char*>(&page);
+		int numPageRecords = 0;
+		int pageMatching = 0;
+		for(PageIterator iter = page.begin(); iter != page.end(); ++iter)
+		{
+			std::string_view view = iter.getRecordView();
+			if(view == *iter && view.data() > begin && view.data() + view.size() <= begin + Page::SIZE)
+				pageMatching++;
+			numPageRecords++;
+		}
+		checkPassFail((numPageRecords > 0), true)
+		checkPassFail(pageMatching, numPageRecords)
+	}
+
+	deleteRelation();
+	std::cout << "Test 20: record views Passed" << std::endl;
+}
+
+void test21()
+{
+	// Random inserts, updates and deletes of records of varying length on one page. Deleted records
+	// leave holes that are only compacted when an insert needs the space, and freed slots are reused.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 21: page record churn" << std::endl;
+	Page page;
+	const std::uint16_t emptyFreeSpace = page.getFreeSpace();
+	std::map<SlotId, std::string> expected;
+	std::mt19937 rng(13);
+	int mismatches = 0;
+
+	for(int op = 0; op < 20000; op++)
+	{
+		std::string record(rng() % 200, (char)('a' + op % 26));
+		const unsigned choice = rng() % 3;
+		if(choice == 0 || expected.empty())
+		{
+			if(!page.hasSpaceForRecord(record))
+				continue;
+			RecordId newRid = page.insertRecord(record);
+			if(expected.count(newRid.slot_number) != 0)
+				mismatches++;
+			expected[newRid.slot_number] = record;
+		}
+		else
+		{
+			std::map<SlotId, std::string>::iterator it = expected.begin();
+			std::advance(it, rng() % expected.size());
+			RecordId oldRid = {page.page_number(), it->first};
+			if(choice == 1)
+			{
+				page.deleteRecord(oldRid);
+				expected.erase(it);
+			}
+			else
+			{
+				try
+				{
+					page.updateRecord(oldRid, record);
+					it->second = record;
+				}
+				catch(InsufficientSpaceException e)
+				{
+				}
+			}
+		}
+	}
+
+	for(std::map<SlotId, std::string>::iterator it = expected.begin(); it != expected.end(); ++it)
+	{
+		RecordId checkRid = {page.page_number(), it->first};
+		if(page.getRecordView(checkRid) != it->second)
+			mismatches++;
+	}
+	int numRecords = 0;
+	for(PageIterator iter = page.begin(); iter != page.end(); ++iter)
+		numRecords++;
+	checkPassFail(numRecords, (int)expected.size())
+	checkPassFail(mismatches, 0)
+
+	// Emptying the page gives back all of its space, slots included.
+	while(!expected.empty())
+	{
+		RecordId lastRid = {page.page_number(), expected.begin()->first};
+		page.deleteRecord(lastRid);
+		expected.erase(expected.begin());
+	}
+	checkPassFail(page.getFreeSpace(), emptyFreeSpace)
+	checkPassFail((page.begin() == page.end()), true)
+
+	// A page left full of holes still takes one record as large as all of them.
+	std::vector<RecordId> rids;
+	std::string small(100, 'x');
+	while(page.hasSpaceForRecord(small))
+		rids.push_back(page.insertRecord(small));
+	for(std::size_t i = 0; i < rids.size(); i += 2)
+		page.deleteRecord(rids[i]);
+	std::string large(page.getFreeSpace(), 'y');
+	checkPassFail(page.hasSpaceForRecord(large), true)
+	RecordId largeRid = page.insertRecord(large);
+	checkPassFail((page.getRecordView(largeRid) == large), true)
+	checkPassFail((page.getRecordView(rids[1]) == small), true)
+
+	// A page as earlier builds wrote it: a 16 byte header, the slot array at the start of the data
+	// and no trailer.  It is full, with no room to add a trailer until a record is deleted.
+	const std::string legacyName = relationName + ".legacy";
+	const std::uint16_t oldLength = 30;
+	const SlotId numOld = Page::DATA_SIZE / (oldLength + sizeof(PageSlot));
+	try
+	{
+		File::remove(legacyName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	{
+		char block[Page::SIZE] = {};
+		PageHeader* oldHeader = reinterpret_cast<PageHeader*>(block);
+		PageSlot* oldSlots = reinterpret_cast<PageSlot*>(block + sizeof(PageHeader));
+		char* oldData = block + sizeof(PageHeader);
+		std::uint16_t upper = Page::DATA_SIZE;
+		for(SlotId i = 0; i < numOld; i++)
+		{
+			upper -= oldLength;
+			oldSlots[i].used = true;
+			oldSlots[i].item_offset = upper;
+			oldSlots[i].item_length = oldLength;
+			memset(oldData + upper, 'a' + i % 26, oldLength);
+		}
+		oldHeader->free_space_lower_bound = numOld * sizeof(PageSlot);
+		oldHeader->free_space_upper_bound = upper;
+		oldHeader->num_slots = numOld;
+		oldHeader->num_free_slots = 0;
+		oldHeader->current_page_number = 1;
+		oldHeader->next_page_number = Page::INVALID_NUMBER;
+		const PageId legacyHeader[4] = {2 /* num_pages */, 1 /* first_used_page */,
+																		0 /* num_free_pages */, 0 /* first_free_page */};
+		std::ofstream out(legacyName, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(legacyHeader), sizeof(legacyHeader));
+		out.write(block, Page::SIZE);
+	}
+	{
+		PageFile legacy = PageFile::open(legacyName);
+		Page oldPage = legacy.readPage(1);
+		checkPassFail(oldPage.getNumRecords(), numOld)
+		int oldMismatches = 0;
+		for(SlotId i = 1; i <= numOld; i++)
+		{
+			RecordId oldRid = {1, i};
+			if(oldPage.getRecordView(oldRid) != std::string(oldLength, 'a' + (i - 1) % 26))
+				oldMismatches++;
+		}
+		checkPassFail(oldMismatches, 0)
+		checkPassFail(oldPage.hasSpaceForRecord(std::string(oldLength, 'z')), false)
+
+		// The first delete closes its hole at once, the second leaves a hole behind, and the
+		// insert reuses the lowest free slot.
+		RecordId oldRid = {1, 5};
+		oldPage.deleteRecord(oldRid);
+		oldRid.slot_number = 100;
+		oldPage.deleteRecord(oldRid);
+		RecordId newRid = oldPage.insertRecord(std::string(oldLength, 'z'));
+		checkPassFail(newRid.slot_number, 5)
+		legacy.writePage(1, oldPage);
+	}
+	{
+		PageFile legacy = PageFile::open(legacyName);
+		Page oldPage = legacy.readPage(1);
+		checkPassFail(oldPage.getNumRecords(), numOld - 1)
+		int oldMismatches = 0;
+		for(SlotId i = 1; i <= numOld; i++)
+		{
+			if(i == 100)
+				continue;
+			RecordId oldRid = {1, i};
+			const std::string oldRecord(oldLength, i == 5 ? 'z' : 'a' + (i - 1) % 26);
+			if(oldPage.getRecordView(oldRid) != oldRecord)
+				oldMismatches++;
+		}
+		checkPassFail(oldMismatches, 0)
+	}
+	File::remove(legacyName);
+
+	std::cout << "Test 21: page record churn Passed" << std::endl;
+}
+
+void test22()
+{
+	// A page file created with a record length gets fixed-length pages: an occupancy bitmap
+	// and a dense array of records, with no slot directory, so more records fit on a page.
+	std::cout << "--------------------------------" << std::endl;
+	std::cout << "Test 22: fixed-length record pages" << std::endl;
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	relationSize = 5000;
+	file1 = new PageFile(relationName, true, sizeof(RECORD));
+	checkPassFail(file1->record_length(), sizeof(RECORD))
+
+	memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+	Page new_page = file1->allocatePage(new_page_number);
+	std::vector<RecordId> rids;
+	for(int i = 0; i < relationSize; i++)
+	{
+		sprintf(record1.s, "%05d string record", i);
+		record1.i = i;
+		record1.d = (double)i;
+		std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+		if(!new_page.hasSpaceForRecord(new_data))
+		{
+			file1->writePage(new_page_number, new_page);
+			new_page = file1->allocatePage(new_page_number);
+		}
+		rids.push_back(new_page.insertRecord(new_data));
+	}
+	file1->writePage(new_page_number, new_page);
+
+	// More records per page than a slotted page holds.
+	Page slotted;
+	int slottedCapacity = 0;
+	std::string sample(reinterpret_cast<char*>(&record1), sizeof(record1));
+	while(slotted.hasSpaceForRecord(sample))
+	{
+		slotted.insertRecord(sample);
+		slottedCapacity++;
+	}
+	checkPassFail(rids[0].page_number, rids[Page::fixedCapacity(sizeof(RECORD)) - 1].page_number)
+	checkPassFail((Page::fixedCapacity(sizeof(RECORD)) > slottedCapacity), true)
+
+	// Records of another length are refused.
+	{
+		Page page = file1->readPage(rids[0].page_number);
+		bool thrown = false;
+		try
+		{
+			page.insertRecord("short");
+		}
+		catch(RecordLengthException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		// Deleted records free their slot for the next insert, which reuses the lowest one.
+		page.deleteRecord(rids[3]);
+		page.deleteRecord(rids[1]);
+		record1.i = -1;
+		std::string replacement(reinterpret_cast<char*>(&record1), sizeof(record1));
+		RecordId reused = page.insertRecord(replacement);
+		checkPassFail(reused.slot_number, rids[1].slot_number)
+		checkPassFail((page.getRecordView(reused) == replacement), true)
+		int numPageRecords = 0;
+		for(PageIterator iter = page.begin(); iter != page.end(); ++iter)
+			numPageRecords++;
+		checkPassFail(numPageRecords, Page::fixedCapacity(sizeof(RECORD)) - 1)
+
+		// Updating writes the new record over the old one.
+		record1.i = -2;
+		std::string update(reinterpret_cast<char*>(&record1), sizeof(record1));
+		page.updateRecord(rids[0], update);
+		checkPassFail((page.getRecord(rids[0]) == update), true)
+	}
+
+	int numRecords = 0;
+	{
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				if(fscan.getRecordView().size() == sizeof(RECORD))
+					numRecords++;
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+	}
+	checkPassFail(numRecords, relationSize)
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER,
+			INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE, false /* useLog */);
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+		checkPassFail(intScan(&index, 100, GTE, 200, LT), 100)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	std::cout << "Test 22: fixed-length record pages Passed" << std::endl;
+}
+
+void test23()
+{
+	// A PAX page file stores each page's records column by column. Records read back whole, a
+	// column scan reads one minipage, and an index builds over it like over any other relation.
+	std::cout << "--------------------" << std::endl;
+	std::cout << "Test 23: PAX pages" << std::endl;
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	relationSize = 5000;
+	// i and its padding, d, s
+	const std::vector<std::uint16_t> widths = {offsetof(RECORD, d), sizeof(double), sizeof(record1.s)};
+	file1 = new PageFile(PageFile::create(relationName, widths));
+	checkPassFail((file1->column_widths() == widths), true)
+	checkPassFail(file1->record_length(), sizeof(RECORD))
+
+	memset(&record1, ' ', sizeof(record1));
+	PageId new_page_number;
+	Page new_page = file1->allocatePage(new_page_number);
+	checkPassFail(new_page.num_columns(), 3)
+	std::vector<RecordId> rids;
+	for(int i = 0; i < relationSize; i++)
+	{
+		sprintf(record1.s, "%05d string record", i);
+		record1.i = i;
+		record1.d = (double)i;
+		std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+		if(!new_page.hasSpaceForRecord(new_data))
+		{
+			file1->writePage(new_page_number, new_page);
+			new_page = file1->allocatePage(new_page_number);
+		}
+		rids.push_back(new_page.insertRecord(new_data));
+	}
+	file1->writePage(new_page_number, new_page);
+	checkPassFail(rids[0].page_number, rids[Page::paxCapacity(3, widths.data()) - 1].page_number)
+
+	{
+		Page page = file1->readPage(rids[7].page_number);
+		RECORD rec = *reinterpret_cast<const RECORD*>(page.getRecord(rids[7]).data());
+		checkPassFail(rec.i, 7)
+		checkPassFail((std::string(rec.s) == "00007 string record"), true)
+		std::string_view d = page.getColumnView(rids[7], 1);
+		checkPassFail(d.size(), sizeof(double))
+		checkPassFail(*reinterpret_cast<const double*>(d.data()), 7.0)
+
+		bool thrown = false;
+		try
+		{
+			page.getRecordView(rids[7]);
+		}
+		catch(PageLayoutException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		// Records written over and into freed slots are scattered to the minipages too.
+		page.deleteRecord(rids[2]);
+		record1.i = -1;
+		record1.d = -1.0;
+		std::string replacement(reinterpret_cast<char*>(&record1), sizeof(record1));
+		RecordId reused = page.insertRecord(replacement);
+		checkPassFail(reused.slot_number, rids[2].slot_number)
+		checkPassFail((page.getRecord(reused) == replacement), true)
+		page.updateRecord(rids[3], replacement);
+		checkPassFail(*reinterpret_cast<const double*>(page.getColumnView(rids[3], 1).data()), -1.0)
+	}
+
+	int numRecords = 0;
+	int inOrder = 0;
+	{
+		FileScan fscan(relationName, bufMgr);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				std::string_view view = fscan.getRecordView();
+				if(view.size() == sizeof(RECORD) && reinterpret_cast<const RECORD*>(view.data())->i == numRecords)
+					inOrder++;
+				numRecords++;
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+	}
+	checkPassFail(numRecords, relationSize)
+	checkPassFail(inOrder, relationSize)
+
+	double sum = 0;
+	numRecords = 0;
+	{
+		FileScan fscan(relationName, bufMgr);
+		fscan.projectColumn(1);
+		try
+		{
+			RecordId scanRid;
+			while(1)
+			{
+				fscan.scanNext(scanRid);
+				sum += *reinterpret_cast<const double*>(fscan.getRecordView().data());
+				numRecords++;
+			}
+		}
+		catch(EndOfFileException e)
+		{
+		}
+	}
+	checkPassFail(numRecords, relationSize)
+	checkPassFail(sum, (double)relationSize * (relationSize - 1) / 2)
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER,
+			INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE, false /* useLog */);
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+		checkPassFail(intScan(&index, 100, GTE, 200, LT), 100)
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	std::cout << "Test 23: PAX pages Passed" << std::endl;
+}
+
+/**
+ * Returns the number of records of the relation a scan with the given predicate returns, and checks every one of
+ * them satisfies it.
+ */
+int filteredCount(const ScanPredicate& predicate)
+{
+	int numRecords = 0;
+	FileScan fscan(relationName, bufMgr);
+	fscan.setPredicate(predicate);
+	try
+	{
+		RecordId scanRid;
+		while(1)
+		{
+			fscan.scanNext(scanRid);
+			if(!predicate.matches(fscan.getRecord()))
+				return -1;
+			numRecords++;
+		}
+	}
+	catch(EndOfFileException e)
+	{
+	}
+	return numRecords;
+}
+
+void test24()
+{
+	// Scan predicates are evaluated page by page inside FileScan, on row and PAX pages alike.
+	std::cout << "---------------------------" << std::endl;
+	std::cout << "Test 24: scan predicates" << std::endl;
+	relationSize = 5000;
+	for(int layout = 0; layout < 2; layout++)
+	{
+		if(layout == 0)
+		{
+			createRelationForward();
+		}
+		else
+		{
+			file1 = new PageFile(PageFile::create(relationName, {offsetof(RECORD, d), sizeof(double), sizeof(record1.s)}));
+			PageId new_page_number;
+			Page new_page = file1->allocatePage(new_page_number);
+			for(int i = 0; i < relationSize; i++)
+			{
+				sprintf(record1.s, "%05d string record", i);
+				record1.i = i;
+				record1.d = (double)i;
+				std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+				if(!new_page.hasSpaceForRecord(new_data))
+				{
+					file1->writePage(new_page_number, new_page);
+					new_page = file1->allocatePage(new_page_number);
+				}
+				new_page.insertRecord(new_data);
+			}
+			file1->writePage(new_page_number, new_page);
+		}
+
+		checkPassFail(filteredCount(ScanPredicate()), relationSize)
+		checkPassFail(filteredCount(ScanPredicate().addInt(offsetof(RECORD, i), GTE, 1000).addInt(offsetof(RECORD, i), LT, 1100)), 100)
+		checkPassFail(filteredCount(ScanPredicate().addDouble(offsetof(RECORD, d), GT, relationSize - 9.5)), 9)
+		checkPassFail(filteredCount(ScanPredicate().addString(offsetof(RECORD, s), 5, EQ, "00042")), 1)
+		checkPassFail(filteredCount(ScanPredicate().addInt(offsetof(RECORD, i), NE, 7)), relationSize - 1)
+		checkPassFail(filteredCount(ScanPredicate().addInt(offsetof(RECORD, i), LT, 0)), 0)
+		// A field straddling two PAX columns is read from the whole record.
+		checkPassFail(filteredCount(ScanPredicate().addInt(offsetof(RECORD, d) - 2, NE, 0x7fffffff)), relationSize)
+		deleteRelation();
+	}
+
+	// A record too short for a field fails the comparison.
+	checkPassFail(ScanPredicate().addInt(0, GTE, 0).matches(std::string_view("ab")), false)
+	std::cout << "Test 24: scan predicates Passed" << std::endl;
+}
+
+void test25()
+{
+	// A parallel scan returns every record exactly once, split over the sinks of its workers.
+	std::cout << "---------------------------" << std::endl;
+	std::cout << "Test 25: parallel file scan" << std::endl;
+	relationSize = 5000;
+	createRelationForward();
+	bufMgr->flushFile(file1);
+
+	const int numWorkers = 4;
+	for(std::size_t morselPages = 1; morselPages <= 64; morselPages *= 8)
+	{
+		std::vector<std::vector<int>> seen(numWorkers);
+		std::vector<ParallelFileScan::RecordSink> sinks;
+		for(int w = 0; w < numWorkers; w++)
+		{
+			std::vector<int>* keys = &seen[w];
+			sinks.push_back([keys](const RecordId& rid, std::string_view record) {
+				keys->push_back(reinterpret_cast<const RECORD*>(record.data())->i);
+			});
+		}
+		ParallelFileScan pscan(relationName, bufMgr, morselPages);
+		pscan.run(sinks);
+
+		std::vector<int> all;
+		for(int w = 0; w < numWorkers; w++)
+			all.insert(all.end(), seen[w].begin(), seen[w].end());
+		std::sort(all.begin(), all.end());
+		int distinct = std::unique(all.begin(), all.end()) - all.begin();
+		checkPassFail((int)all.size(), relationSize)
+		checkPassFail(distinct, relationSize)
+	}
+
+	// With a predicate, and a sink that fails part way through.
+	{
+		std::atomic<int> count(0);
+		std::vector<ParallelFileScan::RecordSink> sinks(3, [&count](const RecordId& rid, std::string_view record) {
+			count++;
+		});
+		ParallelFileScan pscan(relationName, bufMgr, 2);
+		pscan.setPredicate(ScanPredicate().addInt(offsetof(RECORD, i), LT, 1000));
+		pscan.run(sinks);
+		checkPassFail(count.load(), 1000)
+
+		bool thrown = false;
+		pscan.setPredicate(ScanPredicate());
+		std::fill(sinks.begin(), sinks.end(), [](const RecordId& rid, std::string_view record) {
+			if(reinterpret_cast<const RECORD*>(record.data())->i == 2500)
+				throw EndOfFileException();
+		});
+		try
+		{
+			pscan.run(sinks);
+		}
+		catch(EndOfFileException e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+	}
+
+	// A file in the original format has no allocation maps, and its page chain is followed instead.
+	{
+		const std::string legacyName = relationName + ".legacy";
+		const PageId legacyPages = 10;
+		int legacyRecords = 0;
+		{
+			std::ofstream out(legacyName, std::ios::binary);
+			const PageId legacyHeader[4] = {legacyPages + 1 /* num_pages */, 1 /* first_used_page */,
+																			0 /* num_free_pages */, 0 /* first_free_page */};
+			out.write(reinterpret_cast<const char*>(legacyHeader), sizeof(legacyHeader));
+			for(PageId i = 1; i <= legacyPages; i++)
+			{
+				Page page = file1->readPage(i);
+				for(PageIterator it = page.begin(); it != page.end(); ++it)
+					legacyRecords++;
+				if(i == legacyPages)
+				{
+					// Page 10 ends the used list of the copy.
+					memset(reinterpret_cast<char*>(&page) + offsetof(PageHeader, next_page_number), 0,
+											sizeof(PageId));
+				}
+				out.write(reinterpret_cast<const char*>(&page), Page::SIZE);
+			}
+		}
+
+		std::atomic<int> count(0);
+		std::vector<ParallelFileScan::RecordSink> sinks(3, [&count](const RecordId& rid, std::string_view record) {
+			count++;
+		});
+		{
+			ParallelFileScan pscan(legacyName, bufMgr, 2);
+			pscan.run(sinks);
+		}
+		checkPassFail(count.load(), legacyRecords)
+		File::remove(legacyName);
+	}
+
+	// Pages deleted in the middle of the file leave holes in the allocation maps, which the listing steps over.
+	{
+		int deletedRecords = 0;
+		for(PageId pageNo = 2; pageNo <= 8; pageNo += 3)
+		{
+			Page* page;
+			bufMgr->readPage(file1, pageNo, page);
+			for(PageIterator it = page->begin(); it != page->end(); ++it)
+				deletedRecords++;
+			bufMgr->unPinPage(file1, pageNo, false);
+			bufMgr->disposePage(file1, pageNo);
+		}
+
+		std::atomic<int> count(0);
+		std::atomic<bool> deletedSeen(false);
+		std::vector<ParallelFileScan::RecordSink> sinks(3, [&count, &deletedSeen](const RecordId& rid,
+																																							std::string_view record) {
+			count++;
+			if(rid.page_number % 3 == 2 && rid.page_number <= 8)
+				deletedSeen = true;
+		});
+		ParallelFileScan pscan(relationName, bufMgr, 2);
+		pscan.run(sinks);
+		checkPassFail(count.load(), relationSize - deletedRecords)
+		checkPassFail(deletedSeen.load(), false)
+	}
+
+	// Every page was unpinned, or this throws.
+	deleteRelation();
+	std::cout << "Test 25: parallel file scan Passed" << std::endl;
+}
+
+void test26()
+{
+	// Batches come a page at a time, never more than asked for, and the end of the scan is a return value.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 26: batch file scan" << std::endl;
+	relationSize = 5000;
+	createRelationForward();
+
+	for(std::size_t max = 1; max <= 1000; max *= 10)
+	{
+		FileScan fscan(relationName, bufMgr);
+		std::vector<RecordId> rids;
+		std::vector<std::string_view> records;
+		int numRecords = 0;
+		int inOrder = 0;
+		int bad = 0;
+		while(fscan.scanNextBatch(rids, records, max))
+		{
+			if(rids.empty() || rids.size() > max || records.size() != rids.size())
+				bad++;
+			for(std::size_t i = 0; i < rids.size(); i++)
+			{
+				if(rids[i].page_number != rids[0].page_number)
+					bad++;
+				if(reinterpret_cast<const RECORD*>(records[i].data())->i == numRecords)
+					inOrder++;
+				numRecords++;
+			}
+		}
+		checkPassFail(numRecords, relationSize)
+		checkPassFail(inOrder, relationSize)
+		checkPassFail(bad, 0)
+		checkPassFail(fscan.scanNextBatch(rids, records, max), false)
+		checkPassFail(rids.size(), 0)
+	}
+
+	// Batches and single records mix, and batches honour the predicate.
+	{
+		FileScan fscan(relationName, bufMgr);
+		fscan.setPredicate(ScanPredicate().addInt(offsetof(RECORD, i), GTE, 10));
+		std::vector<RecordId> rids;
+		RecordId scanRid;
+		fscan.scanNext(scanRid);
+		checkPassFail(reinterpret_cast<const RECORD*>(fscan.getRecordView().data())->i, 10)
+		checkPassFail(fscan.scanNextBatch(rids, 5), true)
+		checkPassFail(rids.size(), 5)
+		checkPassFail(reinterpret_cast<const RECORD*>(fscan.getRecordView().data())->i, 15)
+		fscan.scanNext(scanRid);
+		checkPassFail(reinterpret_cast<const RECORD*>(fscan.getRecordView().data())->i, 16)
+		int numRecords = 1;
+		while(fscan.scanNextBatch(rids, 1000))
+			numRecords += rids.size();
+		checkPassFail(numRecords, relationSize - 16)
+	}
+
+	deleteRelation();
+	std::cout << "Test 26: batch file scan Passed" << std::endl;
+}
+
+void test27()
+{
+	// A scan of a relation much bigger than the pool reads through a ring and leaves the pages of another file alone.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 27: scan-resistant buffer ring" << std::endl;
+	relationSize = 20000;
+	createRelationForward();
+
+	const std::string hotName = "relA.hot";
+	try
+	{
+		File::remove(hotName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	BufMgr* ringBufMgr = new BufMgr(64);
+	{
+		PageFile hotFile = PageFile::create(hotName);
+		std::vector<PageId> hotPages;
+		for(int i = 0; i < 16; i++)
+		{
+			PageId pageNo;
+			Page* page;
+			ringBufMgr->allocPage(&hotFile, pageNo, page);
+			ringBufMgr->unPinPage(&hotFile, pageNo, true);
+			hotPages.push_back(pageNo);
+		}
+		ringBufMgr->flushDirtyPages(&hotFile);
+
+		int numRecords = 0;
+		{
+			FileScan fscan(relationName, ringBufMgr);
+			RecordId scanRid;
+			try
+			{
+				while(1)
+				{
+					fscan.scanNext(scanRid);
+					numRecords++;
+				}
+			}
+			catch(EndOfFileException e)
+			{
+			}
+		}
+		checkPassFail(numRecords, relationSize)
+
+		// every page of the hot file is still in the pool
+		ringBufMgr->clearBufStats();
+		for(std::size_t i = 0; i < hotPages.size(); i++)
+		{
+			Page* page;
+			ringBufMgr->readPage(&hotFile, hotPages[i], page);
+			ringBufMgr->unPinPage(&hotFile, hotPages[i], false);
+		}
+		checkPassFail(ringBufMgr->getBufStats().diskreads, 0)
+
+		ringBufMgr->flushFile(&hotFile);
+	}
+	delete ringBufMgr;
+
+	File::remove(hotName);
+	deleteRelation();
+	std::cout << "Test 27: scan-resistant buffer ring Passed" << std::endl;
+}
+
+void test28()
+{
+	// Page guards unpin on scope exit, on move assignment and when an exception passes through them.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 28: page guards" << std::endl;
+
+	const std::string guardName = "relA.guard";
+	try
+	{
+		File::remove(guardName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	BufMgr* guardBufMgr = new BufMgr(10);
+	{
+		PageFile guardFile = PageFile::create(guardName);
+		PageId pageNo;
+		{
+			PageGuard page = guardBufMgr->allocPage(&guardFile, pageNo);
+			page->insertRecord("guarded record");
+			page.markDirty();
+
+			PageGuard moved = std::move(page);
+			checkPassFail(page.isPinned(), false)
+			checkPassFail(moved.isPinned(), true)
+			checkPassFail(moved.getPageNo(), pageNo)
+		}
+		// nothing is left pinned, and the dirty page reached the file
+		guardBufMgr->flushFile(&guardFile);
+		checkPassFail(guardFile.readPage(pageNo).getRecord({pageNo, 1}), std::string("guarded record"))
+
+		int unpinned = 0;
+		try
+		{
+			PageGuard page = guardBufMgr->readPage(&guardFile, pageNo);
+			throw EndOfFileException();
+		}
+		catch(EndOfFileException e)
+		{
+			unpinned = 1;
+		}
+		checkPassFail(unpinned, 1)
+		guardBufMgr->flushFile(&guardFile);
+
+		// release() unpins at once and only once; assigning over a guard unpins its page
+		{
+			PageGuard page = guardBufMgr->readPage(&guardFile, pageNo);
+			page.release();
+			page.release();
+			checkPassFail((page.get() == NULL), true)
+			page = guardBufMgr->readPage(&guardFile, pageNo);
+			page = guardBufMgr->readPage(&guardFile, pageNo);
+		}
+		guardBufMgr->flushFile(&guardFile);
+	}
+	File::remove(guardName);
+
+	// Scans that fail to start leave nothing pinned in a pool of ten frames.
+	relationSize = 5000;
+	createRelationForward();
+	{
+		BTreeIndex index(relationName, intIndexName, guardBufMgr, offsetof(tuple,i), INTEGER);
+		int failed = 0;
+		for(int i = 0; i < 100; i++)
+		{
+			int low = relationSize + i;
+			int high = relationSize + 1000;
+			try
+			{
+				index.startScan(&low, GTE, &high, LTE);
+			}
+			catch(NoSuchKeyFoundException e)
+			{
+				failed++;
+			}
+		}
+		checkPassFail(failed, 100)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	}
+	delete guardBufMgr;
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	std::cout << "Test 28: page guards Passed" << std::endl;
+}
+
+void test29()
+{
+	// The shape of the tree survives a reopen, and the counters kept on split match a walk of the tree.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 29: persisted tree shape" << std::endl;
+	relationSize = 2000;
+	createRelationRandom();
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	const int order = 8;
+	int height, numLeafNodes, numNonLeafNodes;
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order,
+			false /* useLog */, false /* bulkLoad */);
+		height = index.getHeight();
+		numLeafNodes = index.getNumLeafNodes();
+		numNonLeafNodes = index.getNumNonLeafNodes();
+		checkPassFail((height >= 3), true)
+		checkPassFail(index.getNumKeys(), (std::uint64_t)relationSize)
+		checkPassFail(index.getTreePreOrder().size(), (std::size_t)(numLeafNodes + numNonLeafNodes))
+		checkPassFail((index.getLeafFill() > 0.5 && index.getLeafFill() <= 1), true)
+		checkPassFail((index.getNonLeafFill() > 0.5 && index.getNonLeafFill() <= 1), true)
+	}
+
+	{
+		// the root is not taken for a leaf: lookups work right after the reopen
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order,
+			false /* useLog */, false /* bulkLoad */);
+		checkPassFail(index.getHeight(), height)
+		checkPassFail(index.getNumLeafNodes(), numLeafNodes)
+		checkPassFail(index.getNumNonLeafNodes(), numNonLeafNodes)
+		checkPassFail(index.getNumKeys(), (std::uint64_t)relationSize)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+
+		RecordId rid = {1, 1};
+		for(int key = relationSize; key < relationSize + 500; key++)
+			index.insertEntry(&key, rid);
+		numLeafNodes = index.getNumLeafNodes();
+		numNonLeafNodes = index.getNumNonLeafNodes();
+		checkPassFail(index.getNumKeys(), (std::uint64_t)(relationSize + 500))
+		checkPassFail(index.getTreePreOrder().size(), (std::size_t)(numLeafNodes + numNonLeafNodes))
+	}
+
+	{
+		// opened with the default orders, the index keeps splitting at the orders it was built with
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		checkPassFail(index.getNumLeafNodes(), numLeafNodes)
+		checkPassFail(index.getNumKeys(), (std::uint64_t)(relationSize + 500))
+		checkPassFail(intScan(&index, 0, GTE, relationSize + 500, LT), relationSize + 500)
+
+		RecordId rid = {1, 1};
+		for(int key = relationSize + 500; key < relationSize + 1000; key++)
+			index.insertEntry(&key, rid);
+		checkPassFail((index.getNumLeafNodes() >= numLeafNodes + 500 / order), true)
+		checkPassFail(intScan(&index, 0, GTE, relationSize + 1000, LT), relationSize + 1000)
+	}
+
+	{
+		// orders that do not fit the nodes of the key type are rejected on open
+		BlobFile indexFile(intIndexName, false);
+		Page metaPage = indexFile.readPage(indexFile.first_page_number());
+		reinterpret_cast<IndexMetaInfo*>(&metaPage)->leafOccupancy = INTARRAYLEAFSIZE + 1;
+		indexFile.writePage(indexFile.first_page_number(), metaPage);
+	}
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		std::cout << "\nTest FAILS at line no:" << __LINE__ << std::endl;
+		exit(1);
+	}
+	catch(BadIndexInfoException e)
+	{
+	}
+
+	{
+		// so is an index written with another node layout, such as the 1023-key INTEGER non-leaf nodes of version 1
+		BlobFile indexFile(intIndexName, false);
+		Page metaPage = indexFile.readPage(indexFile.first_page_number());
+		reinterpret_cast<IndexMetaInfo*>(&metaPage)->leafOccupancy = order;
+		reinterpret_cast<IndexMetaInfo*>(&metaPage)->layoutVersion = 1;
+		indexFile.writePage(indexFile.first_page_number(), metaPage);
+	}
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		std::cout << "\nTest FAILS at line no:" << __LINE__ << std::endl;
+		exit(1);
+	}
+	catch(BadIndexInfoException e)
+	{
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	// A bulk load counts its levels and entries too.
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order,
+			false /* useLog */, true /* bulkLoad */);
+		checkPassFail(index.getNumKeys(), (std::uint64_t)relationSize)
+		checkPassFail(index.getLeafFill(), 1.0)
+		checkPassFail(index.getTreePreOrder().size(),
+			(std::size_t)(index.getNumLeafNodes() + index.getNumNonLeafNodes()))
+		checkPassFail(index.getHeight(), 4)
+	}
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, order, order);
+		checkPassFail(index.getHeight(), 4)
+		checkPassFail(intScan(&index, 25, GT, 40, LT), 14)
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	std::cout << "Test 29: persisted tree shape Passed" << std::endl;
+}
+
+void test30()
+{
+	// Every node search kernel the CPU runs agrees with std::upper_bound and std::lower_bound, duplicates included.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 30: node search kernels" << std::endl;
+	const NodeSearch::Kernel kernels[] = {NodeSearch::LINEAR, NodeSearch::BINARY, NodeSearch::SSE, NodeSearch::AVX2};
+	const int lengths[] = {0, 1, 2, 7, 8, 9, 31, 32, 33, 100, INTARRAYLEAFSIZE, INTARRAYNONLEAFSIZE};
+	std::mt19937 rng(22);
+	int wrong = 0;
+	int checked = 0;
+	for(int length : lengths)
+	{
+		std::vector<int> keys(length);
+		for(int i = 0; i < length; i++)
+			keys[i] = (int)(rng() % (2 * length + 1)) - length;
+		std::sort(keys.begin(), keys.end());
+		for(int key = -length - 2; key <= length + 2; key++)
+		{
+			int upper = std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+			int lower = std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+			for(NodeSearch::Kernel kernel : kernels)
+			{
+				if(!NodeSearch::supported(kernel))
+					continue;
+				if(NodeSearch::upperBound(kernel, keys.data(), length, key) != upper)
+					wrong++;
+				if(NodeSearch::lowerBound(kernel, keys.data(), length, key) != lower)
+					wrong++;
+				checked++;
+			}
+			if(NodeSearch::upperBound(keys.data(), length, key) != upper
+				|| NodeSearch::lowerBound(keys.data(), length, key) != lower)
+				wrong++;
+		}
+	}
+	checkPassFail(wrong, 0)
+	checkPassFail((checked > 0), true)
+	checkPassFail(NodeSearch::upperBound(NULL, -1, 5), 0)
+	std::cout << "Test 30: node search kernels Passed" << std::endl;
+}
+
+void test31()
+{
+	// DOUBLE and STRING attributes get trees of their own key type, whether inserted one at a time or bulk loaded.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 31: DOUBLE and STRING keys" << std::endl;
+	relationSize = 3000;
+	createRelationRandom();
+	const int order = 8;
+
+	for(int bulkLoad = 0; bulkLoad < 2; bulkLoad++)
+	{
+		try
+		{
+			File::remove(doubleIndexName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		{
+			BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE, order, order,
+				false /* useLog */, bulkLoad == 1);
+			checkPassFail((index.getHeight() >= 3), true)
+			checkPassFail(index.getNumKeys(), (std::uint64_t)relationSize)
+			double low = 25, high = 40;
+			checkPassFail(keyScan(&index, &low, GT, &high, LT), 14)
+			checkPassFail(keyScan(&index, &low, GTE, &high, LTE), 16)
+			low = 0.5;
+			high = 1.5;
+			checkPassFail(keyScan(&index, &low, GTE, &high, LTE), 1)
+			low = 2999;
+			high = 1e9;
+			checkPassFail(keyScan(&index, &low, GT, &high, LT), 0)
+		}
+		{
+			// reopened, then keys around zero and NaN go in where the total order puts them
+			BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE, order, order);
+			checkPassFail(index.getNumKeys(), (std::uint64_t)relationSize)
+			RecordId rid = {1, 1};
+			const double extra[] = {-2.5, -0.0, std::numeric_limits<double>::quiet_NaN(),
+				-std::numeric_limits<double>::infinity()};
+			for(double key : extra)
+				index.insertEntry(&key, rid);
+			double low = -10, high = 0.0;
+			checkPassFail(keyScan(&index, &low, GTE, &high, LT), 2)
+			low = -std::numeric_limits<double>::infinity();
+			high = std::numeric_limits<double>::infinity();
+			checkPassFail(keyScan(&index, &low, GTE, &high, LTE), relationSize + 3)
+			high = std::numeric_limits<double>::quiet_NaN();
+			checkPassFail(keyScan(&index, &low, GT, &high, LTE), relationSize + 3)
+			bool threw = false;
+			try
+			{
+				index.getTreePreOrder();
+			}
+			catch(BadIndexInfoException e)
+			{
+				threw = true;
+			}
+			checkPassFail(threw, true)
+		}
+
+		try
+		{
+			File::remove(stringIndexName);
+		}
+		catch(FileNotFoundException e)
+		{
+		}
+		{
+			// keys are the first STRINGSIZE characters, "00025 stri" for record 25
+			BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, order, order,
+				false /* useLog */, bulkLoad == 1);
+			checkPassFail((index.getHeight() >= 3), true)
+			checkPassFail(index.getNumKeys(), (std::uint64_t)relationSize)
+			checkPassFail(keyScan(&index, "00025", GTE, "00040", LT), 15)
+			checkPassFail(keyScan(&index, "00025 string record", GT, "00040", LT), 14)
+			checkPassFail(keyScan(&index, "00025 stri", GTE, "00025 stri", LTE), 1)
+			checkPassFail(keyScan(&index, "", GTE, "99999", LTE), relationSize)
+			checkPassFail(keyScan(&index, "1", GTE, "2", LT), 0)
+		}
+		{
+			BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, order, order);
+			checkPassFail(index.getNumKeys(), (std::uint64_t)relationSize)
+			RecordId rid = {1, 1};
+			index.insertEntry("00030", rid);
+			index.insertEntry("zzzzzzzzzzzzzzzz", rid);
+			checkPassFail(keyScan(&index, "00025", GTE, "00040", LT), 16)
+			checkPassFail(keyScan(&index, "", GTE, "zzzzzzzzzz", LTE), relationSize + 2)
+		}
+	}
+
+	{
+		// the default orders fill nodes of the key type, which hold fewer doubles than ints
+		File::remove(doubleIndexName);
+		BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE,
+			INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE, false /* useLog */, true /* bulkLoad */);
+		checkPassFail(index.getNumLeafNodes(), (relationSize + LeafNodeDouble::CAPACITY - 1) / LeafNodeDouble::CAPACITY)
+		double low = 0, high = relationSize;
+		checkPassFail(keyScan(&index, &low, GTE, &high, LT), relationSize)
+	}
+
+	File::remove(doubleIndexName);
+	File::remove(stringIndexName);
+	deleteRelation();
+	std::cout << "Test 31: DOUBLE and STRING keys Passed" << std::endl;
+}
+
+void test32()
+{
+	// Cursors scan one index at once, each from its own leaf, next to the scan of the index itself.
+	std::cout << "-------------------------" << std::endl;
+	std::cout << "Test 32: independent index cursors" << std::endl;
+	relationSize = 5000;
+	createRelationRandom();
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		IndexCursor first(&index);
+		IndexCursor second(&index);
+		int low1 = 25, high1 = 40, low2 = 1000, high2 = 3000;
+		first.startScan(&low1, GTE, &high1, LT);
+		second.startScan(&low2, GT, &high2, LTE);
+		checkPassFail(intScan(&index, 2000, GTE, 2010, LT), 10)
+
+		// interleaved, every cursor returns its own range in key order
+		int counts[2] = {0, 0};
+		int lastKeys[2] = {low1 - 1, low2};
+		bool done[2] = {false, false};
+		bool ordered = true;
+		while(!done[0] || !done[1])
+		{
+			for(int c = 0; c < 2; c++)
+			{
+				if(done[c])
+					continue;
+				RecordId scanRid;
+				try
+				{
+					(c == 0 ? first : second).scanNext(scanRid);
+				}
+				catch(IndexScanCompletedException e)
+				{
+					done[c] = true;
+					continue;
+				}
+				Page* page;
+				bufMgr->readPage(file1, scanRid.page_number, page);
+				RECORD myRec = *(reinterpret_cast<const RECORD*>(page->getRecord(scanRid).data()));
+				bufMgr->unPinPage(file1, scanRid.page_number, false);
+				if(myRec.i <= lastKeys[c])
+					ordered = false;
+				lastKeys[c] = myRec.i;
+				counts[c]++;
+			}
+		}
+		checkPassFail(counts[0], 15)
+		checkPassFail(counts[1], 2000)
+		checkPassFail(ordered, true)
+		first.endScan();
+		second.endScan();
+
+		// a running scan is ended by the next startScan of the cursor
+		first.startScan(&low1, GTE, &high1, LT);
+		first.startScan(&low2, GTE, &high2, LT);
+		int count = 0;
+		try
+		{
+			RecordId scanRid;
+			while(true)
+			{
+				first.scanNext(scanRid);
+				count++;
+			}
+		}
+		catch(IndexScanCompletedException e)
+		{
+		}
+		checkPassFail(count, 2000)
+		first.endScan();
+		checkPassFail(first.isScanning(), false)
+
+		bool threw = false;
+		try
+		{
+			RecordId scanRid;
+			second.scanNext(scanRid);
+		}
+		catch(ScanNotInitializedException e)
+		{
+			threw = true;
+		}
+		checkPassFail(threw, true)
+
+		// one cursor per thread, each over a quarter of the keys
+		const int numThreads = 4;
+		std::atomic<int> total(0);
+		std::vector<std::thread> threads;
+		for(int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&index, &total, t]() {
+				IndexCursor cursor(&index);
+				cursor.setReadAhead(2);
+				int low = t * relationSize / numThreads;
+				int high = (t + 1) * relationSize / numThreads;
+				cursor.startScan(&low, GTE, &high, LT);
+				RecordId scanRid;
+				try
+				{
+					while(true)
+					{
+						cursor.scanNext(scanRid);
+						total++;
+					}
+				}
+				catch(IndexScanCompletedException e)
+				{
+				}
+				cursor.endScan();
+			}));
+		}
+		for(std::size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+		checkPassFail(total.load(), relationSize)
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(FileNotFoundException e)
+	{
+	}
+	deleteRelation();
+	std::cout << "Test 32: independent index cursors Passed" << std::endl;
+}
@@ -0,0 +1,250 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BADGERDB_NODE_SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace badgerdb {
+
+/**
+ * @brief Kernels that find a key in the sorted key array of a B+ tree node.
+ *
+ * upperBound() returns the number of keys not greater than the key, which is the child to descend into and the slot
+ * an equal key is inserted after; lowerBound() returns the number of keys less than the key, the first entry a scan
+ * starting at the key returns. Both narrow the range with a branchless binary search until it fits in a few vectors,
+ * then count the keys of what is left with SIMD compares: AVX2 if the CPU has it, SSE otherwise, or plain compares
+ * off x86. The other kernels are there to be measured against. Keys other than ints get the binary search alone.
+ */
+class NodeSearch
+{
+ public:
+  /**
+   * Ways of searching a node.
+   */
+  enum Kernel
+  {
+    LINEAR,   /* Compare keys one at a time from the first, stopping at the answer */
+    BINARY,   /* Branchless binary search all the way down */
+    SSE,      /* Branchless binary search, then 4 keys per compare */
+    AVX2      /* Branchless binary search, then 8 keys per compare */
+  };
+
+  /**
+   * Number of keys the binary search narrows the range down to before the keys left are counted.
+   */
+  static const int SIMD_WINDOW = 32;
+
+  /**
+   * Returns the number of keys not greater than key, with the best kernel the CPU runs.
+   *
+   * @param keys    Keys of the node, in ascending order
+   * @param length  Number of keys; 0 or less for none
+   * @param key     Key to look for
+   */
+  static int upperBound(const int* keys, const int length, const int key)
+  {
+    return search<true>(best(), keys, length, key);
+  }
+
+  /**
+   * Returns the number of keys less than key, with the best kernel the CPU runs.
+   *
+   * @param keys    Keys of the node, in ascending order
+   * @param length  Number of keys; 0 or less for none
+   * @param key     Key to look for
+   */
+  static int lowerBound(const int* keys, const int length, const int key)
+  {
+    return search<false>(best(), keys, length, key);
+  }
+
+  /**
+   * Returns upperBound() computed with the given kernel, which the CPU must support.
+   */
+  static int upperBound(const Kernel kernel, const int* keys, const int length, const int key)
+  {
+    return search<true>(kernel, keys, length, key);
+  }
+
+  /**
+   * Returns lowerBound() computed with the given kernel, which the CPU must support.
+   */
+  static int lowerBound(const Kernel kernel, const int* keys, const int length, const int key)
+  {
+    return search<false>(kernel, keys, length, key);
+  }
+
+  /**
+   * Returns the number of keys not greater than key for keys of any type, ordered by Order::less(a, b), with a
+   * branchless binary search. Order is a key traits type of the B+ tree, which defines the Key type.
+   *
+   * @param keys    Keys of the node, in ascending order
+   * @param length  Number of keys; 0 or less for none
+   * @param key     Key to look for
+   */
+  template <class Order>
+  static int upperBound(const typename Order::Key* keys, const int length, const typename Order::Key& key)
+  {
+    return searchOrdered<Order, true>(keys, length, key);
+  }
+
+  /**
+   * Returns the number of keys less than key for keys of any type, ordered by Order::less(a, b).
+   */
+  template <class Order>
+  static int lowerBound(const typename Order::Key* keys, const int length, const typename Order::Key& key)
+  {
+    return searchOrdered<Order, false>(keys, length, key);
+  }
+
+  /**
+   * Returns true if the CPU runs the kernel.
+   */
+  static bool supported(const Kernel kernel)
+  {
+#ifdef BADGERDB_NODE_SEARCH_X86
+    if (kernel == AVX2)
+      return __builtin_cpu_supports("avx2");
+    if (kernel == SSE)
+      return __builtin_cpu_supports("sse2");
+    return true;
+#else
+    return kernel == LINEAR || kernel == BINARY;
+#endif
+  }
+
+  /**
+   * Returns the fastest kernel the CPU runs, checked once.
+   */
+  static Kernel best()
+  {
+    static const Kernel kernel = supported(AVX2) ? AVX2 : (supported(SSE) ? SSE : BINARY);
+    return kernel;
+  }
+
+ private:
+  /**
+   * Returns true if a key counts towards the result: not greater than key for an upper bound, less for a lower one.
+   */
+  template <bool Upper>
+  static bool before(const int k, const int key)
+  {
+    return Upper ? k <= key : k < key;
+  }
+
+  template <bool Upper>
+  static int search(const Kernel kernel, const int* keys, const int length, const int key)
+  {
+    if (length <= 0)
+      return 0;
+    if (kernel == LINEAR)
+    {
+      int i = 0;
+      while (i < length && before<Upper>(keys[i], key))
+        i++;
+      return i;
+    }
+
+    // The answer is in [base, base + n]; each step halves n without a branch on the keys
+    const int* base = keys;
+    int n = length;
+    const int stop = (kernel == BINARY) ? 1 : SIMD_WINDOW;
+    while (n > stop)
+    {
+      const int half = n / 2;
+      base += before<Upper>(base[half - 1], key) ? half : 0;
+      n -= half;
+    }
+
+    int count;
+#ifdef BADGERDB_NODE_SEARCH_X86
+    if (kernel == AVX2)
+      count = countAvx2<Upper>(base, n, key);
+    else if (kernel == SSE)
+      count = countSse<Upper>(base, n, key);
+    else
+#endif
+      count = countScalar<Upper>(base, n, key);
+    return (int)(base - keys) + count;
+  }
+
+  template <class Order, bool Upper>
+  static int searchOrdered(const typename Order::Key* keys, const int length, const typename Order::Key& key)
+  {
+    if (length <= 0)
+      return 0;
+    const typename Order::Key* base = keys;
+    int n = length;
+    while (n > 1)
+    {
+      const int half = n / 2;
+      const bool before = Upper ? !Order::less(key, base[half - 1]) : Order::less(base[half - 1], key);
+      base += before ? half : 0;
+      n -= half;
+    }
+    const bool before = Upper ? !Order::less(key, base[0]) : Order::less(base[0], key);
+    return (int)(base - keys) + before;
+  }
+
+  /**
+   * Returns how many of the n keys count towards the result.
+   */
+  template <bool Upper>
+  static int countScalar(const int* keys, const int n, const int key)
+  {
+    int count = 0;
+    for (int i = 0; i < n; i++)
+      count += before<Upper>(keys[i], key);
+    return count;
+  }
+
+#ifdef BADGERDB_NODE_SEARCH_X86
+  template <bool Upper>
+  __attribute__((target("sse2")))
+  static int countSse(const int* keys, const int n, const int key)
+  {
+    // an upper bound counts the keys not greater than key, that is n minus those greater; a lower bound counts the
+    // keys less than key directly
+    const __m128i probe = _mm_set1_epi32(key);
+    int count = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+      __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i));
+      __m128i hit = Upper ? _mm_cmpgt_epi32(block, probe) : _mm_cmplt_epi32(block, probe);
+      count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(hit)));
+    }
+    if (Upper)
+      count = i - count;
+    return count + countScalar<Upper>(keys + i, n - i, key);
+  }
+
+  template <bool Upper>
+  __attribute__((target("avx2")))
+  static int countAvx2(const int* keys, const int n, const int key)
+  {
+    const __m256i probe = _mm256_set1_epi32(key);
+    int count = 0;
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+      __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i));
+      __m256i hit = Upper ? _mm256_cmpgt_epi32(block, probe) : _mm256_cmpgt_epi32(probe, block);
+      count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(hit)));
+    }
+    if (Upper)
+      count = i - count;
+    return count + countScalar<Upper>(keys + i, n - i, key);
+  }
+#endif
+};
+
+}
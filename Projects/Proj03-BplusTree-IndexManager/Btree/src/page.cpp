@@ -5,12 +5,15 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <cassert>
 
 #include <iostream>
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
 #include "exceptions/invalid_slot_exception.h"
+#include "exceptions/page_layout_exception.h"
+#include "exceptions/record_length_exception.h"
 #include "exceptions/slot_in_use_exception.h"
 #include "page_iterator.h"
 #include "page.h"
@@ -22,7 +25,7 @@ Page::Page() {
   initialize();
 }
 
-void Page::initialize() {
+void Page::initialize(const std::uint16_t record_length) {
   header_.free_space_lower_bound = 0;
   header_.free_space_upper_bound = DATA_SIZE;
   header_.num_slots = 0;
@@ -31,29 +34,199 @@ void Page::initialize() {
   header_.next_page_number = INVALID_NUMBER;
   //data_.assign(DATA_SIZE, char());
 	memset(data_, '\0', DATA_SIZE);
+  if (record_length != 0) {
+    // Every slot exists from the start; the bitmap says which are in use.
+    header_.free_space_lower_bound = FIXED_LENGTH_BOUND;
+    fixedHeader()->record_length = record_length;
+    header_.num_slots = fixedCapacity(record_length);
+    header_.num_free_slots = header_.num_slots;
+  } else {
+    // An empty trailer: no holes and no free slots.
+    header_.free_space_lower_bound = trailerBytes(0);
+  }
+}
+
+void Page::initializeColumns(const std::uint16_t num_columns,
+                             const std::uint16_t* column_widths) {
+  assert(num_columns > 0 && num_columns <= MAX_COLUMNS);
+  std::uint16_t record_length = 0;
+  for (std::uint16_t i = 0; i < num_columns; ++i) {
+    record_length += column_widths[i];
+  }
+  initialize(record_length);
+  fixedHeader()->num_columns = num_columns;
+  header_.num_slots = paxCapacity(num_columns, column_widths);
+  header_.num_free_slots = header_.num_slots;
+
+  // Minipages follow the bitmap in column order, each sized for every slot.
+  std::size_t offset = fixedBitmapOffset() +
+      fixedBitmapBytes(header_.num_slots);
+  ColumnEntry* directory = columnDirectory();
+  for (std::uint16_t i = 0; i < num_columns; ++i) {
+    directory[i].width = column_widths[i];
+    directory[i].offset = offset;
+    offset += (std::size_t)header_.num_slots * column_widths[i];
+  }
+  assert(offset <= DATA_SIZE);
+}
+
+SlotId Page::tupleCapacity(const std::size_t space,
+                           const std::uint16_t record_length) {
+  std::size_t capacity = space * 8 / (record_length * 8 + 1);
+  while (fixedBitmapBytes(capacity) + capacity * record_length > space) {
+    --capacity;
+  }
+  return capacity;
+}
+
+SlotId Page::fixedCapacity(const std::uint16_t record_length) {
+  return tupleCapacity(DATA_SIZE - sizeof(FixedHeader), record_length);
+}
+
+SlotId Page::paxCapacity(const std::uint16_t num_columns,
+                         const std::uint16_t* column_widths) {
+  std::uint16_t record_length = 0;
+  for (std::uint16_t i = 0; i < num_columns; ++i) {
+    record_length += column_widths[i];
+  }
+  return tupleCapacity(
+      DATA_SIZE - sizeof(FixedHeader) - columnDirectoryBytes(num_columns),
+      record_length);
 }
 
-RecordId Page::insertRecord(const std::string& record_data) {
+RecordId Page::insertRecord(std::string_view record_data) {
+  if (isFixedLength() && record_data.length() != record_length()) {
+    throw RecordLengthException(
+        page_number(), record_data.length(), record_length());
+  }
   if (!hasSpaceForRecord(record_data)) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
   }
+  if (isFixedLength()) {
+    const SlotId slot_number = getAvailableSlot();
+    insertRecordInSlot(slot_number, record_data);
+    return {page_number(), slot_number};
+  }
+  // A page written before trailers existed gets one if there is room for it
+  // besides the record.
+  addTrailer(record_data.length() +
+             (header_.num_free_slots == 0 ? sizeof(PageSlot) + 1 : 0));
+  // A new slot comes out of the free space as well.
+  ensureContiguousSpace(record_data.length() +
+                        (header_.num_free_slots == 0 ? newSlotBytes() : 0));
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
   return {page_number(), slot_number};
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  if (num_columns() != 0) {
+    // Gather the record back from the minipages.
+    validateRecordId(record_id);
+    std::string record;
+    record.reserve(record_length());
+    const SlotId index = record_id.slot_number - 1;
+    const ColumnEntry* directory = columnDirectory();
+    for (std::uint16_t i = 0; i < num_columns(); ++i) {
+      record.append(&data_[directory[i].offset + index * directory[i].width],
+                    directory[i].width);
+    }
+    return record;
+  }
+  return std::string(getRecordView(record_id));
+}
+
+std::string_view Page::getRecordView(const RecordId& record_id) const {
   validateRecordId(record_id);
+  if (num_columns() != 0) {
+    throw PageLayoutException(page_number(), "viewing a record in place");
+  }
+  if (isFixedLength()) {
+    return std::string_view(&data_[fixedRecordOffset(record_id.slot_number)],
+                            record_length());
+  }
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
+  return std::string_view(&data_[slot.item_offset], slot.item_length);
+}
 
-	return retStr;
+std::string_view Page::getColumnView(const RecordId& record_id,
+                                     const std::uint16_t column) const {
+  validateRecordId(record_id);
+  if (column >= num_columns()) {
+    throw PageLayoutException(page_number(), "reading a column");
+  }
+  const ColumnEntry& entry = columnDirectory()[column];
+  return std::string_view(
+      &data_[entry.offset + (record_id.slot_number - 1) * entry.width],
+      entry.width);
+}
+
+std::size_t Page::getRecordViews(const SlotId start, const std::size_t max,
+                                 RecordId* record_ids,
+                                 std::string_view* records) const {
+  if (records != NULL && num_columns() != 0) {
+    throw PageLayoutException(page_number(), "viewing a record in place");
+  }
+  std::size_t count = 0;
+  if (isFixedLength()) {
+    const char* tuples = &data_[fixedRecordOffset(1)];
+    for (SlotId slot = getNextUsedSlot(start);
+         slot != INVALID_SLOT && count < max;
+         slot = getNextUsedSlot(slot)) {
+      record_ids[count] = {page_number(), slot};
+      if (records != NULL) {
+        records[count] = std::string_view(
+            tuples + (std::size_t)(slot - 1) * record_length(),
+            record_length());
+      }
+      ++count;
+    }
+    return count;
+  }
+  const PageSlot* slots = reinterpret_cast<const PageSlot*>(data_);
+  for (SlotId i = start; i < header_.num_slots && count < max; ++i) {
+    if (!slots[i].used) {
+      continue;
+    }
+    record_ids[count] = {page_number(), static_cast<SlotId>(i + 1)};
+    if (records != NULL) {
+      records[count] = std::string_view(&data_[slots[i].item_offset],
+                                        slots[i].item_length);
+    }
+    ++count;
+  }
+  return count;
+}
+
+void Page::writeFixedRecord(const SlotId slot_number,
+                            std::string_view record_data) {
+  if (num_columns() == 0) {
+    memcpy(&data_[fixedRecordOffset(slot_number)], record_data.data(),
+           record_length());
+    return;
+  }
+  const SlotId index = slot_number - 1;
+  const ColumnEntry* directory = columnDirectory();
+  const char* source = record_data.data();
+  for (std::uint16_t i = 0; i < num_columns(); ++i) {
+    memcpy(&data_[directory[i].offset + index * directory[i].width], source,
+           directory[i].width);
+    source += directory[i].width;
+  }
 }
 
 void Page::updateRecord(const RecordId& record_id,
-                        const std::string& record_data) {
+                        std::string_view record_data) {
   validateRecordId(record_id);
+  if (isFixedLength()) {
+    if (record_data.length() != record_length()) {
+      throw RecordLengthException(
+          page_number(), record_data.length(), record_length());
+    }
+    writeFixedRecord(record_id.slot_number, record_data);
+    return;
+  }
   const PageSlot* slot = getSlot(record_id.slot_number);
   const std::size_t free_space_after_delete =
       getFreeSpace() + slot->item_length;
@@ -61,6 +234,17 @@ void Page::updateRecord(const RecordId& record_id,
     throw InsufficientSpaceException(
         page_number(), record_data.length(), free_space_after_delete);
   }
+  if (record_data.length() <= slot->item_length) {
+    // Overwrite in place, keeping the record against its end so that what is
+    // left over lies below it.
+    PageSlot* in_place = getSlot(record_id.slot_number);
+    const std::uint16_t shrink = in_place->item_length - record_data.length();
+    releaseSpace(in_place->item_offset, shrink);
+    in_place->item_offset += shrink;
+    in_place->item_length = record_data.length();
+    memcpy(&data_[in_place->item_offset], record_data.data(), record_data.length());
+    return;
+  }
   // We have to disallow slot compaction here because we're going to place the
   // record data in the same slot, and compaction might delete the slot if we
   // permit it.
@@ -70,49 +254,34 @@ void Page::updateRecord(const RecordId& record_id,
 
 void Page::deleteRecord(const RecordId& record_id) {
   deleteRecord(record_id, true /* allow_slot_compaction */);
+  // A page written before trailers existed gets one once it has room.
+  if (!isFixedLength()) {
+    addTrailer(0 /* reserve */);
+  }
 }
 
 void Page::deleteRecord(const RecordId& record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
-  PageSlot* slot = getSlot(record_id.slot_number);
-
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = '\0';
-
-  //data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
-    }
+  if (isFixedLength()) {
+    const SlotId index = record_id.slot_number - 1;
+    fixedBitmap()[index / 64] &= ~(std::uint64_t(1) << (index % 64));
+    ++header_.num_free_slots;
+    return;
   }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
-
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
+  PageSlot* slot = getSlot(record_id.slot_number);
 
-    //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
-  }
-  header_.free_space_upper_bound += slot->item_length;
+  // Leave the data where it is.  A record at the start of the data area just
+  // gives its bytes back to the free space; any other leaves a hole that
+  // compact() closes once an insert needs the space.
+  releaseSpace(slot->item_offset, slot->item_length);
 
   // Mark slot as unused.
   slot->used = false;
   slot->item_offset = 0;
   slot->item_length = 0;
   ++header_.num_free_slots;
+  setSlotFree(record_id.slot_number, true);
 
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
     // Last slot in the list, so we need to free any unused slots that are at
@@ -129,16 +298,137 @@ void Page::deleteRecord(const RecordId& record_id,
         break;
       }
     }
-    header_.num_slots -= num_slots_to_delete;
+    for (int i = 0; i < num_slots_to_delete; ++i) {
+      setSlotFree(header_.num_slots - i, false);
+    }
+    // The trailer moves down to the new end of the slot array, keeping the
+    // bits of the slots that are left.
+    const bool has_trailer = hasTrailer();
+    const SlotId num_slots = header_.num_slots - num_slots_to_delete;
+    if (has_trailer) {
+      memmove(&data_[sizeof(PageSlot) * num_slots], trailer(),
+              trailerBytes(num_slots));
+    }
+    header_.num_slots = num_slots;
     header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    header_.free_space_lower_bound = sizeof(PageSlot) * num_slots +
+        (has_trailer ? trailerBytes(num_slots) : 0);
+  }
+}
+
+void Page::releaseSpace(const std::uint16_t offset,
+                        const std::uint16_t length) {
+  if (offset == header_.free_space_upper_bound) {
+    header_.free_space_upper_bound += length;
+  } else if (hasTrailer()) {
+    setFragmentedBytes(fragmentedBytes() + length);
+  } else if (length > 0) {
+    // Nowhere to count a hole, so close it now: the records below it, which
+    // lie in one piece, move up over it.
+    memmove(&data_[header_.free_space_upper_bound + length],
+            &data_[header_.free_space_upper_bound],
+            offset - header_.free_space_upper_bound);
+    for (SlotId i = 1; i <= header_.num_slots; ++i) {
+      PageSlot* other_slot = getSlot(i);
+      if (other_slot->used && other_slot->item_offset < offset) {
+        other_slot->item_offset += length;
+      }
+    }
+    header_.free_space_upper_bound += length;
+  }
+}
+
+void Page::addTrailer(const std::size_t reserve) {
+  if (hasTrailer() ||
+      (std::size_t)(header_.free_space_upper_bound -
+                    header_.free_space_lower_bound) <
+      trailerBytes(header_.num_slots) + reserve) {
+    return;
+  }
+  memset(trailer(), 0, trailerBytes(header_.num_slots));
+  header_.free_space_lower_bound += trailerBytes(header_.num_slots);
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    if (!getSlot(i)->used) {
+      setSlotFree(i, true);
+    }
+  }
+}
+
+void Page::compact() {
+  if (fragmentedBytes() == 0) {
+    return;
+  }
+
+  // Sort the records by offset, highest first.  They are counted by 64-byte
+  // stretch of the data area and then dropped into place stretch by stretch,
+  // which leaves an insertion sort only records of the same stretch to order.
+  const std::size_t num_buckets = (DATA_SIZE >> 6) + 1;
+  std::uint16_t bucket_start[num_buckets + 1] = {};
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    const PageSlot* slot = getSlot(i);
+    if (slot->used) {
+      ++bucket_start[((DATA_SIZE - slot->item_offset) >> 6) + 1];
+    }
+  }
+  for (std::size_t b = 1; b <= num_buckets; ++b) {
+    bucket_start[b] += bucket_start[b - 1];
+  }
+  const std::size_t num_records = bucket_start[num_buckets];
+  SlotId order[DATA_SIZE / sizeof(PageSlot)];
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    const PageSlot* slot = getSlot(i);
+    if (slot->used) {
+      order[bucket_start[(DATA_SIZE - slot->item_offset) >> 6]++] = i;
+    }
+  }
+  for (std::size_t i = 1; i < num_records; ++i) {
+    const SlotId slot_number = order[i];
+    const std::uint16_t offset = getSlot(slot_number)->item_offset;
+    std::size_t j = i;
+    for (; j > 0 && getSlot(order[j - 1])->item_offset < offset; --j) {
+      order[j] = order[j - 1];
+    }
+    order[j] = slot_number;
+  }
+
+  // Move the records up against each other in that order, so that none is
+  // overwritten before it has moved.  Records that already lie next to each
+  // other move together in one memmove.
+  std::size_t end = DATA_SIZE;
+  std::size_t run_offset = DATA_SIZE;
+  std::size_t run_length = 0;
+  for (std::size_t i = 0; i < num_records; ++i) {
+    PageSlot* slot = getSlot(order[i]);
+    if (slot->item_offset + slot->item_length != run_offset) {
+      memmove(&data_[end], &data_[run_offset], run_length);
+      run_length = 0;
+    }
+    run_offset = slot->item_offset;
+    run_length += slot->item_length;
+    end -= slot->item_length;
+    slot->item_offset = end;
   }
+  memmove(&data_[end], &data_[run_offset], run_length);
+
+  header_.free_space_upper_bound = end;
+  setFragmentedBytes(0);
 }
 
-bool Page::hasSpaceForRecord(const std::string& record_data) const {
+void Page::ensureContiguousSpace(const std::size_t length) {
+  if (header_.free_space_upper_bound - header_.free_space_lower_bound <
+      (int)length) {
+    compact();
+  }
+}
+
+bool Page::hasSpaceForRecord(std::string_view record_data) const {
+  if (isFixedLength()) {
+    return record_data.length() == record_length() &&
+        header_.num_free_slots > 0;
+  }
   std::size_t record_size = record_data.length();
   if (header_.num_free_slots == 0) {
-    record_size += sizeof(PageSlot);
+    record_size += newSlotBytes();
   }
   return record_size <= getFreeSpace();
 }
@@ -153,7 +443,32 @@ const PageSlot& Page::getSlot(const SlotId slot_number) const {
 
 SlotId Page::getAvailableSlot() {
   SlotId slot_number = INVALID_SLOT;
-  if (header_.num_free_slots > 0) {
+  if (isFixedLength()) {
+    // First clear bit of the occupancy bitmap; num_free_slots > 0 means there
+    // is one below num_slots.
+    const std::uint64_t* bitmap = fixedBitmap();
+    for (std::size_t word = 0; ; ++word) {
+      if (~bitmap[word] != 0) {
+        slot_number = word * 64 + __builtin_ctzll(~bitmap[word]) + 1;
+        break;
+      }
+    }
+    assert(slot_number <= header_.num_slots);
+  } else if (header_.num_free_slots > 0 && hasTrailer()) {
+    // Have an allocated but unused slot that we can reuse; take the lowest,
+    // reading the free-slot bitmap eight bytes at a time.  We don't decrement
+    // the number of free slots until someone actually puts data in the slot.
+    const std::uint8_t* bitmap = trailer() + sizeof(std::uint16_t);
+    const std::size_t num_bytes = (header_.num_slots + 7) / 8;
+    for (std::size_t byte = 0; byte < num_bytes; byte += sizeof(std::uint64_t)) {
+      std::uint64_t bits = 0;
+      memcpy(&bits, bitmap + byte, std::min(sizeof(bits), num_bytes - byte));
+      if (bits != 0) {
+        slot_number = byte * 8 + __builtin_ctzll(bits) + 1;
+        break;
+      }
+    }
+  } else if (header_.num_free_slots > 0) {
     // Have an allocated but unused slot that we can reuse.
     for (SlotId i = 1; i <= header_.num_slots; ++i) {
       const PageSlot* slot = getSlot(i);
@@ -165,35 +480,61 @@ SlotId Page::getAvailableSlot() {
       }
     }
   } else {
-    // Have to allocate a new slot.
+    // Have to allocate a new slot; the trailer moves up to make room for it.
+    const std::size_t trailer_bytes =
+        hasTrailer() ? trailerBytes(header_.num_slots) : 0;
+    memmove(trailer() + sizeof(PageSlot), trailer(), trailer_bytes);
     slot_number = header_.num_slots + 1;
     ++header_.num_slots;
     ++header_.num_free_slots;
     header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    if (trailer_bytes != 0) {
+      if (trailerBytes(header_.num_slots) > trailer_bytes) {
+        trailer()[trailer_bytes] = 0;
+      }
+      header_.free_space_lower_bound += trailerBytes(header_.num_slots);
+    }
+    // The free space may still hold bytes of deleted records.
+    PageSlot* slot = getSlot(slot_number);
+    slot->used = false;
+    slot->item_offset = 0;
+    slot->item_length = 0;
+    setSlotFree(slot_number, true);
   }
   assert(slot_number != INVALID_SLOT);
   return static_cast<SlotId>(slot_number);
 }
 
 void Page::insertRecordInSlot(const SlotId slot_number,
-                              const std::string& record_data) {
+                              std::string_view record_data) {
   if (slot_number > header_.num_slots ||
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
   }
+  if (isFixedLength()) {
+    if (isFixedSlotUsed(slot_number)) {
+      throw SlotInUseException(page_number(), slot_number);
+    }
+    const SlotId index = slot_number - 1;
+    fixedBitmap()[index / 64] |= std::uint64_t(1) << (index % 64);
+    --header_.num_free_slots;
+    writeFixedRecord(slot_number, record_data);
+    return;
+  }
   PageSlot* slot = getSlot(slot_number);
   if (slot->used) {
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
+  ensureContiguousSpace(record_length);
   slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
+  setSlotFree(slot_number, false);
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = record_data[i];
+  memcpy(&data_[slot->item_offset], record_data.data(), record_length);
 
   //data_.replace(slot->item_offset, slot->item_length, record_data);
 }
@@ -202,12 +543,46 @@ void Page::validateRecordId(const RecordId& record_id) const {
   if (record_id.page_number != page_number()) {
     throw InvalidRecordException(record_id, page_number());
   }
+  if (isFixedLength()) {
+    if (record_id.slot_number == INVALID_SLOT ||
+        record_id.slot_number > header_.num_slots ||
+        !isFixedSlotUsed(record_id.slot_number)) {
+      throw InvalidRecordException(record_id, page_number());
+    }
+    return;
+  }
   const PageSlot& slot = getSlot(record_id.slot_number);
   if (!slot.used) {
     throw InvalidRecordException(record_id, page_number());
   }
 }
 
+SlotId Page::getNextUsedSlot(const SlotId start) const {
+  if (isFixedLength()) {
+    // Walk the occupancy bitmap a word at a time, from the bit after start.
+    const std::uint64_t* bitmap = fixedBitmap();
+    const std::size_t num_words = (header_.num_slots + 63) / 64;
+    std::size_t word = start / 64;
+    if (word >= num_words) {
+      return INVALID_SLOT;
+    }
+    std::uint64_t bits = bitmap[word] & (~std::uint64_t(0) << (start % 64));
+    while (bits == 0) {
+      if (++word >= num_words) {
+        return INVALID_SLOT;
+      }
+      bits = bitmap[word];
+    }
+    return word * 64 + __builtin_ctzll(bits) + 1;
+  }
+  for (SlotId i = start + 1; i <= header_.num_slots; ++i) {
+    if (getSlot(i).used) {
+      return i;
+    }
+  }
+  return INVALID_SLOT;
+}
+
 PageIterator Page::begin() {
   return PageIterator(this);
 }
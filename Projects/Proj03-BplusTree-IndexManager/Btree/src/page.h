@@ -8,9 +8,11 @@
 #pragma once
 
 #include <cstddef>
+#include <cstring>
 #include <stdint.h>
 #include <memory>
 #include <string>
+#include <string_view>
 
 //#include <gtest/gtest.h>
 #include "types.h"
@@ -21,12 +23,16 @@ namespace badgerdb {
  * @brief Header metadata in a page.
  *
  * Header metadata in each page which tracks where space has been used and
- * contains a pointer to the next page in the file.
+ * contains a pointer to the next page in the file.  The header has the same
+ * 16 bytes it always had, so that pages written by earlier builds read as
+ * they are; anything newer is kept in the data of the page.
  */
 struct PageHeader {
   /**
    * Lower bound of the free space.  This is the offset of the first unused byte
-   * after the slot array.
+   * after the slot array and its trailer, if the page has one.  On a
+   * fixed-length page, which has no free space bounds, it is
+   * Page::FIXED_LENGTH_BOUND instead.
    */
   std::uint16_t free_space_lower_bound;
 
@@ -128,6 +134,17 @@ class Page {
    */
   static const SlotId INVALID_SLOT = 0;
 
+  /**
+   * Largest number of columns of a PAX page.
+   */
+  static const std::uint16_t MAX_COLUMNS = 16;
+
+  /**
+   * Free space lower bound marking a fixed-length page.  It lies past the
+   * end of the data, where the lower bound of a slotted page never gets.
+   */
+  static const std::uint16_t FIXED_LENGTH_BOUND = 0xFFFF;
+
   /**
    * Constructs a new, uninitialized page.
    */
@@ -139,7 +156,7 @@ class Page {
    * @param record_data  Bytes that compose the record.
    * @return  ID of the newly inserted record.
    */
-  RecordId insertRecord(const std::string& record_data);
+  RecordId insertRecord(std::string_view record_data);
 
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
@@ -151,20 +168,64 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID without copying it.  The view points
+   * into the page and stays valid until the page is changed or, for a page in
+   * the buffer pool, unpinned.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  The record.
+   * @throws  PageLayoutException   If this is a PAX page, which does not keep
+   *                                a record's bytes together.
+   */
+  std::string_view getRecordView(const RecordId& record_id) const;
+
+  /**
+   * Returns one column of the record with the given ID without copying it,
+   * read straight from the column's minipage on a PAX page.  The view stays
+   * valid as long as one returned by getRecordView() would.
+   *
+   * @param record_id  ID of the record.
+   * @param column     Index of the column.
+   * @return  The bytes of the column.
+   * @throws  PageLayoutException   If this is not a PAX page.
+   */
+  std::string_view getColumnView(const RecordId& record_id,
+                                 const std::uint16_t column) const;
+
+  /**
+   * Returns the records in use after the given slot, in slot order, at most
+   * max of them: the batch form of stepping a PageIterator and calling
+   * getRecordView() on each record.
+   *
+   * @param start       Slot to start after; INVALID_SLOT for the first one.
+   * @param max         Largest number of records to return.
+   * @param record_ids  Receives the IDs of the records.
+   * @param records     Receives views of the records, as getRecordView()
+   *                    would return them; may be NULL to list IDs only.
+   * @return  Number of records returned.
+   * @throws  PageLayoutException   If records is not NULL on a PAX page.
+   */
+  std::size_t getRecordViews(const SlotId start, const std::size_t max,
+                             RecordId* record_ids,
+                             std::string_view* records) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
-   * new one, with the exception that the record ID will not change.
+   * new one, with the exception that the record ID will not change.  A new
+   * version no longer than the old one is written in place.
    *
    * @param record_id   ID of record to update.
    * @param record_data Updated bytes that compose the record.
    */
-  void updateRecord(const RecordId& record_id, const std::string& record_data);
+  void updateRecord(const RecordId& record_id, std::string_view record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  The record's space is reclaimed
+   * at once if it borders the free space, and otherwise left as a hole until
+   * an insert needs it (see compact()).  Slot array is compacted if the slot
+   * deleted is at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -176,15 +237,77 @@ class Page {
    * @param record_data Bytes that compose the record.
    * @return  Whether the page can hold the data.
    */
-  bool hasSpaceForRecord(const std::string& record_data) const;
+  bool hasSpaceForRecord(std::string_view record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes.  On a fixed-length page this is
+   * the space of its free slots.
    *
    * @return  Free space in bytes.
    */
-  std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+  std::uint16_t getFreeSpace() const {
+    if (isFixedLength()) {
+      return header_.num_free_slots * record_length();
+    }
+    return header_.free_space_upper_bound - header_.free_space_lower_bound +
+        fragmentedBytes();
+  }
+
+  /**
+   * Returns the number of records on this page.
+   *
+   * @return  Number of slots in use.
+   */
+  SlotId getNumRecords() const {
+    return header_.num_slots - header_.num_free_slots;
+  }
+
+  /**
+   * Returns the length of every record on a fixed-length page.
+   *
+   * @return  Record length in bytes, or 0 for a slotted page.
+   */
+  std::uint16_t record_length() const {
+    return isFixedLength() ? fixedHeader()->record_length : 0;
+  }
+
+  /**
+   * Returns the number of records of the given length a fixed-length page
+   * holds.
+   *
+   * @param record_length   Length of each record in bytes.
+   * @return  Number of slots of a fixed-length page.
+   */
+  static SlotId fixedCapacity(const std::uint16_t record_length);
+
+  /**
+   * Returns the number of columns of a PAX page.
+   *
+   * @return  Number of columns, or 0 for a page stored by row.
+   */
+  std::uint16_t num_columns() const {
+    return isFixedLength() ? fixedHeader()->num_columns : 0;
+  }
+
+  /**
+   * Returns the width of a column of a PAX page.
+   *
+   * @param column   Index of the column.
+   * @return  Width of the column in bytes.
+   */
+  std::uint16_t column_width(const std::uint16_t column) const {
+    return columnDirectory()[column].width;
+  }
+
+  /**
+   * Returns the number of records a PAX page with the given columns holds.
+   *
+   * @param num_columns     Number of columns.
+   * @param column_widths   Width of each column in bytes.
+   * @return  Number of slots of the PAX page.
+   */
+  static SlotId paxCapacity(const std::uint16_t num_columns,
+                            const std::uint16_t* column_widths);
 
   /**
    * Returns this page's number in its file.
@@ -218,8 +341,21 @@ class Page {
  private:
   /**
    * Initializes this page as a new page with no header information or data.
+   *
+   * @param record_length   Length of every record for a fixed-length page,
+   *                        or 0 for a slotted page.
+   */
+  void initialize(const std::uint16_t record_length = 0);
+
+  /**
+   * Initializes this page as a new PAX page with no records.  Its record
+   * length is the sum of the column widths.
+   *
+   * @param num_columns     Number of columns, at most MAX_COLUMNS.
+   * @param column_widths   Width of each column in bytes.
    */
-  void initialize();
+  void initializeColumns(const std::uint16_t num_columns,
+                         const std::uint16_t* column_widths);
 
   /**
    * Sets this page's number in its file.
@@ -240,9 +376,9 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
+   * Deletes the record with the given ID.  Other records only move on a page
+   * without a trailer, which cannot keep a hole for later.  Slot array is
+   * compacted if the slot deleted is at the end of the slot array and
    * <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
@@ -252,6 +388,140 @@ class Page {
   void deleteRecord(const RecordId& record_id,
                     const bool allow_slot_compaction);
 
+  /**
+   * Gives back bytes of the data area that a record no longer uses.  Bytes at
+   * the free space just join it; any others become a hole, counted in the
+   * trailer, or are closed at once by moving the records below them up on a
+   * page without a trailer.
+   *
+   * @param offset  Offset of the bytes in the data of the page.
+   * @param length  Number of bytes.
+   */
+  void releaseSpace(const std::uint16_t offset, const std::uint16_t length);
+
+  /**
+   * Moves the records to the end of the page so that all free space lies in
+   * one piece between the slot array and the records.  Records are taken in
+   * descending order of offset and each is moved up in place with one
+   * memmove, so none is overwritten before it has been moved.
+   */
+  void compact();
+
+  /**
+   * Compacts the page if the free space in one piece is less than the given
+   * number of bytes.
+   *
+   * @param length  Bytes needed in one piece.
+   */
+  void ensureContiguousSpace(const std::size_t length);
+
+  /**
+   * Returns whether the slot array of a slotted page is followed by a
+   * trailer: two bytes counting the bytes of holes left by deleted records,
+   * then a bitmap with one bit per slot that is set if the slot is allocated
+   * but not in use.  Pages written before the trailer existed have none, and
+   * their slot array ends right at the free space lower bound; such a page
+   * finds free slots by reading the slot array and closes holes as soon as
+   * they appear, until it has room for a trailer.
+   *
+   * @return  True if the page has a trailer.
+   */
+  bool hasTrailer() const {
+    return header_.free_space_lower_bound !=
+        header_.num_slots * sizeof(PageSlot);
+  }
+
+  /**
+   * Returns the number of bytes of the trailer of a slotted page with the
+   * given number of slots.
+   *
+   * @param num_slots   Number of slots of the page.
+   * @return  Size of the trailer in bytes.
+   */
+  static std::size_t trailerBytes(const std::size_t num_slots) {
+    return sizeof(std::uint16_t) + (num_slots + 7) / 8;
+  }
+
+  /**
+   * Returns the trailer of a slotted page, which starts right after the slot
+   * array.
+   *
+   * @return  First byte of the trailer.
+   */
+  std::uint8_t* trailer() {
+    return reinterpret_cast<std::uint8_t*>(
+        data_ + header_.num_slots * sizeof(PageSlot));
+  }
+  const std::uint8_t* trailer() const {
+    return reinterpret_cast<const std::uint8_t*>(
+        data_ + header_.num_slots * sizeof(PageSlot));
+  }
+
+  /**
+   * Returns the number of bytes of holes left by deleted records between the
+   * free space upper bound and the end of the page.
+   *
+   * @return  Fragmented bytes; always 0 on a page without a trailer.
+   */
+  std::uint16_t fragmentedBytes() const {
+    if (!hasTrailer()) {
+      return 0;
+    }
+    std::uint16_t fragmented_bytes;
+    memcpy(&fragmented_bytes, trailer(), sizeof(fragmented_bytes));
+    return fragmented_bytes;
+  }
+
+  /**
+   * Sets the number of fragmented bytes of a page with a trailer.
+   *
+   * @param fragmented_bytes  Bytes of holes left by deleted records.
+   */
+  void setFragmentedBytes(const std::uint16_t fragmented_bytes) {
+    memcpy(trailer(), &fragmented_bytes, sizeof(fragmented_bytes));
+  }
+
+  /**
+   * Gives the page a trailer if it has none and there is room for one next
+   * to the given number of bytes still needed in one piece.  The free-slot
+   * bitmap is filled in from the slot array.
+   *
+   * @param reserve   Bytes of free space to leave over.
+   */
+  void addTrailer(const std::size_t reserve);
+
+  /**
+   * Returns the number of bytes a new slot takes out of the free space: the
+   * slot itself, and the byte it may add to the free-slot bitmap.
+   *
+   * @return  Bytes taken by a new slot.
+   */
+  std::size_t newSlotBytes() const {
+    std::size_t bytes = sizeof(PageSlot);
+    if (hasTrailer()) {
+      bytes += trailerBytes(header_.num_slots + 1) -
+          trailerBytes(header_.num_slots);
+    }
+    return bytes;
+  }
+
+  /**
+   * Sets or clears the bit of a slot in the free-slot bitmap of a page with a
+   * trailer.
+   *
+   * @param slot_number   Number of slot.
+   * @param free          True if the slot is allocated but not in use.
+   */
+  void setSlotFree(const SlotId slot_number, const bool free) {
+    if (!hasTrailer()) {
+      return;
+    }
+    const std::uint8_t bit = (std::uint8_t)(1u << ((slot_number - 1) % 8));
+    std::uint8_t& byte =
+        trailer()[sizeof(std::uint16_t) + (slot_number - 1) / 8];
+    byte = free ? (byte | bit) : (byte & ~bit);
+  }
+
   /**
    * Returns the slot with the given number.  This method will return
    * unallocated slots if requested; it is up to the caller to ensure they
@@ -302,7 +572,181 @@ class Page {
    * @throws  SlotInUseException  Thrown when given slot is in use.
    */
   void insertRecordInSlot(const SlotId slot_number,
-                          const std::string& record_data);
+                          std::string_view record_data);
+
+  /**
+   * Returns the first used slot after the given slot, or INVALID_SLOT if
+   * there is none.  A fixed-length page answers from its occupancy bitmap.
+   *
+   * @param start   Slot to start search at.
+   * @return  Next used slot after given slot or INVALID_SLOT.
+   */
+  SlotId getNextUsedSlot(const SlotId start) const;
+
+  /**
+   * Start of the data of a fixed-length page, which has no slot array.  The
+   * length of its records is kept here rather than in the header, so that
+   * the header keeps the size it has on pages written by earlier builds.
+   */
+  struct FixedHeader {
+    /**
+     * Length of every record.
+     */
+    std::uint16_t record_length;
+
+    /**
+     * Number of columns of a PAX page, or 0 for a page stored by row.
+     */
+    std::uint16_t num_columns;
+
+    /**
+     * Pads the header to a 64-bit word, so that the bitmap after it stays
+     * aligned.
+     */
+    std::uint32_t unused;
+  };
+
+  /**
+   * Returns whether this is a fixed-length page: its free space lower bound
+   * is FIXED_LENGTH_BOUND and its data starts with a FixedHeader.
+   *
+   * @return  True for a fixed-length page, false for a slotted page.
+   */
+  bool isFixedLength() const {
+    return header_.free_space_lower_bound == FIXED_LENGTH_BOUND;
+  }
+
+  /**
+   * Returns the header at the start of the data of a fixed-length page.
+   *
+   * @return  The fixed-length header.
+   */
+  FixedHeader* fixedHeader() {
+    return reinterpret_cast<FixedHeader*>(data_);
+  }
+  const FixedHeader* fixedHeader() const {
+    return reinterpret_cast<const FixedHeader*>(data_);
+  }
+
+  /**
+   * Returns the number of bytes of the occupancy bitmap of a fixed-length
+   * page holding the given number of slots.  The bitmap is a whole number of
+   * 64-bit words.
+   *
+   * @param num_slots   Number of slots of the page.
+   * @return  Size of the bitmap in bytes.
+   */
+  static std::size_t fixedBitmapBytes(const std::size_t num_slots) {
+    return (num_slots + 63) / 64 * sizeof(std::uint64_t);
+  }
+
+  /**
+   * Returns the number of records of the given length that fit in the given
+   * space along with their occupancy bitmap.
+   *
+   * @param space           Bytes available for the bitmap and records.
+   * @param record_length   Length of each record in bytes.
+   * @return  Number of slots.
+   */
+  static SlotId tupleCapacity(const std::size_t space,
+                              const std::uint16_t record_length);
+
+  /**
+   * Entry of the column directory of a PAX page.
+   */
+  struct ColumnEntry {
+    /**
+     * Width of the column in bytes.
+     */
+    std::uint16_t width;
+
+    /**
+     * Offset in the data of the page of the column's minipage, which holds
+     * the column of every slot in slot order.
+     */
+    std::uint16_t offset;
+  };
+
+  /**
+   * Returns the number of bytes of the column directory of a PAX page with
+   * the given number of columns, a whole number of 64-bit words so that the
+   * bitmap after it stays aligned.
+   *
+   * @param num_columns   Number of columns, 0 for a page stored by row.
+   * @return  Size of the directory in bytes.
+   */
+  static std::size_t columnDirectoryBytes(const std::size_t num_columns) {
+    return (num_columns * sizeof(ColumnEntry) + 7) / 8 * 8;
+  }
+
+  /**
+   * Returns the column directory of a PAX page.
+   *
+   * @return  Entry of the first column.
+   */
+  ColumnEntry* columnDirectory() {
+    return reinterpret_cast<ColumnEntry*>(data_ + sizeof(FixedHeader));
+  }
+  const ColumnEntry* columnDirectory() const {
+    return reinterpret_cast<const ColumnEntry*>(data_ + sizeof(FixedHeader));
+  }
+
+  /**
+   * Returns the occupancy bitmap of a fixed-length page, which follows the
+   * fixed-length header, and the column directory on a PAX page.
+   *
+   * @return  First word of the bitmap.
+   */
+  std::uint64_t* fixedBitmap() {
+    return reinterpret_cast<std::uint64_t*>(
+        data_ + fixedBitmapOffset());
+  }
+  const std::uint64_t* fixedBitmap() const {
+    return reinterpret_cast<const std::uint64_t*>(
+        data_ + fixedBitmapOffset());
+  }
+
+  /**
+   * Returns where the occupancy bitmap of a fixed-length page starts.
+   *
+   * @return  Offset of the bitmap in the data of the page.
+   */
+  std::size_t fixedBitmapOffset() const {
+    return sizeof(FixedHeader) + columnDirectoryBytes(num_columns());
+  }
+
+  /**
+   * Returns whether a slot of a fixed-length page holds a record.
+   *
+   * @param slot_number   Number of slot.
+   * @return  True if the slot is in use.
+   */
+  bool isFixedSlotUsed(const SlotId slot_number) const {
+    return (fixedBitmap()[(slot_number - 1) / 64] >>
+            ((slot_number - 1) % 64)) & 1;
+  }
+
+  /**
+   * Returns where the record in a slot of a fixed-length page lies; the
+   * offset is computed from the slot number.
+   *
+   * @param slot_number   Number of slot.
+   * @return  Offset of the record in the data of the page.
+   */
+  std::size_t fixedRecordOffset(const SlotId slot_number) const {
+    return fixedBitmapOffset() + fixedBitmapBytes(header_.num_slots) +
+        (std::size_t)(slot_number - 1) * record_length();
+  }
+
+  /**
+   * Writes a record into a slot of a fixed-length page, scattering it over
+   * the minipages of a PAX page.
+   *
+   * @param slot_number   Number of slot.
+   * @param record_data   Bytes that compose the record.
+   */
+  void writeFixedRecord(const SlotId slot_number,
+                        std::string_view record_data);
 
   /**
    * Throws an exception if the given record ID is not valid for this page
@@ -343,5 +787,9 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(sizeof(PageHeader) == 16,
+              "Pages written by earlier builds start with a 16-byte header.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page is read and written as a single block of SIZE bytes.");
 
 }
@@ -0,0 +1,498 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "replacement_policy.h"
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(const ReplacementPolicyType type, const std::uint32_t numBufs)
+{
+	switch(type)
+	{
+		case LRU_K:
+			return new LruKPolicy(numBufs);
+		case TWO_Q:
+			return new TwoQPolicy(numBufs);
+		case ARC:
+			return new ArcPolicy(numBufs);
+		case CLOCK:
+		default:
+			return new ClockPolicy(numBufs);
+	}
+}
+
+// -----------------------------------------------------------------------------
+// ClockPolicy
+// -----------------------------------------------------------------------------
+
+ClockPolicy::ClockPolicy(const std::uint32_t numBufs)
+	: numBufs(numBufs), clockHand(numBufs - 1), refbits(new std::atomic<bool>[numBufs]())
+{
+}
+
+void ClockPolicy::access(const FrameId frameNo)
+{
+	refbits[frameNo] = true;
+}
+
+void ClockPolicy::admit(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+	refbits[frameNo] = true;
+}
+
+void ClockPolicy::evicted(const FrameId frameNo)
+{
+}
+
+void ClockPolicy::release(const FrameId frameNo)
+{
+	refbits[frameNo] = false;
+}
+
+bool ClockPolicy::victim(FrameId& frame, const ClaimFunction& claim)
+{
+	for(std::uint32_t numScanned = 0; numScanned < 2 * numBufs; numScanned++)	//Need to scan twice
+	{
+		// advance the clock
+		FrameId candidate = (clockHand.fetch_add(1) + 1) % numBufs;
+
+		// has been referenced, clear the bit
+		if(refbits[candidate].exchange(false))
+			continue;
+
+		if(claim(candidate))
+		{
+			frame = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ClockPolicy::upcoming(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+	// the frames just ahead of the hand are swept next
+	FrameId hand = clockHand;
+	for(std::uint32_t i = 1; i <= numBufs && frames.size() < max; i++)
+		frames.push_back((hand + i) % numBufs);
+}
+
+// -----------------------------------------------------------------------------
+// ListPolicy
+// -----------------------------------------------------------------------------
+
+ListPolicy::ListPolicy(const std::uint32_t numBufs)
+	: numBufs(numBufs), framePage(numBufs), hitPending(new std::atomic<bool>[numBufs]()),
+		hitLog(new std::atomic<FrameId>[numBufs]), hitHead(0), hitTail(0)
+{
+	// hand out low frames first
+	for(std::uint32_t i = numBufs; i > 0; i--)
+		freeFrames.push_back(i - 1);
+	for(std::uint32_t i = 0; i < numBufs; i++)
+		hitLog[i] = numBufs;
+}
+
+void ListPolicy::access(const FrameId frameNo)
+{
+	if(hitPending[frameNo].exchange(true))
+		return;
+	hitLog[hitHead.fetch_add(1) % numBufs] = frameNo;
+}
+
+void ListPolicy::drainHits()
+{
+	const std::uint64_t head = hitHead;
+	for(; hitTail < head; hitTail++)
+	{
+		// the thread that took the slot may not have filled it in yet
+		FrameId frameNo;
+		while((frameNo = hitLog[hitTail % numBufs].exchange(numBufs)) == numBufs)
+			std::this_thread::yield();
+		hitPending[frameNo] = false;
+		hit(frameNo);
+	}
+}
+
+bool ListPolicy::claimFree(FrameId& frame, const ClaimFunction& claim)
+{
+	for(std::size_t i = freeFrames.size(); i > 0; i--)
+	{
+		if(claim(freeFrames[i - 1]))
+		{
+			frame = freeFrames[i - 1];
+			freeFrames.erase(freeFrames.begin() + (i - 1));
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ListPolicy::claimFrom(const std::list<FrameId>& frames, FrameId& frame, const ClaimFunction& claim)
+{
+	for(std::list<FrameId>::const_iterator it = frames.begin(); it != frames.end(); ++it)
+	{
+		if(claim(*it))
+		{
+			frame = *it;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ListPolicy::listFrom(const std::list<FrameId>& list, std::vector<FrameId>& frames, const std::uint32_t max)
+{
+	for(std::list<FrameId>::const_iterator it = list.begin(); it != list.end() && frames.size() < max; ++it)
+		frames.push_back(*it);
+}
+
+// -----------------------------------------------------------------------------
+// LruKPolicy
+// -----------------------------------------------------------------------------
+
+LruKPolicy::LruKPolicy(const std::uint32_t numBufs)
+	: ListPolicy(numBufs), now(0), frameHistory(numBufs), resident(numBufs, false)
+{
+}
+
+LruKPolicy::OrderKey LruKPolicy::orderKey(const FrameId frameNo) const
+{
+	const History& history = frameHistory[frameNo];
+	return OrderKey(std::make_pair(history.times[K - 1], history.times[0]), frameNo);
+}
+
+void LruKPolicy::reference(const FrameId frameNo)
+{
+	if(resident[frameNo])
+		order.erase(orderKey(frameNo));
+
+	History& history = frameHistory[frameNo];
+	for(std::uint32_t i = K - 1; i > 0; i--)
+		history.times[i] = history.times[i - 1];
+	history.times[0] = ++now;
+
+	order.insert(orderKey(frameNo));
+	resident[frameNo] = true;
+}
+
+void LruKPolicy::hit(const FrameId frameNo)
+{
+	if(resident[frameNo])
+		reference(frameNo);
+}
+
+void LruKPolicy::admit(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	PageKey key = {file, pageNo};
+	framePage[frameNo] = key;
+
+	// a page read in again continues its old history
+	std::map<PageKey, std::pair<History, std::list<PageKey>::iterator> >::iterator it = retained.find(key);
+	if(it != retained.end())
+	{
+		frameHistory[frameNo] = it->second.first;
+		retainedOrder.erase(it->second.second);
+		retained.erase(it);
+	}
+	else
+	{
+		std::fill(frameHistory[frameNo].times, frameHistory[frameNo].times + K, 0);
+	}
+	reference(frameNo);
+}
+
+void LruKPolicy::evicted(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	if(!resident[frameNo])
+		return;
+	order.erase(orderKey(frameNo));
+	resident[frameNo] = false;
+
+	const PageKey& key = framePage[frameNo];
+	retainedOrder.push_back(key);
+	retained[key] = std::make_pair(frameHistory[frameNo], --retainedOrder.end());
+	if(retained.size() > numBufs)
+	{
+		retained.erase(retainedOrder.front());
+		retainedOrder.pop_front();
+	}
+}
+
+void LruKPolicy::release(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	if(resident[frameNo])
+	{
+		order.erase(orderKey(frameNo));
+		resident[frameNo] = false;
+	}
+	freeFrames.push_back(frameNo);
+}
+
+bool LruKPolicy::victim(FrameId& frame, const ClaimFunction& claim)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	if(claimFree(frame, claim))
+		return true;
+
+	for(std::set<OrderKey>::const_iterator it = order.begin(); it != order.end(); ++it)
+	{
+		if(claim(it->second))
+		{
+			frame = it->second;
+			return true;
+		}
+	}
+	return false;
+}
+
+void LruKPolicy::upcoming(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	for(std::set<OrderKey>::const_iterator it = order.begin(); it != order.end() && frames.size() < max; ++it)
+		frames.push_back(it->second);
+}
+
+// -----------------------------------------------------------------------------
+// TwoQPolicy
+// -----------------------------------------------------------------------------
+
+TwoQPolicy::TwoQPolicy(const std::uint32_t numBufs)
+	: ListPolicy(numBufs), kin(std::max(numBufs / 4, 1u)), kout(std::max(numBufs / 2, 1u)),
+		queue(numBufs, NONE), position(numBufs)
+{
+}
+
+void TwoQPolicy::unlink(const FrameId frameNo)
+{
+	if(queue[frameNo] == A1IN)
+		a1in.erase(position[frameNo]);
+	else if(queue[frameNo] == AM)
+		am.erase(position[frameNo]);
+	queue[frameNo] = NONE;
+}
+
+void TwoQPolicy::hit(const FrameId frameNo)
+{
+	// a hit in A1in is a correlated reference and does not promote the page
+	if(queue[frameNo] == AM)
+	{
+		am.erase(position[frameNo]);
+		position[frameNo] = am.insert(am.end(), frameNo);
+	}
+}
+
+void TwoQPolicy::admit(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	PageKey key = {file, pageNo};
+	framePage[frameNo] = key;
+	unlink(frameNo);
+
+	std::map<PageKey, std::list<PageKey>::iterator>::iterator it = a1outIndex.find(key);
+	if(it != a1outIndex.end())
+	{
+		a1out.erase(it->second);
+		a1outIndex.erase(it);
+		position[frameNo] = am.insert(am.end(), frameNo);
+		queue[frameNo] = AM;
+	}
+	else
+	{
+		position[frameNo] = a1in.insert(a1in.end(), frameNo);
+		queue[frameNo] = A1IN;
+	}
+}
+
+void TwoQPolicy::evicted(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	if(queue[frameNo] == A1IN)
+	{
+		const PageKey& key = framePage[frameNo];
+		if(a1outIndex.find(key) == a1outIndex.end())
+			a1outIndex[key] = a1out.insert(a1out.end(), key);
+		if(a1out.size() > kout)
+		{
+			a1outIndex.erase(a1out.front());
+			a1out.pop_front();
+		}
+	}
+	unlink(frameNo);
+}
+
+void TwoQPolicy::release(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	unlink(frameNo);
+	freeFrames.push_back(frameNo);
+}
+
+bool TwoQPolicy::victim(FrameId& frame, const ClaimFunction& claim)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	if(claimFree(frame, claim))
+		return true;
+
+	if(a1in.size() > kin)
+		return claimFrom(a1in, frame, claim) || claimFrom(am, frame, claim);
+	return claimFrom(am, frame, claim) || claimFrom(a1in, frame, claim);
+}
+
+void TwoQPolicy::upcoming(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	bool a1inFirst = a1in.size() > kin;
+	listFrom(a1inFirst ? a1in : am, frames, max);
+	listFrom(a1inFirst ? am : a1in, frames, max);
+}
+
+// -----------------------------------------------------------------------------
+// ArcPolicy
+// -----------------------------------------------------------------------------
+
+void ArcPolicy::GhostList::pushBack(const PageKey& key)
+{
+	erase(key);
+	index[key] = pages.insert(pages.end(), key);
+}
+
+void ArcPolicy::GhostList::popFront()
+{
+	index.erase(pages.front());
+	pages.pop_front();
+}
+
+bool ArcPolicy::GhostList::erase(const PageKey& key)
+{
+	std::map<PageKey, std::list<PageKey>::iterator>::iterator it = index.find(key);
+	if(it == index.end())
+		return false;
+	pages.erase(it->second);
+	index.erase(it);
+	return true;
+}
+
+ArcPolicy::ArcPolicy(const std::uint32_t numBufs)
+	: ListPolicy(numBufs), p(0), queue(numBufs, NONE), position(numBufs)
+{
+}
+
+void ArcPolicy::unlink(const FrameId frameNo)
+{
+	if(queue[frameNo] == T1)
+		t1.erase(position[frameNo]);
+	else if(queue[frameNo] == T2)
+		t2.erase(position[frameNo]);
+	queue[frameNo] = NONE;
+}
+
+void ArcPolicy::trimGhosts()
+{
+	while(!b1.pages.empty() && t1.size() + b1.pages.size() > numBufs)
+		b1.popFront();
+	while(!b2.pages.empty() && t1.size() + t2.size() + b1.pages.size() + b2.pages.size() > 2 * numBufs)
+		b2.popFront();
+}
+
+void ArcPolicy::hit(const FrameId frameNo)
+{
+	if(queue[frameNo] == NONE)
+		return;
+	unlink(frameNo);
+	position[frameNo] = t2.insert(t2.end(), frameNo);
+	queue[frameNo] = T2;
+}
+
+void ArcPolicy::admit(const FrameId frameNo, const File* file, const PageId pageNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	PageKey key = {file, pageNo};
+	framePage[frameNo] = key;
+	unlink(frameNo);
+
+	std::uint32_t sizeB1 = b1.pages.size();
+	std::uint32_t sizeB2 = b2.pages.size();
+	if(b1.erase(key))
+	{
+		// T1 was too small to keep this page: grow its target
+		p = std::min(numBufs, p + std::max(sizeB2 / sizeB1, 1u));
+	}
+	else if(b2.erase(key))
+	{
+		// T2 was too small to keep this page: shrink T1's target
+		std::uint32_t delta = std::max(sizeB2 == 0 ? 1u : sizeB1 / sizeB2, 1u);
+		p = p > delta ? p - delta : 0;
+	}
+	else
+	{
+		position[frameNo] = t1.insert(t1.end(), frameNo);
+		queue[frameNo] = T1;
+		trimGhosts();
+		return;
+	}
+
+	position[frameNo] = t2.insert(t2.end(), frameNo);
+	queue[frameNo] = T2;
+}
+
+void ArcPolicy::evicted(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	if(queue[frameNo] == T1)
+		b1.pushBack(framePage[frameNo]);
+	else if(queue[frameNo] == T2)
+		b2.pushBack(framePage[frameNo]);
+	unlink(frameNo);
+	trimGhosts();
+}
+
+void ArcPolicy::release(const FrameId frameNo)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	unlink(frameNo);
+	freeFrames.push_back(frameNo);
+}
+
+bool ArcPolicy::victim(FrameId& frame, const ClaimFunction& claim)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	if(claimFree(frame, claim))
+		return true;
+
+	if(!t1.empty() && t1.size() > p)
+		return claimFrom(t1, frame, claim) || claimFrom(t2, frame, claim);
+	return claimFrom(t2, frame, claim) || claimFrom(t1, frame, claim);
+}
+
+void ArcPolicy::upcoming(std::vector<FrameId>& frames, const std::uint32_t max)
+{
+	std::lock_guard<std::mutex> guard(latch);
+	drainHits();
+	bool t1First = !t1.empty() && t1.size() > p;
+	listFrom(t1First ? t1 : t2, frames, max);
+	listFrom(t1First ? t2 : t1, frames, max);
+}
+
+}
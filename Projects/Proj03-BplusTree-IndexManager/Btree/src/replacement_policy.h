@@ -0,0 +1,466 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "types.h"
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Page replacement policies a BufMgr can be constructed with.
+ */
+enum ReplacementPolicyType
+{
+	CLOCK,	/* Two-pass clock over reference bits */
+	LRU_K,	/* LRU-2: evicts the page whose second most recent reference is oldest */
+	TWO_Q,	/* 2Q: first-time pages wait in a FIFO, pages referenced again move to an LRU list */
+	ARC			/* Adaptive Replacement Cache */
+};
+
+/**
+ * @brief Identity of a page in a file, used by policies that remember evicted pages.
+ */
+struct PageKey
+{
+	const File* file;
+	PageId pageNo;
+
+	bool operator<(const PageKey& rhs) const
+	{
+		return file < rhs.file || (file == rhs.file && pageNo < rhs.pageNo);
+	}
+};
+
+/**
+ * @brief Decides which buffer frame is reused when a page has to be read in.
+ *
+ * The buffer manager reports every hit through access(), every page placed in a frame through admit(), every
+ * evicted page through evicted() and every frame it empties for another reason through release(). When it needs a
+ * frame it calls victim(), which offers frames in the policy's order of preference to a claim function. The claim
+ * function latches the frame and returns true if the frame is unpinned; the first claimed frame is returned. A
+ * frame that holds a page stays known to the policy until evicted() is called, because the buffer manager may
+ * still find it pinned once it has been latched and give it up again.
+ *
+ * All methods may be called from many threads at once.
+ */
+class ReplacementPolicy
+{
+ public:
+	/**
+	 * Tries to take a frame; true if the frame now belongs to the caller.
+	 */
+	typedef std::function<bool(FrameId)> ClaimFunction;
+
+	/**
+	 * Creates the policy of the given type for a pool of numBufs frames.
+	 *
+	 * @param type	Policy to create
+	 * @param numBufs	Number of frames in the buffer pool
+	 * @return The policy, owned by the caller.
+	 */
+	static ReplacementPolicy* create(const ReplacementPolicyType type, const std::uint32_t numBufs);
+
+	virtual ~ReplacementPolicy() {}
+
+	/**
+	 * Short name of the policy, reported in BufStats.
+	 */
+	virtual const char* name() const = 0;
+
+	/**
+	 * The page held in frameNo was requested again.
+	 *
+	 * @param frameNo	Frame that was hit
+	 */
+	virtual void access(const FrameId frameNo) = 0;
+
+	/**
+	 * A page was read in or allocated into frameNo, which victim() handed out.
+	 *
+	 * @param frameNo	Frame now holding the page
+	 * @param file		File of the page
+	 * @param pageNo	Page number in the file
+	 */
+	virtual void admit(const FrameId frameNo, const File* file, const PageId pageNo) = 0;
+
+	/**
+	 * The page held in frameNo, last handed out by victim(), was evicted.
+	 *
+	 * @param frameNo	Frame that was emptied
+	 */
+	virtual void evicted(const FrameId frameNo) = 0;
+
+	/**
+	 * frameNo is empty and may be handed out again: its page was flushed or disposed, or victim() handed it out
+	 * and the caller did not use it.
+	 *
+	 * @param frameNo	Frame that was emptied
+	 */
+	virtual void release(const FrameId frameNo) = 0;
+
+	/**
+	 * Offers frames to claim, most preferable victim first.
+	 *
+	 * @param frame		Claimed frame returned via this reference
+	 * @param claim		Claim function
+	 * @return True if a frame was claimed, false if every frame is in use.
+	 */
+	virtual bool victim(FrameId& frame, const ClaimFunction& claim) = 0;
+
+	/**
+	 * Lists the frames holding pages that victim() would offer next, most preferable first, without claiming them.
+	 * Used by the background writer to clean frames before they are needed.
+	 *
+	 * @param frames	Frames returned via this vector
+	 * @param max		Maximum number of frames to list
+	 */
+	virtual void upcoming(std::vector<FrameId>& frames, const std::uint32_t max) = 0;
+};
+
+/**
+ * @brief Two-pass clock. Lock free: reference bits are atomic and every thread advances the shared hand.
+ */
+class ClockPolicy : public ReplacementPolicy
+{
+ public:
+	ClockPolicy(const std::uint32_t numBufs);
+
+	const char* name() const { return "clock"; }
+	void access(const FrameId frameNo);
+	void admit(const FrameId frameNo, const File* file, const PageId pageNo);
+	void evicted(const FrameId frameNo);
+	void release(const FrameId frameNo);
+	bool victim(FrameId& frame, const ClaimFunction& claim);
+	void upcoming(std::vector<FrameId>& frames, const std::uint32_t max);
+
+ private:
+	/**
+	 * Number of frames in the buffer pool
+	 */
+	std::uint32_t numBufs;
+
+	/**
+	 * Current position of clockhand in our buffer pool
+	 */
+	std::atomic<FrameId> clockHand;
+
+	/**
+	 * Has each frame been referenced since the hand last passed it
+	 */
+	std::unique_ptr<std::atomic<bool>[]> refbits;
+};
+
+/**
+ * @brief Base of the list based policies: a mutex and a stack of empty frames handed out before any page is evicted.
+ * Hits do not take the mutex. access() only logs the frame, and the logged hits are applied to the lists the next
+ * time the mutex is taken, on a miss or an eviction. Hits on a frame that is already in the log count once.
+ */
+class ListPolicy : public ReplacementPolicy
+{
+ public:
+	ListPolicy(const std::uint32_t numBufs);
+
+	void access(const FrameId frameNo);
+
+ protected:
+	/**
+	 * Applies a logged hit on a frame. Caller holds latch.
+	 */
+	virtual void hit(const FrameId frameNo) = 0;
+
+	/**
+	 * Applies the logged hits, oldest first. Caller holds latch.
+	 */
+	void drainHits();
+
+	/**
+	 * Hands out an empty frame if one can be claimed. Caller holds latch.
+	 */
+	bool claimFree(FrameId& frame, const ClaimFunction& claim);
+
+	/**
+	 * Offers the frames of a list from front to back. Caller holds latch.
+	 */
+	static bool claimFrom(const std::list<FrameId>& frames, FrameId& frame, const ClaimFunction& claim);
+
+	/**
+	 * Appends the frames of a list from front to back until frames holds max entries. Caller holds latch.
+	 */
+	static void listFrom(const std::list<FrameId>& list, std::vector<FrameId>& frames, const std::uint32_t max);
+
+	/**
+	 * Guards every member of the policy
+	 */
+	std::mutex latch;
+
+	/**
+	 * Number of frames in the buffer pool
+	 */
+	std::uint32_t numBufs;
+
+	/**
+	 * Frames holding no page
+	 */
+	std::vector<FrameId> freeFrames;
+
+	/**
+	 * Page held by each frame
+	 */
+	std::vector<PageKey> framePage;
+
+	/**
+	 * True while a frame is in hitLog
+	 */
+	std::unique_ptr<std::atomic<bool>[]> hitPending;
+
+	/**
+	 * Ring of logged hits, numBufs where a slot is empty. A frame is in it at most once, so it never overflows.
+	 */
+	std::unique_ptr<std::atomic<FrameId>[]> hitLog;
+
+	/**
+	 * Number of hits ever logged; the next hit goes to slot hitHead % numBufs
+	 */
+	std::atomic<std::uint64_t> hitHead;
+
+	/**
+	 * Number of hits ever applied. Guarded by latch.
+	 */
+	std::uint64_t hitTail;
+};
+
+/**
+ * @brief LRU-K with K = 2. Frames are ordered by the time of their K-th most recent reference; pages referenced fewer
+ * than K times come first, least recently used first. Reference history of evicted pages is kept for as many pages
+ * as there are frames, so a page read in again is not mistaken for a new one.
+ */
+class LruKPolicy : public ListPolicy
+{
+ public:
+	/**
+	 * Number of references remembered per page
+	 */
+	static const std::uint32_t K = 2;
+
+	LruKPolicy(const std::uint32_t numBufs);
+
+	const char* name() const { return "lru-2"; }
+	void admit(const FrameId frameNo, const File* file, const PageId pageNo);
+	void evicted(const FrameId frameNo);
+	void release(const FrameId frameNo);
+	bool victim(FrameId& frame, const ClaimFunction& claim);
+	void upcoming(std::vector<FrameId>& frames, const std::uint32_t max);
+
+ private:
+	void hit(const FrameId frameNo);
+
+	/**
+	 * Times of the K most recent references of a page, most recent first; 0 if there were fewer.
+	 */
+	struct History
+	{
+		std::uint64_t times[K];
+	};
+
+	/**
+	 * Position of a frame in order: (K-th reference time, last reference time, frame)
+	 */
+	typedef std::pair<std::pair<std::uint64_t, std::uint64_t>, FrameId> OrderKey;
+
+	/**
+	 * Records a reference at the current time and repositions the frame. Caller holds latch.
+	 */
+	void reference(const FrameId frameNo);
+
+	/**
+	 * Key of a frame in order
+	 */
+	OrderKey orderKey(const FrameId frameNo) const;
+
+	/**
+	 * Logical clock, advanced on every reference
+	 */
+	std::uint64_t now;
+
+	/**
+	 * History of the page held by each frame
+	 */
+	std::vector<History> frameHistory;
+
+	/**
+	 * True if the frame holds a page and is in order
+	 */
+	std::vector<bool> resident;
+
+	/**
+	 * Resident frames, best victim first
+	 */
+	std::set<OrderKey> order;
+
+	/**
+	 * History of recently evicted pages and their position in retainedOrder
+	 */
+	std::map<PageKey, std::pair<History, std::list<PageKey>::iterator> > retained;
+
+	/**
+	 * Pages in retained, oldest first
+	 */
+	std::list<PageKey> retainedOrder;
+};
+
+/**
+ * @brief 2Q. Pages seen once sit in the FIFO A1in; once pushed out their identities are remembered in A1out, and a
+ * page referenced again while remembered there is placed in the LRU list Am. A scan therefore only cycles through
+ * A1in and cannot push hot pages out of Am.
+ */
+class TwoQPolicy : public ListPolicy
+{
+ public:
+	TwoQPolicy(const std::uint32_t numBufs);
+
+	const char* name() const { return "2q"; }
+	void admit(const FrameId frameNo, const File* file, const PageId pageNo);
+	void evicted(const FrameId frameNo);
+	void release(const FrameId frameNo);
+	bool victim(FrameId& frame, const ClaimFunction& claim);
+	void upcoming(std::vector<FrameId>& frames, const std::uint32_t max);
+
+ private:
+	void hit(const FrameId frameNo);
+
+	/**
+	 * List each frame is on
+	 */
+	enum Queue { NONE, A1IN, AM };
+
+	/**
+	 * Removes a frame from its list. Caller holds latch.
+	 */
+	void unlink(const FrameId frameNo);
+
+	/**
+	 * Target size of A1in (a quarter of the pool)
+	 */
+	std::uint32_t kin;
+
+	/**
+	 * Size of A1out (half the pool)
+	 */
+	std::uint32_t kout;
+
+	/**
+	 * Pages seen once, oldest first
+	 */
+	std::list<FrameId> a1in;
+
+	/**
+	 * Pages referenced again, least recently used first
+	 */
+	std::list<FrameId> am;
+
+	/**
+	 * Identities of pages pushed out of A1in, oldest first
+	 */
+	std::list<PageKey> a1out;
+
+	/**
+	 * Position of each page in a1out
+	 */
+	std::map<PageKey, std::list<PageKey>::iterator> a1outIndex;
+
+	/**
+	 * List and position of each frame
+	 */
+	std::vector<Queue> queue;
+	std::vector<std::list<FrameId>::iterator> position;
+};
+
+/**
+ * @brief Adaptive Replacement Cache. Resident pages are split between T1 (seen once recently) and T2 (seen at least
+ * twice); ghost lists B1 and B2 remember pages evicted from each. A hit in a ghost list moves the target size of T1
+ * towards the list that would have kept the page.
+ */
+class ArcPolicy : public ListPolicy
+{
+ public:
+	ArcPolicy(const std::uint32_t numBufs);
+
+	const char* name() const { return "arc"; }
+	void admit(const FrameId frameNo, const File* file, const PageId pageNo);
+	void evicted(const FrameId frameNo);
+	void release(const FrameId frameNo);
+	bool victim(FrameId& frame, const ClaimFunction& claim);
+	void upcoming(std::vector<FrameId>& frames, const std::uint32_t max);
+
+ private:
+	void hit(const FrameId frameNo);
+
+	/**
+	 * List each frame is on
+	 */
+	enum Queue { NONE, T1, T2 };
+
+	/**
+	 * A ghost list with an index of its pages
+	 */
+	struct GhostList
+	{
+		std::list<PageKey> pages;
+		std::map<PageKey, std::list<PageKey>::iterator> index;
+
+		void pushBack(const PageKey& key);
+		void popFront();
+		bool erase(const PageKey& key);
+	};
+
+	/**
+	 * Removes a frame from its list. Caller holds latch.
+	 */
+	void unlink(const FrameId frameNo);
+
+	/**
+	 * Drops the oldest ghosts until T1 and B1 together remember at most one pool's worth of pages and all four lists
+	 * at most two. Caller holds latch.
+	 */
+	void trimGhosts();
+
+	/**
+	 * Target size of T1
+	 */
+	std::uint32_t p;
+
+	/**
+	 * Resident lists, least recently used first
+	 */
+	std::list<FrameId> t1, t2;
+
+	/**
+	 * Ghost lists, oldest first
+	 */
+	GhostList b1, b2;
+
+	/**
+	 * List and position of each frame
+	 */
+	std::vector<Queue> queue;
+	std::vector<std::list<FrameId>::iterator> position;
+};
+
+}
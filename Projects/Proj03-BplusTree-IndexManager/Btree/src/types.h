@@ -9,6 +9,30 @@
 
 namespace badgerdb {
 
+/**
+ * @brief Datatype enumeration type.
+ */
+enum Datatype
+{
+	INTEGER = 0,
+	DOUBLE = 1,
+	STRING = 2
+};
+
+/**
+ * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method, which takes only the first four,
+ * and to ScanPredicate.
+ */
+enum Operator
+{ 
+	LT, 	/* Less Than */
+	LTE,	/* Less Than or Equal to */
+	GTE,	/* Greater Than or Equal to */
+	GT,		/* Greater Than */
+	EQ,		/* Equal to */
+	NE		/* Not Equal to */
+};
+
 /**
  * @brief Identifier for a page in a file.
  */